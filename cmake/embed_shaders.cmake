@@ -0,0 +1,34 @@
+# Writes OUTPUT, a C++ source that embeds the SPIR-V files of SHADERS (a
+# comma-separated list) as word arrays and lists them for shaders::embedded().
+# Run with cmake -P by the Shaders target.
+
+string(REPLACE "," ";" SHADER_LIST "${SHADERS}")
+
+set(ARRAYS "")
+set(ENTRIES "")
+foreach(SPIRV ${SHADER_LIST})
+  get_filename_component(NAME ${SPIRV} NAME)
+  string(MAKE_C_IDENTIFIER "${NAME}" SYMBOL)
+
+  # SPIR-V is little-endian words, so every 4 bytes are reversed into one
+  file(READ ${SPIRV} HEX HEX)
+  string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u,\n" WORDS "${HEX}")
+
+  string(APPEND ARRAYS "constexpr uint32_t ${SYMBOL}[] = {\n${WORDS}};\n\n")
+  string(APPEND ENTRIES
+    "    {\"${NAME}\", ${SYMBOL}, sizeof(${SYMBOL}) / sizeof(uint32_t)},\n")
+endforeach()
+
+file(WRITE ${OUTPUT}
+"// Generated by cmake/embed_shaders.cmake from the compiled shaders
+#include \"vulkan_base/shader_registry.h\"
+
+namespace {
+${ARRAYS}constexpr shaders::Embedded EMBEDDED[] = {
+${ENTRIES}};
+} // namespace
+
+namespace shaders {
+std::span<Embedded const> embedded() { return EMBEDDED; }
+} // namespace shaders
+")
@@ -0,0 +1,135 @@
+#pragma once
+
+#ifndef CHUNKED_STREAM_H
+#define CHUNKED_STREAM_H
+
+#include "compute_stream.h"
+#include "simple_compute_pipeline.h"
+#include "vulkan_base/buffer.h"
+#include "vulkan_base/command_buffer.h"
+#include "vulkan_base/vk_device.h"
+
+#include <memory>
+#include <vector>
+
+static constexpr VkDeviceSize DEFAULT_CHUNK_BYTES =
+    64ULL << 20; /**< Largest chunk of one array picked automatically **/
+static constexpr size_t DEFAULT_CHUNK_DEPTH =
+    3; /**< Chunks in flight, i. e. triple buffering **/
+
+/**
+ * \struct ChunkPushConstants
+ *
+ * \brief The push constants every chunked kernel starts with.
+ *
+ * The element index is split into two words, so the arrays may hold more
+ * elements than a 32 bit index reaches. Push constants of the kernel itself
+ * follow this header.
+ */
+struct ChunkPushConstants {
+    uint32_t base_low;  /**< Low word of the index of the first element **/
+    uint32_t base_high; /**< High word of the index of the first element **/
+    uint32_t count;     /**< Elements in the chunk **/
+    uint32_t pad;       /**< Aligns the kernel's own constants to 16 bytes **/
+};
+
+/**
+ * \class ChunkedStream
+ *
+ * \brief Streams arrays of any length through a kernel in fixed-size chunks.
+ *
+ * The input and output are host arrays that need not fit into a storage
+ * buffer or into device memory. Each chunk is uploaded into the input buffer
+ * of a slot, processed by one dispatch that binds the input to binding 0 and
+ * the output to binding 1 of set 0, and read back from the output buffer of
+ * the slot. With depth slots, the upload of one chunk, the dispatch of the
+ * next and the readback of a third overlap, while the device memory used
+ * stays at depth chunks, whatever the length of the arrays.
+ */
+class ChunkedStream {
+    /**
+     * \struct Slot
+     *
+     * \brief The buffers of one chunk in flight.
+     */
+    struct Slot {
+        std::unique_ptr<buffer::Buffer> input;  /**< Uploaded chunk **/
+        std::unique_ptr<buffer::Buffer> output; /**< Written by the kernel **/
+        scheduler::Point computed{}; /**< Dispatch that writes output **/
+        void *destination = nullptr; /**< Where output is read back to **/
+        size_t count = 0;            /**< Elements in flight, 0 when idle **/
+    };
+
+    std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+    SimpleComputePipeline &m_pipeline; /**< The chunked kernel **/
+    size_t m_inputStride;              /**< Bytes per input element **/
+    size_t m_outputStride;             /**< Bytes per output element **/
+    size_t m_chunkElements;            /**< Elements per chunk **/
+    ComputeStream m_stream;            /**< Submits the dispatches **/
+    std::vector<Slot> m_slots;
+    size_t m_nextSlot = 0; /**< Slot of the next chunk **/
+
+    /**
+     * \brief Waits for the chunk of slot and copies its output to the host.
+     */
+    void m_drain(Slot &slot);
+
+      public:
+    ChunkedStream() = delete;
+    ChunkedStream(ChunkedStream &&) = delete;
+    ChunkedStream(ChunkedStream const &) = delete;
+    ChunkedStream &operator=(ChunkedStream &&) = delete;
+    ChunkedStream &operator=(ChunkedStream const &) = delete;
+
+    /**
+     * \brief Creates the buffers of the slots.
+     *
+     * \param deviceHandler The device.
+     * \param commandBuffer The command buffer handler used by the buffers.
+     * \param pipeline A kernel whose push constants start with
+     * ChunkPushConstants; must outlive the stream.
+     * \param inputStride The size of an input element in bytes.
+     * \param outputStride The size of an output element in bytes.
+     * \param chunkElements Elements per chunk, or 0 for the most that fits
+     * into a storage buffer and DEFAULT_CHUNK_BYTES.
+     * \param depth The number of chunks in flight.
+     *
+     * \throw std::runtime_error if a stride is 0, or a chunk of
+     * chunkElements exceeds maxStorageBufferRange.
+     */
+    ChunkedStream(
+        std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+        std::shared_ptr<command_buffer::CommandBufferHandler> const
+            &commandBuffer,
+        SimpleComputePipeline &pipeline, size_t inputStride,
+        size_t outputStride, size_t chunkElements = 0,
+        size_t depth = DEFAULT_CHUNK_DEPTH);
+
+    /**
+     * \brief Waits for every chunk in flight.
+     */
+    ~ChunkedStream();
+
+    /**
+     * \brief Runs the kernel over count elements.
+     *
+     * Returns once output holds the results of all chunks. input is only
+     * read while the call runs.
+     *
+     * \param input count elements of inputStride bytes.
+     * \param output Room for count elements of outputStride bytes.
+     * \param count The number of elements.
+     * \param pConst The kernel's own push constants, pushed after the
+     * ChunkPushConstants of every chunk.
+     * \param pconst_size The size of pConst in bytes.
+     */
+    void run(void const *input, void *output, size_t count,
+             void const *pConst = nullptr, size_t pconst_size = 0);
+
+    /**
+     * \brief The number of elements per chunk.
+     */
+    [[nodiscard]] size_t chunkElements() const { return m_chunkElements; }
+};
+
+#endif
@@ -0,0 +1,105 @@
+#pragma once
+
+#ifndef COMPUTE_STREAM_H
+#define COMPUTE_STREAM_H
+
+#include "simple_compute_pipeline.h"
+#include "vulkan_base/command_buffer.h"
+#include "vulkan_base/scheduler.h"
+#include "vulkan_base/vk_device.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+static constexpr size_t DEFAULT_STREAM_DEPTH =
+    3; /**< Submissions a ComputeStream keeps in flight by default **/
+
+/**
+ * \class ComputeStream
+ *
+ * \brief Keeps several compute submissions in flight.
+ *
+ * The stream cycles through depth command buffers and submits them through
+ * the scheduler of its CommandBufferHandler. Submitting only waits for the
+ * timeline point of the slot about to be reused, i. e. for the submission
+ * made depth submissions ago, so the host records the next job while the
+ * device runs the previous ones. Every submission returns its point, which
+ * can be waited on, polled, or waited for by a submission to another queue.
+ * Each stream holds a scheduler::Lane, so several streams spread over the
+ * queues of the compute family.
+ */
+class ComputeStream {
+    std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+    std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer;
+    scheduler::Scheduler &m_scheduler;     /**< Submits every slot **/
+    scheduler::Lane m_lane;                /**< Queue of all submissions **/
+    std::vector<VkCommandBuffer> m_cmds;   /**< One command buffer per slot **/
+    std::vector<scheduler::Point> m_points; /**< Last point of every slot **/
+    size_t m_nextSlot = 0;                  /**< Slot of the next submission **/
+
+      public:
+    ComputeStream() = delete;
+    ComputeStream(ComputeStream &&) = delete;
+    ComputeStream(ComputeStream const &) = delete;
+    ComputeStream &operator=(ComputeStream &&) = delete;
+    ComputeStream &operator=(ComputeStream const &) = delete;
+
+    /**
+     * \brief Creates the command buffers of the slots.
+     *
+     * \param deviceHandler The device.
+     * \param commandBuffer The command pool owner.
+     * \param depth The number of submissions kept in flight.
+     */
+    ComputeStream(
+        std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+        std::shared_ptr<command_buffer::CommandBufferHandler> const
+            &commandBuffer,
+        size_t depth = DEFAULT_STREAM_DEPTH);
+
+    /**
+     * \brief Waits for all submissions and frees the command buffers.
+     */
+    ~ComputeStream();
+
+    /**
+     * \brief Records commands into the next slot and submits them.
+     *
+     * \param record Records the commands into a command buffer that has
+     * already been begun, and is ended after it returns.
+     * \param waits Points of other queues the commands wait for.
+     *
+     * \return The point of the submission.
+     */
+    scheduler::Point
+    submit(std::function<void(VkCommandBuffer)> const &record,
+           std::vector<scheduler::Wait> const &waits = {});
+
+    /**
+     * \brief Submits a single dispatch of pipeline.
+     *
+     * \return The point of the submission.
+     */
+    scheduler::Point dispatch(SimpleComputePipeline &pipeline,
+                      VkDescriptorSet const *descriptorSet,
+                      void const *pConst, size_t pconst_size,
+                      std::array<uint32_t, 3> const &disp_sizes);
+
+    /**
+     * \brief Waits until the submission of point has completed.
+     */
+    void wait(scheduler::Point const &point) const;
+
+    /**
+     * \brief Whether the submission of point has completed, without waiting.
+     */
+    [[nodiscard]] bool poll(scheduler::Point const &point) const;
+
+    /**
+     * \brief Waits for every submission made so far.
+     */
+    void waitAll() const;
+};
+
+#endif
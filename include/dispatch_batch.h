@@ -0,0 +1,153 @@
+#pragma once
+
+#ifndef DISPATCH_BATCH_H
+#define DISPATCH_BATCH_H
+
+#include "simple_compute_pipeline.h"
+#include "vulkan_base/command_buffer.h"
+#include "vulkan_base/scheduler.h"
+#include "vulkan_base/vk_device.h"
+
+#include <deque>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/**
+ * \enum Access
+ *
+ * \brief How a dispatch uses a buffer.
+ */
+enum class Access {
+    Read,      /**< Only read by the shader */
+    Write,     /**< Only written by the shader */
+    ReadWrite, /**< Both */
+};
+
+/**
+ * \struct BufferAccess
+ *
+ * \brief A range of a buffer a dispatch reads or writes.
+ */
+struct BufferAccess {
+    VkBuffer buffer;                   /**< The buffer */
+    Access access;                     /**< How the range is used */
+    VkDeviceSize offset = 0;           /**< First byte of the range */
+    VkDeviceSize size = VK_WHOLE_SIZE; /**< Size of the range */
+};
+
+/**
+ * \class DispatchBatch
+ *
+ * \brief Records many dispatches into one command buffer and submits it once.
+ *
+ * The dispatches may use different pipelines. Every dispatch lists the
+ * buffer ranges it reads and writes, and a barrier is only recorded before a
+ * dispatch that reads a range an earlier one wrote, or writes a range an
+ * earlier one used, since the last barrier. Independent dispatches thus run
+ * back to back without waiting on each other.
+ */
+class DispatchBatch {
+    /**
+     * \struct Range
+     *
+     * \brief A byte range of a buffer used since the last barrier.
+     */
+    struct Range {
+        VkDeviceSize begin; /**< First byte **/
+        VkDeviceSize end;   /**< One past the last byte **/
+        bool written;       /**< Whether a dispatch wrote it **/
+    };
+
+    std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+    std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer;
+    scheduler::Scheduler &m_scheduler;   /**< Submits the batches **/
+    VkCommandBuffer m_cmd = VK_NULL_HANDLE; /**< The batch being recorded **/
+    std::unordered_map<VkBuffer, std::vector<Range>>
+        m_used;                   /**< Ranges used since the last barrier **/
+    size_t m_dispatches = 0;      /**< Dispatches in the current batch **/
+    size_t m_barriers = 0;        /**< Barriers in the current batch **/
+    uint32_t m_scope = profiling::NO_SCOPE; /**< Times the current batch **/
+    std::deque<std::pair<scheduler::Point, VkCommandBuffer>>
+        m_pending;                         /**< Submitted, oldest first **/
+    std::vector<VkCommandBuffer> m_free;   /**< Ready to be recorded **/
+
+    /**
+     * \brief Begins a command buffer for the batch if there is none.
+     */
+    void m_begin();
+
+    /**
+     * \brief Records the barrier accesses need against the used ranges.
+     */
+    void m_barrier(std::vector<BufferAccess> const &accesses);
+
+      public:
+    DispatchBatch() = delete;
+    DispatchBatch(DispatchBatch &&) = delete;
+    DispatchBatch(DispatchBatch const &) = delete;
+    DispatchBatch &operator=(DispatchBatch &&) = delete;
+    DispatchBatch &operator=(DispatchBatch const &) = delete;
+
+    /**
+     * \brief Creates an empty batch.
+     *
+     * \param deviceHandler The device.
+     * \param commandBuffer The command pool owner.
+     */
+    DispatchBatch(
+        std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+        std::shared_ptr<command_buffer::CommandBufferHandler> const
+            &commandBuffer);
+
+    /**
+     * \brief Waits for all submitted batches and frees the command buffers.
+     *
+     * The dispatches of a batch that was never submitted are discarded, not
+     * run; call submit() first to run them.
+     */
+    ~DispatchBatch();
+
+    /**
+     * \brief Records a dispatch of pipeline into the batch.
+     *
+     * \param accesses Every buffer range the dispatch reads or writes.
+     *
+     * \return The batch, so that dispatches can be chained.
+     */
+    DispatchBatch &add(SimpleComputePipeline &pipeline,
+                       VkDescriptorSet const *descriptorSet,
+                       void const *pConst, size_t pconst_size,
+                       std::array<uint32_t, 3> const &disp_sizes,
+                       std::vector<BufferAccess> const &accesses);
+
+    /**
+     * \brief Submits the recorded dispatches in one submission.
+     *
+     * Writes of the batch are made visible to the host once it completes.
+     * Afterwards the batch is empty and can be filled again.
+     *
+     * \param waits Points of other queues the batch waits for.
+     *
+     * \return The point of the submission, a reached point if empty.
+     */
+    scheduler::Point submit(std::vector<scheduler::Wait> const &waits = {});
+
+    /**
+     * \brief Waits until the batch of point has completed.
+     */
+    void wait(scheduler::Point const &point) const;
+
+    /**
+     * \brief The number of dispatches recorded since the last submit.
+     */
+    [[nodiscard]] size_t size() const { return m_dispatches; }
+
+    /**
+     * \brief The number of barriers recorded since the last submit.
+     */
+    [[nodiscard]] size_t barriers() const { return m_barriers; }
+};
+
+#endif
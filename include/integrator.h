@@ -0,0 +1,155 @@
+#pragma once
+
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "recorded_dispatch.h"
+#include "reduction.h"
+#include "shader_variants.h"
+#include "simple_compute_pipeline.h"
+#include "vulkan_base/autotune.h"
+#include "vulkan_base/buffer.h"
+#include "vulkan_base/command_buffer.h"
+#include "vulkan_base/descriptor_allocator.h"
+#include "vulkan_base/vk_device.h"
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+/**
+ * \brief The default number of cells along x and y.
+ *
+ * Every invocation integrates one cell of the grid, so this is also about
+ * the number of partial sums the reduction folds per iteration; the grid is
+ * rounded up to whole workgroups.
+ */
+static constexpr std::array<uint32_t, 3> DEFAULT_INTEGRATION_GRID = {64, 64,
+                                                                     1};
+
+/**
+ * \struct IntegralParams
+ *
+ * \brief The parameter buffer of the integrand shaders.
+ *
+ * Matches the std430 layout of the Params block.
+ */
+struct IntegralParams {
+    IntegralPushContant bounds; /**< The rectangle and the number of steps */
+    std::array<uint32_t, 2> active; /**< Cells along x and y that integrate */
+};
+
+/**
+ * \struct IntegrationResult
+ *
+ * \brief The outcome of an adaptive integration.
+ */
+struct IntegrationResult {
+    double value = 0.0;    /**< The last (finest) estimate of the integral */
+    double abs_err = 0.0;  /**< Runge estimate of the absolute error */
+    double rel_err = 0.0;  /**< Runge estimate of the relative error */
+    size_t iterations = 0; /**< Number of times the step was halved */
+    bool converged = false; /**< Whether both tolerances were reached */
+};
+
+/**
+ * \class Integrator
+ *
+ * \brief Drives one of the integrand shaders until the estimate converges.
+ *
+ * Each round doubles splits_x and splits_y in the push constant and compares
+ * the new estimate with the previous one (Runge rule, for the order of the
+ * quadrature rule of the shader). The per-cell results
+ * are summed on the device by a Reduction, so only one double is read back
+ * per round. The buffers, descriptor sets and command buffers are created once
+ * and reused for every round and every call to integrate(): the shader and
+ * the reduction are recorded into a RecordedDispatch over the whole grid, and
+ * each round only writes its IntegralParams and replays it.
+ */
+class Integrator {
+    std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+    std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer;
+    std::array<uint32_t, 3> m_grid;   /**< The largest grid of cells **/
+    std::array<uint32_t, 3> m_groups; /**< Workgroups covering m_grid **/
+    uint32_t m_order; /**< The order of the quadrature rule of the shader **/
+
+    std::unique_ptr<descriptor::Allocator>
+        m_descriptors;                 /**< Sets of this and m_reduction **/
+    VkDescriptorSet m_descriptorSet{}; /**< Results at 0, params at 1 **/
+
+    std::unique_ptr<buffer::Buffer> m_results; /**< Per-cell sums **/
+    std::unique_ptr<Reduction> m_reduction;    /**< Sums m_results **/
+    std::unique_ptr<SimpleComputePipeline> m_pipeline;
+    std::unique_ptr<RecordedDispatch> m_dispatch; /**< Replayed every round **/
+
+    /**
+     * \brief Replays the shader once and sums the per-cell results.
+     *
+     * \param pConst The bounds and the number of steps.
+     *
+     * \return The integral estimate for the given number of steps.
+     */
+    double m_evaluate(IntegralPushContant const &pConst);
+
+      public:
+    Integrator() = delete;
+    Integrator(Integrator &&) = delete;
+    Integrator(Integrator const &) = delete;
+    Integrator &operator=(Integrator &&) = delete;
+    Integrator &operator=(Integrator const &) = delete;
+
+    /**
+     * \brief Creates the pipeline and all the per-integration resources.
+     *
+     * \param shader One of the integrand variants, see shaderVariants().
+     * \param rule The quadrature rule shader was built with.
+     * \param reduce The reduce.comp.spv shader.
+     * \param deviceHandler The device to run on.
+     * \param commandBuffer The command pool owner.
+     * \param grid The largest number of cells along x and y.
+     * \param pipelineCache The cache both pipelines are created through.
+     * \param workgroup The workgroup and subgroup size of the integrand,
+     * usually the tuned one of the device.
+     *
+     * \throw std::runtime_error if the device cannot run workgroup.
+     */
+    Integrator(
+        std::string const &shader, QuadratureRule rule,
+        std::string const &reduce,
+        std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+        std::shared_ptr<command_buffer::CommandBufferHandler> const
+            &commandBuffer,
+        std::array<uint32_t, 3> const &grid = DEFAULT_INTEGRATION_GRID,
+        VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+        tuning::Config const &workgroup = tuning::defaultConfig(2));
+    ~Integrator();
+
+    /**
+     * \brief Times the evaluation of one estimate, for tuning.
+     *
+     * \param pConst The bounds and the number of steps.
+     * \param rounds How many evaluations to average, after a warm-up one.
+     *
+     * \return The mean wall time of an evaluation in nanoseconds.
+     */
+    double benchmark(IntegralPushContant const &pConst, size_t rounds);
+
+    /**
+     * \brief Integrates over the rectangle in bounds.
+     *
+     * Starts from init_steps_x/init_steps_y and halves the step until the
+     * Runge estimate of the error, the difference between two successive
+     * estimates over 2^p - 1 for a rule of order p, is within both abs_err
+     * and rel_err, or max_iter refinements have been made.
+     *
+     * \param bounds The rectangle; the splits fields are ignored.
+     * \param config The parsed configuration (see process_config).
+     *
+     * \return The last estimate with its error estimates.
+     */
+    IntegrationResult
+    integrate(IntegralPushContant bounds,
+              std::unordered_map<std::string, double> const &config);
+};
+
+#endif
@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef RECORDED_DISPATCH_H
+#define RECORDED_DISPATCH_H
+
+#include "vulkan_base/buffer.h"
+#include "vulkan_base/command_buffer.h"
+#include "vulkan_base/scheduler.h"
+#include "vulkan_base/vk_device.h"
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * \class RecordedDispatch
+ *
+ * \brief Command buffers that are recorded once and submitted many times.
+ *
+ * Instead of push constants, the recorded shaders read their parameters from
+ * a host-visible storage buffer with one region per slot. Replaying writes
+ * the parameters into the next slot and submits its command buffer as it
+ * is, so a run costs a memcpy and a submission rather than a reset and a new
+ * recording. A slot is only reused once its previous submission completes.
+ *
+ * When the profiler measures batches, every replay is submitted between two
+ * small command buffers that write the timestamps of a "replay" scope, as a
+ * scope cannot be written into the recorded buffer itself.
+ *
+ * Replays go to the compute queue of the scheduler::Lane the dispatch holds,
+ * so the dispatches of independent integrations run side by side as long as
+ * the compute family has queues to spare.
+ */
+class RecordedDispatch {
+    std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+    std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer;
+    scheduler::Scheduler &m_scheduler;      /**< Submits every replay **/
+    scheduler::Lane m_lane;                 /**< Queue of all submissions **/
+    VkDeviceSize m_paramsSize;              /**< Size of one slot's params **/
+    VkDeviceSize m_stride;                  /**< Aligned size of a slot **/
+    std::unique_ptr<buffer::Buffer> m_params; /**< The params of all slots **/
+    std::vector<VkCommandBuffer> m_cmds;    /**< One command buffer per slot **/
+    std::vector<std::array<VkCommandBuffer, 2>>
+        m_stamps; /**< Timestamps around every slot, when profiled **/
+    std::vector<scheduler::Point> m_points; /**< Last point of every slot **/
+    size_t m_nextSlot = 0;                  /**< Slot of the next replay **/
+    bool m_recorded = false;                /**< Whether record was called **/
+
+      public:
+    RecordedDispatch() = delete;
+    RecordedDispatch(RecordedDispatch &&) = delete;
+    RecordedDispatch(RecordedDispatch const &) = delete;
+    RecordedDispatch &operator=(RecordedDispatch &&) = delete;
+    RecordedDispatch &operator=(RecordedDispatch const &) = delete;
+
+    /**
+     * \brief Creates the parameter buffer and the command buffers.
+     *
+     * \param deviceHandler The device.
+     * \param commandBuffer The command pool owner.
+     * \param paramsSize The size of the parameters of one replay.
+     * \param depth The number of replays that can be in flight.
+     */
+    RecordedDispatch(
+        std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+        std::shared_ptr<command_buffer::CommandBufferHandler> const
+            &commandBuffer,
+        VkDeviceSize paramsSize, size_t depth = 1);
+
+    /**
+     * \brief Waits for all replays and frees the command buffers.
+     */
+    ~RecordedDispatch();
+
+    /**
+     * \brief The range of the parameter buffer slot reads from.
+     *
+     * Bind it to the descriptor set used while recording slot.
+     */
+    [[nodiscard]] VkDescriptorBufferInfo paramsInfo(size_t slot) const;
+
+    /**
+     * \brief Records the command buffers of all slots, once.
+     *
+     * \param record Records the commands of a slot into a command buffer
+     * that has already been begun, and is ended after it returns.
+     */
+    void record(std::function<void(VkCommandBuffer, size_t)> const &record);
+
+    /**
+     * \brief Writes params into the next slot and submits it.
+     *
+     * \param params paramsSize bytes, copied before returning.
+     *
+     * \return The point of the submission.
+     */
+    scheduler::Point replay(void const *params);
+
+    /**
+     * \brief Waits until the replay of point has completed.
+     */
+    void wait(scheduler::Point const &point) const;
+
+    /**
+     * \brief Waits for every replay made so far.
+     */
+    void waitAll() const;
+
+    /**
+     * \brief The number of slots.
+     */
+    [[nodiscard]] size_t depth() const { return m_cmds.size(); }
+};
+
+#endif
@@ -0,0 +1,86 @@
+#pragma once
+
+#ifndef REDUCTION_H
+#define REDUCTION_H
+
+#include "simple_compute_pipeline.h"
+#include "vulkan_base/buffer.h"
+#include "vulkan_base/command_buffer.h"
+#include "vulkan_base/descriptor_allocator.h"
+#include "vulkan_base/vk_device.h"
+
+#include <memory>
+#include <string>
+
+static constexpr uint32_t REDUCE_MAX_WORKGROUPS =
+    256; /**< Upper bound on the partials of the first pass **/
+
+/**
+ * \class Reduction
+ *
+ * \brief Sums an array of doubles on the device.
+ *
+ * The first pass of reduce.comp folds the input into at most
+ * REDUCE_MAX_WORKGROUPS partials, the second folds those into a single double
+ * in a small host-visible buffer, so the host reads 8 bytes instead of the
+ * whole input. Workgroups sum with subgroup arithmetic where compute shaders
+ * have it, and with a tree in shared memory otherwise.
+ */
+class Reduction {
+    std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+
+    VkDescriptorSet m_firstPass{};  /**< input -> m_partials **/
+    VkDescriptorSet m_secondPass{}; /**< m_partials -> m_result **/
+
+    std::unique_ptr<buffer::Buffer> m_partials;
+    std::unique_ptr<buffer::Buffer> m_result;
+    std::unique_ptr<SimpleComputePipeline> m_pipeline;
+
+      public:
+    Reduction() = delete;
+    Reduction(Reduction &&) = delete;
+    Reduction(Reduction const &) = delete;
+    Reduction &operator=(Reduction &&) = delete;
+    Reduction &operator=(Reduction const &) = delete;
+
+    /**
+     * \brief Creates the reduction of input.
+     *
+     * \param shader The reduce.comp.spv shader. Without subgroup
+     * arithmetic its TREE build, the same name ending in .tree.spv, is used
+     * instead.
+     * \param deviceHandler The device.
+     * \param commandBuffer The command buffer handler used by the buffers.
+     * \param input The storage buffer of doubles to be summed.
+     * \param inputRange The size of input in bytes.
+     * \param descriptors Allocates both descriptor sets; must outlive the
+     * reduction.
+     * \param pipelineCache The cache the pipeline is created through.
+     */
+    Reduction(std::string const &shader,
+              std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+              std::shared_ptr<command_buffer::CommandBufferHandler> const
+                  &commandBuffer,
+              VkBuffer input, VkDeviceSize inputRange,
+              descriptor::Allocator &descriptors,
+              VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+    ~Reduction();
+
+    /**
+     * \brief Records both passes into buf.
+     *
+     * The recorded commands wait for earlier compute writes to the input and
+     * make the result visible to the host once the submission completes.
+     *
+     * \param buf A command buffer in the recording state.
+     * \param count The number of doubles of the input to sum.
+     */
+    void record(VkCommandBuffer buf, uint32_t count);
+
+    /**
+     * \brief The sum written by the last completed submission of record.
+     */
+    [[nodiscard]] double result() const;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#pragma once
+
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include "vulkan_base/autotune.h"
+#include "vulkan_base/vk_device.h"
+
+#include <array>
+#include <functional>
+#include <optional>
+#include <span>
+#include <vector>
+
+static constexpr double FP64_WEAK_RATIO =
+    4.0; /**< How much faster fp32 accumulation has to be for the tuner to
+            give up double precision for it **/
+static constexpr std::array<uint32_t, 2> DEFAULT_TILE = {
+    8, 8}; /**< The workgroup of the integrands without a tuned one, which
+              every device supports **/
+
+/**
+ * \brief Where in every step the integrand is sampled.
+ */
+enum class QuadratureRule {
+    Rectangle, /**< The corner, as the integrands always did **/
+    Midpoint,  /**< The middle, one order more accurate **/
+};
+
+/**
+ * \brief The order of accuracy of rule: halving the step divides its error
+ * by 2 to this power.
+ */
+constexpr uint32_t ruleOrder(QuadratureRule rule) {
+    return rule == QuadratureRule::Midpoint ? 2 : 1;
+}
+
+/**
+ * \brief The precision the integrand is evaluated and summed in.
+ */
+enum class Accumulation {
+    Fp64, /**< Doubles throughout **/
+    Fp32, /**< Floats with compensated sums, for GPUs with slow doubles **/
+};
+
+/**
+ * \struct ShaderVariant
+ *
+ * \brief One point of the integrand variant matrix declared in
+ * CMakeLists.txt, tagged with what it was built with.
+ */
+struct ShaderVariant {
+    char const *name;          /**< The embedded shader **/
+    uint32_t integrand;        /**< The function integrated, 1 to 3 **/
+    QuadratureRule rule;       /**< Where steps are sampled **/
+    Accumulation accumulation; /**< The precision of the sums **/
+};
+
+/**
+ * \struct VariantChoice
+ *
+ * \brief A variant and the workgroup to specialize it to.
+ */
+struct VariantChoice {
+    ShaderVariant variant;
+    tuning::Config workgroup;
+};
+
+/**
+ * \brief Every variant the build compiled.
+ *
+ * Defined in the source CMake generates from the matrix.
+ */
+std::span<ShaderVariant const> shaderVariants();
+
+/**
+ * \brief The variants of integrand with rule, doubles before floats.
+ *
+ * \param accumulation Only keeps the variants of this precision if set.
+ */
+std::vector<ShaderVariant>
+variantsOf(uint32_t integrand, QuadratureRule rule,
+           std::optional<Accumulation> accumulation = std::nullopt);
+
+/**
+ * \brief Picks the variant of candidates to run on device.
+ *
+ * A candidate tuning has stored a workgroup for in db wins, with that
+ * workgroup. Otherwise it is the first candidate, with DEFAULT_TILE as the
+ * workgroup.
+ *
+ * \param candidates Variants in order of preference, usually from
+ * variantsOf.
+ *
+ * \throw std::runtime_error if the device has no double precision, which the
+ * cell sums of every variant are stored in, or there is no candidate.
+ */
+VariantChoice selectVariant(device::DeviceHandler const &device,
+                            tuning::Database const &db,
+                            std::vector<ShaderVariant> const &candidates);
+
+/**
+ * \brief Tunes the workgroup of candidates and stores the fastest in db.
+ *
+ * The workgroup of the first variant of each precision is swept. Floats are
+ * picked over doubles only if they are FP64_WEAK_RATIO times as fast.
+ *
+ * \param measure Times a variant with a workgroup; see tuning::tune.
+ *
+ * \throw std::runtime_error if no candidate could be measured.
+ */
+VariantChoice
+tuneVariant(device::DeviceHandler const &device, tuning::Database &db,
+            std::vector<ShaderVariant> const &candidates,
+            std::function<double(ShaderVariant const &,
+                                 tuning::Config const &)> const &measure);
+
+#endif
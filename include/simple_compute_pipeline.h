@@ -5,8 +5,16 @@
 #define BASIC_COMPUTE_PIPELINE_H
 
 #include "sync_objects.h"
+#include "vulkan_base/autotune.h"
+#include "vulkan_base/descriptor_allocator.h"
+#include "vulkan_base/profiler.h"
+#include "vulkan_base/reflection.h"
 #include "vulkan_base/vk_device.h"
+#include <functional>
 #include <memory>
+#include <optional>
+#include <string>
+#include <vector>
 
 struct IntegralPushContant {
     double start_x;
@@ -18,20 +26,72 @@ struct IntegralPushContant {
     double splits_y;
 };
 
+/**
+ * \brief How the buffers passed to record at record time are bound.
+ */
+enum class DescriptorMode {
+    Sets, /**< Written once into a cached set from a pool **/
+    Push, /**< Pushed into the command buffer, no set is allocated **/
+};
+
 class SimpleComputePipeline {
     std::shared_ptr<device::DeviceHandler> m_deviceHandler;
-    VkDescriptorSetLayout
-        *m_descriptorSetLayout;        /**< The descriptor set layout **/
+    reflection::ShaderLayout m_reflection; /**< Read from the shader **/
+    std::vector<reflection::Binding> m_bindings; /**< The bindings of set 0 **/
+    DescriptorMode m_descriptorMode = DescriptorMode::Sets;
+    std::unique_ptr<descriptor::Allocator>
+        m_descriptors; /**< Sets bound by buffers, null if pushed **/
+    PFN_vkCmdPushDescriptorSetKHR m_pushDescriptorSet =
+        nullptr; /**< Null unless set 0 is pushed **/
+    std::vector<VkDescriptorSetLayout>
+        m_setLayouts;                  /**< The layout of every set **/
+    bool m_ownsLayouts = false;        /**< Whether they were reflected **/
     VkPipelineLayout pipelineLayout{}; /**< The pipeline layout. */
     VkPipeline pipeline{};             /**< The compute pipeline. */
+    profiling::Profiler *m_profiler = nullptr; /**< Times every dispatch **/
+    std::string m_name;        /**< What the dispatches are timed under **/
+    double m_createTime = 0.0; /**< Nanoseconds vkCreateComputePipelines took **/
 
     /**
      * \brief Performs cleanup operations for the graphics pipeline.
      */
     void cleanup();
+
+    /**
+     * \brief Loads the shader from the registry of the device and reflects
+     * it into m_reflection.
+     */
+    void m_reflect(std::string const &shader);
+
+    /**
+     * \brief Creates the pipeline layout with m_setLayouts, and the pipeline,
+     * specialized to workgroup if it is set.
+     *
+     * \throw std::runtime_error if workgroup exceeds the device limits, sets
+     * a workgroup size the shader fixes, or a subgroup size the device cannot
+     * require.
+     */
+    void m_create(VkShaderModule module, uint32_t pconst_size,
+                  VkPipelineCache pipelineCache,
+                  std::optional<tuning::Config> const &workgroup);
+
     void pushConstant(VkCommandBuffer buf, void const *push_const,
                       size_t pconst_size);
 
+    /**
+     * \brief Records the push constants and the dispatch, once the pipeline
+     * and its descriptors are bound.
+     */
+    void m_record(VkCommandBuffer buf, void const *pConst, size_t pconst_size,
+                  std::array<uint32_t, 3> const &disp_sizes);
+
+    /**
+     * \brief Records buf with record in the slot iter of objs and submits it,
+     * then waits for it if wait is set.
+     */
+    void m_submit(VkCommandBuffer buf, SyncObjects const &objs, size_t iter,
+                  std::function<void()> const &record, bool wait);
+
       public:
     SimpleComputePipeline() = delete;
     SimpleComputePipeline(SimpleComputePipeline &&) = delete;
@@ -39,20 +99,178 @@ class SimpleComputePipeline {
     SimpleComputePipeline &operator=(SimpleComputePipeline &&) = delete;
     SimpleComputePipeline &operator=(SimpleComputePipeline const &) = delete;
 
+    /**
+     * \brief Creates the compute pipeline from a shader of the registry.
+     *
+     * \param shader The name of the .spv file, e. g. compute.comp.spv.
+     * \param m_deviceHandler The device.
+     * \param layout The descriptor set layout of the shader.
+     * \param pconst_size The size of the push constant block, 0 if the shader
+     * has none.
+     * \param pipelineCache A cache to create the pipeline through, usually a
+     * pipeline_cache::PipelineCache shared by all pipelines of the device.
+     *
+     * \throw std::runtime_error if pconst_size is smaller than the push
+     * constant block of the shader.
+     */
+    SimpleComputePipeline(
+        std::string shader,
+        std::shared_ptr<device::DeviceHandler> const &m_deviceHandler,
+        VkDescriptorSetLayout *layout,
+        uint32_t pconst_size = sizeof(IntegralPushContant),
+        VkPipelineCache pipelineCache = VK_NULL_HANDLE);
+
+    /**
+     * \brief Creates the compute pipeline and its layouts from the reflection
+     * of a shader of the registry.
+     *
+     * The set layouts, the push constant range and the entry point all come
+     * from the shader; get the layouts with descriptorSetLayout to allocate
+     * the sets.
+     *
+     * With DescriptorMode::Push, set 0 is pushed by the record and dispatch
+     * overloads that take buffers, and its layout cannot be allocated from.
+     * If the device has no VK_KHR_push_descriptor, or set 0 has more
+     * descriptors than one push may write, the pipeline falls back to
+     * DescriptorMode::Sets; check descriptorMode.
+     *
+     * \param shader The name of the .spv file.
+     * \param m_deviceHandler The device.
+     * \param pipelineCache A cache to create the pipeline through.
+     * \param mode How buffers passed at record time are bound.
+     * \param workgroup The workgroup and subgroup size to specialize the
+     * shader to, which must declare its workgroup size with
+     * local_size_*_id; the shader's own size if empty.
+     *
+     * \throw std::runtime_error if workgroup cannot be applied, see m_create.
+     */
     SimpleComputePipeline(
-        std::string shader_path,
+        std::string shader,
         std::shared_ptr<device::DeviceHandler> const &m_deviceHandler,
-        VkDescriptorSetLayout *layout);
+        VkPipelineCache pipelineCache = VK_NULL_HANDLE,
+        DescriptorMode mode = DescriptorMode::Sets,
+        std::optional<tuning::Config> const &workgroup = std::nullopt);
     ~SimpleComputePipeline() { cleanup(); }
 
+    /**
+     * \brief Times every dispatch recorded from now on with profiler.
+     *
+     * The dispatches are profiling::Level::Dispatch scopes, and the time the
+     * pipeline took to create is added as a sample of "<name> create". A
+     * scope is one-shot, so a pipeline recorded into a RecordedDispatch must
+     * not be profiled.
+     *
+     * \param profiler The profiler, or null to stop timing.
+     * \param name What to time under, the name of the shader file if empty.
+     */
+    void setProfiler(profiling::Profiler *profiler,
+                     std::string const &name = "");
+
+    /**
+     * \brief The descriptors, push constants and workgroup size of the shader,
+     * after specialization.
+     */
+    [[nodiscard]] reflection::ShaderLayout const &reflection() const {
+        return m_reflection;
+    }
+
+    /**
+     * \brief The layout of set, owned by the pipeline if it was reflected.
+     */
+    [[nodiscard]] VkDescriptorSetLayout *descriptorSetLayout(uint32_t set = 0) {
+        return &m_setLayouts.at(set);
+    }
+
+    /**
+     * \brief How the buffers passed at record time are bound.
+     */
+    [[nodiscard]] DescriptorMode descriptorMode() const {
+        return m_descriptorMode;
+    }
+
+    /**
+     * \brief Drops the cached sets that bind buffer, before it is destroyed.
+     *
+     * Only needed with DescriptorMode::Sets, where the record overloads that
+     * take buffers cache a set per distinct list of buffers.
+     */
+    void forget(VkBuffer buffer);
+
+    /**
+     * \brief The workgroups that cover invocations with the shader's
+     * workgroup size.
+     */
+    [[nodiscard]] std::array<uint32_t, 3>
+    groupCount(std::array<uint32_t, 3> const &invocations) const {
+        return m_reflection.groupCount(invocations);
+    }
+
+    /**
+     * \brief Records binding the pipeline and the dispatch into buf.
+     *
+     * Unlike dispatch, this neither begins, ends nor submits buf, so several
+     * dispatches and barriers can share one command buffer. descriptorSet is
+     * null for a shader that reaches all of its buffers through device
+     * addresses in its push constants.
+     */
+    void record(VkCommandBuffer buf, VkDescriptorSet const *descriptorSet,
+                void const *pConst, size_t pconst_size,
+                std::array<uint32_t, 3> const &disp_sizes);
+
+    /**
+     * \brief Like record, but binds buffers to the buffer bindings of set 0
+     * in the order of the shader.
+     *
+     * The buffers are pushed with DescriptorMode::Push, so nothing is
+     * allocated or updated up front. Otherwise they are bound through a set
+     * that is written the first time these buffers are seen, and reused
+     * after.
+     *
+     * \throw std::runtime_error if the pipeline was created with a layout
+     * of its own, or buffers do not match the bindings of set 0.
+     */
+    void record(VkCommandBuffer buf,
+                std::vector<VkDescriptorBufferInfo> const &buffers,
+                void const *pConst, size_t pconst_size,
+                std::array<uint32_t, 3> const &disp_sizes);
+
+    /**
+     * \brief Records and submits a dispatch in the slot iter of objs.
+     *
+     * Only waits for the fence of the previous submission of the same slot
+     * before buf is reset and re-recorded. buf must therefore be the command
+     * buffer of slot iter % objs.fences.size() alone; with one per slot, up
+     * to objs.fences.size() dispatches can be in flight, and with a single
+     * buffer for every slot they must be made with dispatch_s. See
+     * ComputeStream for a version that also manages the command buffers.
+     */
     void dispatch(VkCommandBuffer buf, VkDescriptorSet const *descriptorSet,
                   SyncObjects const &objs, size_t iter, void const *pConst,
                   size_t pconst_size,
                   std::array<uint32_t, 3> const &disp_sizes);
+    /**
+     * \brief Like dispatch, but binds buffers like record does.
+     */
+    void dispatch(VkCommandBuffer buf,
+                  std::vector<VkDescriptorBufferInfo> const &buffers,
+                  SyncObjects const &objs, size_t iter, void const *pConst,
+                  size_t pconst_size,
+                  std::array<uint32_t, 3> const &disp_sizes);
+    /**
+     * \brief Like dispatch, but waits for the dispatch to complete.
+     */
     void dispatch_s(VkCommandBuffer buf, VkDescriptorSet const *descriptorSet,
                     SyncObjects const &objs, size_t iter, void const *pConst,
                     size_t pconst_size,
                     std::array<uint32_t, 3> const &disp_sizes);
+    /**
+     * \brief Like dispatch_s, but binds buffers like record does.
+     */
+    void dispatch_s(VkCommandBuffer buf,
+                    std::vector<VkDescriptorBufferInfo> const &buffers,
+                    SyncObjects const &objs, size_t iter, void const *pConst,
+                    size_t pconst_size,
+                    std::array<uint32_t, 3> const &disp_sizes);
 };
 
 #endif
@@ -0,0 +1,374 @@
+#pragma once
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+#include "common.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace device {
+class DeviceHandler;
+} // namespace device
+
+namespace memory {
+static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE =
+    VkDeviceSize{64} << 20; /**< Size of the blocks sub-allocated from */
+static constexpr VkDeviceSize MIN_ALLOCATION_SIZE =
+    256; /**< The smallest buddy, also the smallest alignment handed out */
+static constexpr VkDeviceSize HEAP_BLOCK_FRACTION =
+    8; /**< A block never takes more than this fraction of its heap */
+static constexpr VkDeviceSize SMALL_BAR_HEAP_SIZE =
+    VkDeviceSize{256} << 20; /**< The BAR heap without resizable BAR; only a
+                                bigger device-local, host-visible heap is
+                                preferred for uploads */
+
+/**
+ * \enum Usage
+ *
+ * \brief How a buffer is accessed, which decides its memory type.
+ */
+enum class Usage {
+  GpuOnly,          /**< Only the device reads and writes it */
+  Upload,           /**< Written sequentially by the host, read by kernels;
+                       device-local with resizable BAR */
+  Readback,         /**< Written by kernels, read by the host; cached */
+  HostRandomAccess, /**< Read and written by the host in any order; cached */
+};
+
+/**
+ * \struct MemoryBlock
+ *
+ * \brief One VkDeviceMemory split into power-of-two buddies.
+ */
+struct MemoryBlock {
+  VkDeviceMemory memory = VK_NULL_HANDLE; /**< The backing allocation */
+  VkDeviceSize size = 0;                  /**< Size of memory in bytes */
+  uint32_t memoryTypeIndex = 0;           /**< The memory type of memory */
+  VkMemoryAllocateFlags allocFlags = 0;   /**< Flags memory was made with */
+  void *mapped = nullptr; /**< The whole block, if it is host visible */
+  VkDeviceSize used = 0;  /**< Bytes currently handed out */
+  std::vector<std::set<VkDeviceSize>>
+      freeLists; /**< Offsets of the free buddies of each order */
+};
+
+/**
+ * \struct Allocation
+ *
+ * \brief A range of device memory handed out by the Allocator.
+ */
+struct Allocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE; /**< The memory the range is in */
+  VkDeviceSize offset = 0; /**< Offset of the range within memory */
+  VkDeviceSize size = 0;   /**< Size of the range, at least the requested */
+  void *mapped = nullptr;  /**< Host pointer to offset, if host visible */
+  uint32_t memoryTypeIndex = 0;  /**< The memory type of memory */
+  MemoryBlock *block = nullptr;  /**< The owning block, null if dedicated */
+  uint32_t order = 0;            /**< The buddy order within block */
+
+  /**
+   * \brief Whether the range owns its VkDeviceMemory.
+   */
+  [[nodiscard]] bool dedicated() const { return block == nullptr; }
+};
+
+/**
+ * \class Allocator
+ *
+ * \brief Sub-allocates device memory out of large blocks.
+ *
+ * Each memory type (and set of allocation flags) gets its own pool of
+ * blocks, and each block is managed as a buddy system with one free list per
+ * power-of-two order. Resources bigger than half a block, or for which the
+ * driver asks for it, get a dedicated VkDeviceMemory instead. Host-visible
+ * blocks are mapped once when created and stay mapped, so mapping a buffer is
+ * free. All methods are thread safe.
+ */
+class Allocator {
+public:
+  Allocator(Allocator &&) = delete;
+  Allocator(Allocator const &) = delete;
+  Allocator &operator=(Allocator &&) = delete;
+  Allocator &operator=(Allocator const &) = delete;
+
+  /**
+   * \brief Creates an empty allocator.
+   *
+   * \param deviceHandler The device the memory is allocated on.
+   * \param blockSize The preferred block size, a power of two.
+   */
+  explicit Allocator(device::DeviceHandler const &deviceHandler,
+                     VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE);
+
+  /**
+   * \brief Frees every block. All allocations must have been freed.
+   */
+  ~Allocator();
+
+  /**
+   * \fn Allocation allocate(VkMemoryRequirements const &requirements,
+   * VkMemoryPropertyFlags properties, bool linear, VkMemoryAllocateFlags
+   * allocFlags, bool dedicated)
+   *
+   * \brief Allocates memory fitting requirements.
+   *
+   * \param requirements The size, alignment and allowed memory types.
+   * \param properties The properties the memory type must have.
+   * \param linear False for optimally tiled images, which are kept
+   * bufferImageGranularity apart from linear resources.
+   * \param allocFlags Flags for VkMemoryAllocateFlagsInfo, e. g. device
+   * address.
+   * \param dedicated Whether to give the resource its own VkDeviceMemory.
+   *
+   * \return The allocation.
+   *
+   * \throw std::runtime_error if the device is out of memory.
+   */
+  Allocation allocate(VkMemoryRequirements const &requirements,
+                      VkMemoryPropertyFlags properties, bool linear = true,
+                      VkMemoryAllocateFlags allocFlags = 0,
+                      bool dedicated = false);
+
+  /**
+   * \fn Allocation allocateBuffer(VkBuffer buffer, VkBufferUsageFlags usage,
+   * VkMemoryPropertyFlags properties)
+   *
+   * \brief Allocates memory for buffer and binds it.
+   *
+   * A dedicated allocation is made if the driver prefers one for buffer.
+   *
+   * \param buffer The buffer to back.
+   * \param usage The usage buffer was created with.
+   * \param properties The properties the memory type must have.
+   *
+   * \return The allocation bound to buffer.
+   */
+  Allocation allocateBuffer(VkBuffer buffer, VkBufferUsageFlags usage,
+                            VkMemoryPropertyFlags properties);
+
+  /**
+   * \fn Allocation allocateBuffer(VkBuffer buffer, VkBufferUsageFlags usage,
+   * Usage intent)
+   *
+   * \brief Allocates memory for buffer in the type that suits intent best,
+   * and binds it.
+   *
+   * \param buffer The buffer to back.
+   * \param usage The usage buffer was created with.
+   * \param intent How the buffer is accessed.
+   *
+   * \return The allocation bound to buffer.
+   */
+  Allocation allocateBuffer(VkBuffer buffer, VkBufferUsageFlags usage,
+                            Usage intent);
+
+  /**
+   * \fn void free(Allocation &allocation)
+   *
+   * \brief Returns allocation to its block, and resets it.
+   *
+   * Ranges of it still waiting to be flushed or invalidated are dropped.
+   *
+   * \param allocation The allocation to free, may be empty.
+   */
+  void free(Allocation &allocation);
+
+  /**
+   * \fn void flush(Allocation const &allocation, VkDeviceSize offset,
+   * VkDeviceSize size)
+   *
+   * \brief Makes host writes to a range of allocation visible to the device
+   * now.
+   *
+   * The range is widened to nonCoherentAtomSize. Nothing is done for
+   * coherent memory.
+   *
+   * \param offset The start of the range, relative to allocation.
+   * \param size The size of the range, or VK_WHOLE_SIZE for the rest.
+   */
+  void flush(Allocation const &allocation, VkDeviceSize offset = 0,
+             VkDeviceSize size = VK_WHOLE_SIZE);
+
+  /**
+   * \fn void invalidate(Allocation const &allocation, VkDeviceSize offset,
+   * VkDeviceSize size)
+   *
+   * \brief Makes device writes to a range of allocation visible to the host
+   * now; see flush().
+   */
+  void invalidate(Allocation const &allocation, VkDeviceSize offset = 0,
+                  VkDeviceSize size = VK_WHOLE_SIZE);
+
+  /**
+   * \fn void markWritten(Allocation const &allocation, VkDeviceSize offset,
+   * VkDeviceSize size)
+   *
+   * \brief Notes that the host wrote a range of allocation, which
+   * flushWritten() flushes.
+   *
+   * Nothing is noted for coherent memory.
+   */
+  void markWritten(Allocation const &allocation, VkDeviceSize offset = 0,
+                   VkDeviceSize size = VK_WHOLE_SIZE);
+
+  /**
+   * \fn void markRead(Allocation const &allocation, VkSemaphore semaphore,
+   * uint64_t value, VkDeviceSize offset, VkDeviceSize size)
+   *
+   * \brief Notes that the host is going to read a range of allocation once
+   * the timeline semaphore reaches value, which invalidateRead() invalidates.
+   *
+   * Nothing is noted for coherent memory.
+   *
+   * \param semaphore The timeline signalled by the work writing the range.
+   * \param value The value semaphore reaches when that work is done.
+   */
+  void markRead(Allocation const &allocation, VkSemaphore semaphore,
+                uint64_t value, VkDeviceSize offset = 0,
+                VkDeviceSize size = VK_WHOLE_SIZE);
+
+  /**
+   * \fn void flushWritten()
+   *
+   * \brief Flushes every range noted by markWritten() with one call, after
+   * merging them.
+   *
+   * Called before every submission.
+   */
+  void flushWritten();
+
+  /**
+   * \fn void invalidateRead(VkSemaphore semaphore, uint64_t reached)
+   *
+   * \brief Invalidates the ranges noted by markRead() against semaphore up
+   * to reached with one call, after merging them.
+   *
+   * Called whenever a timeline point is waited for or seen reached. Ranges
+   * of later values, or of other semaphores, stay noted until theirs is.
+   */
+  void invalidateRead(VkSemaphore semaphore, uint64_t reached);
+
+private:
+  using PoolKey = std::pair<uint32_t, VkMemoryAllocateFlags>;
+
+  /**
+   * \struct Range
+   *
+   * \brief Bytes [begin, end) of a VkDeviceMemory.
+   */
+  struct Range {
+    VkDeviceSize begin = 0; /**< The first byte */
+    VkDeviceSize end = 0;   /**< Past the last byte */
+  };
+
+  using PendingRanges =
+      std::map<VkDeviceMemory, std::vector<Range>>; /**< By memory */
+  using ReadPoint =
+      std::pair<VkSemaphore, uint64_t>; /**< What a read range waits for */
+
+  /**
+   * \fn std::optional<Range> m_atomRange(Allocation const &allocation,
+   * VkDeviceSize offset, VkDeviceSize size) const
+   *
+   * \brief The range of memory to flush or invalidate for a range of
+   * allocation, none if its memory is coherent or not mapped.
+   */
+  [[nodiscard]] std::optional<Range> m_atomRange(Allocation const &allocation,
+                                                 VkDeviceSize offset,
+                                                 VkDeviceSize size) const;
+
+  /**
+   * \fn static std::vector<VkMappedMemoryRange> m_coalesce(PendingRanges
+   * &pending)
+   *
+   * \brief Merges the overlapping and adjacent ranges of pending into
+   * mapped memory ranges, and empties it.
+   */
+  static std::vector<VkMappedMemoryRange> m_coalesce(PendingRanges &pending);
+
+  /**
+   * \fn VkDeviceMemory m_allocateMemory(VkDeviceSize size, uint32_t
+   * memoryTypeIndex, VkMemoryAllocateFlags allocFlags, VkBuffer buffer)
+   *
+   * \brief Calls vkAllocateMemory.
+   *
+   * \param buffer If not null, the buffer the memory is dedicated to.
+   */
+  VkDeviceMemory m_allocateMemory(VkDeviceSize size, uint32_t memoryTypeIndex,
+                                  VkMemoryAllocateFlags allocFlags,
+                                  VkBuffer buffer = VK_NULL_HANDLE);
+
+  /**
+   * \fn Allocation m_allocate(VkMemoryRequirements const &requirements,
+   * uint32_t memoryTypeIndex, bool linear, VkMemoryAllocateFlags allocFlags,
+   * bool dedicated, VkBuffer buffer)
+   *
+   * \brief allocate() from a chosen memory type, without taking the lock.
+   *
+   * \param buffer If not null, the buffer a dedicated allocation is for.
+   */
+  Allocation m_allocate(VkMemoryRequirements const &requirements,
+                        uint32_t memoryTypeIndex, bool linear,
+                        VkMemoryAllocateFlags allocFlags, bool dedicated,
+                        VkBuffer buffer = VK_NULL_HANDLE);
+
+  /**
+   * \fn Allocation m_allocateBuffer(VkBuffer buffer, VkBufferUsageFlags
+   * usage, std::function<uint32_t(uint32_t)> const &memoryType)
+   *
+   * \brief Allocates memory for buffer and binds it.
+   *
+   * \param memoryType Picks the memory type out of the allowed type bits.
+   */
+  Allocation
+  m_allocateBuffer(VkBuffer buffer, VkBufferUsageFlags usage,
+                   std::function<uint32_t(uint32_t)> const &memoryType);
+
+  /**
+   * \fn Allocation m_allocateDedicated(VkDeviceSize size, uint32_t
+   * memoryTypeIndex, VkMemoryAllocateFlags allocFlags, VkBuffer buffer)
+   *
+   * \brief Makes an allocation with its own VkDeviceMemory.
+   */
+  Allocation m_allocateDedicated(VkDeviceSize size, uint32_t memoryTypeIndex,
+                                 VkMemoryAllocateFlags allocFlags,
+                                 VkBuffer buffer = VK_NULL_HANDLE);
+
+  /**
+   * \fn VkDeviceSize m_blockSize(uint32_t memoryTypeIndex) const
+   *
+   * \brief The block size of a memory type, smaller for small heaps.
+   */
+  [[nodiscard]] VkDeviceSize m_blockSize(uint32_t memoryTypeIndex) const;
+
+  /**
+   * \fn bool m_takeBuddy(MemoryBlock &block, uint32_t order, VkDeviceSize
+   * &offset)
+   *
+   * \brief Takes a free buddy of order, splitting bigger ones as needed.
+   *
+   * \return False if the block has no room.
+   */
+  static bool m_takeBuddy(MemoryBlock &block, uint32_t order,
+                          VkDeviceSize &offset);
+
+  device::DeviceHandler const &m_deviceHandler;
+  VkDeviceSize m_blockSizeLimit; /**< The preferred block size */
+  std::map<PoolKey, std::vector<std::unique_ptr<MemoryBlock>>>
+      m_pools;        /**< Blocks of each memory type and flags */
+  std::mutex m_mutex; /**< Guards m_pools */
+  PendingRanges m_written; /**< Noted by markWritten(), not yet flushed */
+  std::map<ReadPoint, PendingRanges>
+      m_read; /**< Noted by markRead(), not yet invalidated */
+  std::mutex m_rangesMutex; /**< Guards m_written and m_read */
+};
+} // namespace memory
+
+#endif
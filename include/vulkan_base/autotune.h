@@ -0,0 +1,141 @@
+#pragma once
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include "common.h"
+#include "vulkan_base/vk_device.h"
+
+#include <array>
+#include <functional>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace tuning {
+static constexpr uint32_t MIN_TUNED_INVOCATIONS =
+    32; /**< Smallest workgroup the tuner tries */
+static constexpr uint32_t MAX_TUNED_INVOCATIONS =
+    256; /**< Largest workgroup the tuner tries */
+
+/**
+ * \struct Config
+ *
+ * \brief The launch configuration of a kernel.
+ */
+struct Config {
+  std::array<uint32_t, 3> localSize = {1, 1, 1}; /**< The workgroup size */
+  uint32_t subgroupSize = 0; /**< The required subgroup size, 0 to let the
+                                driver choose */
+
+  bool operator==(Config const &other) const = default;
+};
+
+/**
+ * \fn Config defaultConfig(uint32_t dimensions)
+ *
+ * \brief A configuration that is reasonable everywhere, for a kernel over a
+ * grid of dimensions axes.
+ */
+Config defaultConfig(uint32_t dimensions);
+
+/**
+ * \fn std::vector<Config> candidates(device::DeviceHandler const &device,
+ * uint32_t dimensions)
+ *
+ * \brief The configurations worth measuring on device.
+ *
+ * Workgroups hold between MIN_TUNED_INVOCATIONS and MAX_TUNED_INVOCATIONS
+ * invocations, in powers of two, and are at least as wide along x as along
+ * y. With subgroup size control, every supported subgroup size up to the
+ * workgroup size is tried as well.
+ *
+ * \param device The device, for its limits.
+ * \param dimensions 1 for a kernel over a line, 2 over a grid.
+ */
+std::vector<Config> candidates(device::DeviceHandler const &device,
+                               uint32_t dimensions);
+
+/**
+ * \fn Config tune(std::string const &name, std::vector<Config> const
+ * &configs, std::function<double(Config const &)> const &measure, double
+ * *bestTime)
+ *
+ * \brief Measures every configuration and returns the fastest.
+ *
+ * \param name What the sweep is traced under.
+ * \param configs The configurations, usually from candidates().
+ * \param measure Runs the kernel with a configuration and returns its time;
+ * a configuration it throws std::runtime_error for is skipped.
+ * \param bestTime Set to the time of the fastest configuration if not null.
+ *
+ * \throw std::runtime_error if no configuration could be measured.
+ */
+Config tune(std::string const &name, std::vector<Config> const &configs,
+            std::function<double(Config const &)> const &measure,
+            double *bestTime = nullptr);
+
+/**
+ * \class Database
+ *
+ * \brief The best configuration of every kernel on every device, kept on
+ * disk.
+ *
+ * Entries are keyed by the device UUID, the driver version and the kernel
+ * name, so a new driver or GPU starts from the defaults until it is tuned.
+ * The file is text, one entry per line, and is replaced atomically.
+ */
+class Database {
+public:
+  Database(Database &&) = delete;
+  Database(Database const &) = delete;
+  Database &operator=(Database &&) = delete;
+  Database &operator=(Database const &) = delete;
+
+  /**
+   * \brief Loads the database from path, empty if it does not exist.
+   */
+  explicit Database(std::string path);
+
+  /**
+   * \fn std::optional<Config> find(device::DeviceHandler const &device,
+   * std::string const &kernel) const
+   *
+   * \brief The configuration stored for kernel on device, if any.
+   */
+  [[nodiscard]] std::optional<Config>
+  find(device::DeviceHandler const &device, std::string const &kernel) const;
+
+  /**
+   * \fn void store(device::DeviceHandler const &device, std::string const
+   * &kernel, Config const &config)
+   *
+   * \brief Sets the configuration of kernel on device; see save().
+   */
+  void store(device::DeviceHandler const &device, std::string const &kernel,
+             Config const &config);
+
+  /**
+   * \fn void save() const
+   *
+   * \brief Writes every entry to the file.
+   */
+  void save() const;
+
+private:
+  /**
+   * \fn static std::string m_key(device::DeviceHandler const &device,
+   * std::string const &kernel)
+   *
+   * \brief The device UUID in hex, the driver version and kernel.
+   */
+  static std::string m_key(device::DeviceHandler const &device,
+                           std::string const &kernel);
+
+  std::string m_path;                     /**< The file backing the entries */
+  std::map<std::string, Config> m_entries; /**< By m_key */
+};
+} // namespace tuning
+
+#endif
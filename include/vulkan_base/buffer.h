@@ -6,6 +6,7 @@
 #include "vulkan_base/command_buffer.h"
 #include "vulkan_base/vk_device.h"
 #include <memory>
+#include <vector>
 
 namespace buffer {
 /**
@@ -31,6 +32,9 @@ public:
    * be used. \param memoryPropertyFlags The memory property flags for the
    * buffer memory. \param sharingMode The sharing mode of the buffer. \param
    * size The size of the buffer in bytes.
+   *
+   * \throw std::runtime_error if usageFlags asks for a device address the
+   * device cannot give.
    */
   Buffer(std::shared_ptr<device::DeviceHandler> m_devicehandler,
          std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer,
@@ -38,6 +42,25 @@ public:
          VkMemoryPropertyFlags memoryPropertyFlags, VkSharingMode sharingMode,
          VkDeviceSize size);
 
+  /**
+   * \brief Constructs a Buffer in the memory type that suits intent.
+   *
+   * \param m_devicehandler The device handler used to create the buffer.
+   * \param m_commandBuffer The command buffer handler associated with the
+   * buffer.
+   * \param usageFlags The usage flags specifying how the buffer will be used.
+   * \param intent How the host and the device access the buffer.
+   * \param sharingMode The sharing mode of the buffer.
+   * \param size The size of the buffer in bytes.
+   *
+   * \throw std::runtime_error if usageFlags asks for a device address the
+   * device cannot give.
+   */
+  Buffer(std::shared_ptr<device::DeviceHandler> m_devicehandler,
+         std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer,
+         VkBufferUsageFlags usageFlags, memory::Usage intent,
+         VkSharingMode sharingMode, VkDeviceSize size);
+
   /**
    * \brief Destroys the Buffer object.
    *
@@ -50,8 +73,10 @@ public:
    *
    * \brief Maps the buffer memory into host-accessible memory.
    *
-   * This function maps the buffer memory into host-accessible memory,
-   * allowing the host to read or modify the buffer's data.
+   * Host-visible memory stays mapped by the allocator, so this only exposes
+   * the buffer's part of that mapping through mapped.
+   *
+   * \throw std::runtime_error if the memory is not host visible.
    */
   void map();
 
@@ -60,7 +85,7 @@ public:
    *
    * \brief Unmaps the buffer memory.
    *
-   * This function unmaps the previously mapped buffer memory.
+   * This function resets mapped. The block stays mapped for other buffers.
    */
   void unmap();
 
@@ -87,25 +112,52 @@ public:
   void setupDescriptor();
 
   /**
-   * \fn void copy(void *data, VkDeviceSize size)
+   * \fn void copy(void *data, VkDeviceSize size,
+   * std::vector<scheduler::Point> const &after = {})
    *
    * \brief Copies data to the buffer with the stage buffer.
    *
    * This function copies data to the buffer from the provided source data
-   * pointer.
+   * pointer, through the staging ring of the command buffer handler. It
+   * returns once the copy has completed.
    *
    * \param data Pointer to the source data to be copied.
    * \param size The size of the data to be copied in bytes.
+   * \param after Points of other lanes the copy waits for; see
+   * copyAsync().
    */
-  void copy(void *data, VkDeviceSize size);
+  void copy(void *data, VkDeviceSize size,
+            std::vector<scheduler::Point> const &after = {});
+
+  /**
+   * \fn transfer::Token copyAsync(void const *data, VkDeviceSize size,
+   * std::vector<scheduler::Point> const &after = {})
+   *
+   * \brief Starts copying data to the buffer through the staging ring.
+   *
+   * data may be reused as soon as the call returns. Compute work submitted
+   * to QueueType::Compute after the call sees the data without waiting on
+   * the token; work on any other lane has to wait on it. The copy waits for
+   * the work submitted to QueueType::Compute before it, so it does not
+   * overwrite what a dispatch still reads.
+   *
+   * \param data Pointer to the source data to be copied.
+   * \param size The size of the data to be copied in bytes.
+   * \param after Points of the submissions of other lanes still reading the
+   * buffer.
+   *
+   * \return The token of the copy.
+   */
+  transfer::Token copyAsync(void const *data, VkDeviceSize size,
+                            std::vector<scheduler::Point> const &after = {});
 
   /**
    * \fn void fastCopy(void *data, VkDeviceSize size)
    *
    * \brief Copies data to the buffer without the stage buffer.
    *
-   * This function performs a fast memory copy of data to the buffer.
-   * The function assumes that the buffer is already mapped.
+   * This function performs a fast memory copy of data to the buffer, mapping
+   * it if needed, and notes the range with markWritten().
    *
    * \param data Pointer to the source data to be copied.
    * \param size The size of the data to be copied in bytes.
@@ -119,8 +171,9 @@ public:
    * \brief Flushes the buffer memory ranges to make them visible to the
    * device.
    *
-   * This function flushes the specified range of buffer memory to make it
-   * visible to the device.
+   * This function flushes the specified range of buffer memory, widened to
+   * nonCoherentAtomSize, right away. It does nothing for coherent memory.
+   * See markWritten() to flush with the next submission instead.
    *
    * \param size The size of the memory range to flush in bytes.
    * \param offset The offset within the buffer to start flushing from.
@@ -134,8 +187,8 @@ public:
    * \brief Invalidates the buffer memory ranges to make them coherent with
    * the device.
    *
-   * This function invalidates the specified range of buffer memory to make it
-   * coherent with the device.
+   * This function invalidates the specified range of buffer memory, widened
+   * to nonCoherentAtomSize, right away. It does nothing for coherent memory.
    *
    * \param size The size of the memory range to invalidate in bytes.
    * \param offset The offset within the buffer to start invalidating from.
@@ -143,7 +196,40 @@ public:
   void invalidate(VkDeviceSize size = VK_WHOLE_SIZE, VkDeviceSize offset = 0);
 
   /**
-   * \fn void copyFrom(VkBuffer srcBuffer)
+   * \fn void markWritten(VkDeviceSize offset = 0, VkDeviceSize size =
+   * VK_WHOLE_SIZE)
+   *
+   * \brief Notes a range the host wrote through mapped.
+   *
+   * The ranges of all buffers are merged and flushed with one call before
+   * the next submission. fastCopy() notes its range itself.
+   *
+   * \param offset The offset within the buffer the range starts at.
+   * \param size The size of the range in bytes.
+   */
+  void markWritten(VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE);
+
+  /**
+   * \fn void markRead(scheduler::Point const &point, VkDeviceSize offset =
+   * 0, VkDeviceSize size = VK_WHOLE_SIZE)
+   *
+   * \brief Notes a range the host reads once the work reaching point has
+   * written it.
+   *
+   * The ranges of all buffers noted against a point are merged and
+   * invalidated with one call once a wait for it returns, or a poll sees it
+   * reached.
+   *
+   * \param point The point of the submission writing the range.
+   * \param offset The offset within the buffer the range starts at.
+   * \param size The size of the range in bytes.
+   */
+  void markRead(scheduler::Point const &point, VkDeviceSize offset = 0,
+                VkDeviceSize size = VK_WHOLE_SIZE);
+
+  /**
+   * \fn void copyFrom(VkBuffer srcBuffer, std::vector<scheduler::Point>
+   * const &after = {})
    *
    * \brief Copies data from another buffer.
    *
@@ -151,11 +237,33 @@ public:
    * buffer.
    *
    * \param srcBuffer The source buffer to copy from.
+   * \param after Points of other lanes the copy waits for; see
+   * transfer::TransferEngine::copy().
+   */
+  void copyFrom(VkBuffer srcBuffer,
+                std::vector<scheduler::Point> const &after = {});
+
+  /**
+   * \fn transfer::Token copyFromAsync(VkBuffer srcBuffer,
+   * std::vector<scheduler::Point> const &after = {})
+   *
+   * \brief Starts copying data from another buffer on the transfer queue.
+   *
+   * The buffer is handed to the compute family once the copy is done.
+   *
+   * \param srcBuffer The source buffer to copy from.
+   * \param after Points of other lanes the copy waits for, like work still
+   * using this buffer.
+   *
+   * \return The token of the copy.
    */
-  void copyFrom(VkBuffer srcBuffer);
+  transfer::Token
+  copyFromAsync(VkBuffer srcBuffer,
+                std::vector<scheduler::Point> const &after = {});
 
   /**
-   * \fn void copyTo(VkBuffer dstBuffer)
+   * \fn void copyTo(VkBuffer dstBuffer, std::vector<scheduler::Point> const
+   * &after = {})
    *
    * \brief Copies data to another buffer.
    *
@@ -163,8 +271,41 @@ public:
    * buffer.
    *
    * \param dstBuffer The destination buffer to copy to.
+   * \param after Points of other lanes the copy waits for; see
+   * copyToAsync().
    */
-  void copyTo(VkBuffer dstBuffer);
+  void copyTo(VkBuffer dstBuffer,
+              std::vector<scheduler::Point> const &after = {});
+
+  /**
+   * \fn transfer::Token copyToAsync(VkBuffer dstBuffer,
+   * std::vector<scheduler::Point> const &after = {})
+   *
+   * \brief Starts copying the results of earlier compute work to another
+   * buffer on the transfer queue.
+   *
+   * The buffer is handed back to the compute family once the copy is done,
+   * so compute work submitted to QueueType::Compute after the call can use
+   * it without waiting on the token.
+   *
+   * \param dstBuffer The destination buffer to copy to.
+   * \param after Points of the work that wrote the buffer, when it ran on a
+   * lane other than QueueType::Compute; that work is not ordered before the
+   * copy otherwise.
+   *
+   * \return The token of the copy.
+   */
+  transfer::Token copyToAsync(VkBuffer dstBuffer,
+                              std::vector<scheduler::Point> const &after = {});
+
+  /**
+   * \fn void wait(transfer::Token const &token) const
+   *
+   * \brief Waits for a copy started by one of the async methods.
+   *
+   * \param token The token of the copy.
+   */
+  void wait(transfer::Token const &token) const;
 
   /**
    * \fn void destroy()
@@ -188,37 +329,44 @@ public:
 
   VkBuffer buffer = VK_NULL_HANDLE; /**< The Vulkan buffer handle. */
   VkDeviceMemory memory =
-      VK_NULL_HANDLE;                  /**< The Vulkan device memory handle. */
+      VK_NULL_HANDLE; /**< The device memory the buffer lives in, shared with
+                         other buffers. */
+  memory::Allocation allocation{}; /**< The range of memory backing the
+                                      buffer. */
   VkDescriptorBufferInfo descriptor{}; /**< Descriptor for the buffer. */
   VkDeviceSize size = 0;               /**< Size of the buffer in bytes. */
+  VkDeviceAddress address =
+      0; /**< The address shaders reach the buffer at, 0 unless it was
+            created with VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT. */
   VkDeviceSize alignment = 0; /**< Alignment requirement for the buffer. */
   void *mapped = nullptr;     /**< Pointer to the mapped buffer memory. */
   VkBufferUsageFlags
       usageFlags{}; /**< Usage flags specifying how the buffer is used. */
-  VkMemoryPropertyFlags memoryPropertyFlags{}; /**< Memory property flags for
-                                                the buffer memory. */
+  VkMemoryPropertyFlags memoryPropertyFlags{}; /**< Memory property flags of
+                                                the memory type the buffer
+                                                is in. */
+  VkSharingMode sharingMode =
+      VK_SHARING_MODE_EXCLUSIVE; /**< Whether ownership is transferred
+                                    between queue families. */
 
 private:
   /**
-   * \fn void m_makeBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                    VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                    VkDeviceMemory &bufferMemory, VkSharingMode sharingMode)
+   * \fn void m_makeBuffer()
    *
-   * \brief Creates a buffer with the specified properties.
+   * \brief Creates buffer from size, usageFlags and sharingMode, without
+   * memory.
    *
-   * This function creates a buffer with the specified size, usage flags, and
-   * memory properties.
+   * \throw std::runtime_error if usageFlags asks for a device address the
+   * device cannot give.
+   */
+  void m_makeBuffer();
+
+  /**
+   * \fn void m_bound()
    *
-   * \param size The size of the buffer in bytes.
-   * \param usage The usage flags specifying how the buffer will be used.
-   * \param properties The memory property flags for the buffer memory.
-   * \param buffer [out] The created Vulkan buffer handle.
-   * \param bufferMemory [out] The allocated Vulkan device memory handle.
-   * \param sharingMode The sharing mode of the buffer.
+   * \brief Fills in memory and address once allocation is bound.
    */
-  void m_makeBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                    VkMemoryPropertyFlags properties, VkBuffer &buffer,
-                    VkDeviceMemory &bufferMemory, VkSharingMode sharingMode);
+  void m_bound();
 
   std::shared_ptr<command_buffer::CommandBufferHandler>
       m_commandBuffer; /**< Command buffer handler associated with the buffer.
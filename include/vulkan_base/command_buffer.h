@@ -4,9 +4,15 @@
 #define COMMAND_BUFFER_H
 
 #include "common.h"
+#include "vulkan_base/parallel_recorder.h"
+#include "vulkan_base/profiler.h"
+#include "vulkan_base/scheduler.h"
+#include "vulkan_base/staging_ring.h"
+#include "vulkan_base/transfer.h"
 #include "vulkan_base/vk_device.h"
 
 #include <memory>
+#include <mutex>
 
 namespace command_buffer {
 /**
@@ -91,7 +97,10 @@ public:
   /**
    * \fn flushCommandBuffer(VkCommandBuffer buf, VkQueue queue)
    *
-   * \brief Sends the command buffer to a queue
+   * \brief Sends the command buffer to a queue and waits for it
+   *
+   * The buffer is submitted through the scheduler, so the wait is on its
+   * timeline rather than on a fence of its own.
    *
    * \param buf The buffer
    * \param queue The queue
@@ -99,10 +108,77 @@ public:
    */
   void flushCommandBuffer(VkCommandBuffer buf, VkQueue queue, bool free = true);
 
+  /**
+   * \fn staging::StagingRing &getStagingRing()
+   *
+   * \brief The staging ring uploads to the device go through.
+   *
+   * The ring is created on first use and shared by every buffer created
+   * with this handler.
+   *
+   * \return The staging ring.
+   */
+  staging::StagingRing &getStagingRing();
+
+  /**
+   * \fn transfer::TransferEngine &getTransferEngine()
+   *
+   * \brief The engine buffer copies are submitted through.
+   *
+   * The engine is created on first use and shared by every buffer created
+   * with this handler.
+   *
+   * \return The transfer engine.
+   */
+  transfer::TransferEngine &getTransferEngine();
+
+  /**
+   * \fn scheduler::Scheduler &getScheduler()
+   *
+   * \brief The scheduler every submission of this handler goes through.
+   *
+   * \return The scheduler.
+   */
+  scheduler::Scheduler &getScheduler() { return *m_scheduler; }
+
+  /**
+   * \fn profiling::Profiler &getProfiler()
+   *
+   * \brief The profiler the submissions of this handler are measured with.
+   *
+   * It starts in profiling::Mode::Batches.
+   *
+   * \return The profiler.
+   */
+  profiling::Profiler &getProfiler() { return *m_profiler; }
+
+  /**
+   * \fn recording::ParallelRecorder &getRecorder()
+   *
+   * \brief The recorder for submissions recorded on several threads.
+   *
+   * commandPool must only be used from one thread at a time; the recorder
+   * gives each of its threads a pool of its own. It is created on first use.
+   *
+   * \return The parallel recorder.
+   */
+  recording::ParallelRecorder &getRecorder();
+
 protected:
   std::shared_ptr<device::DeviceHandler>
       m_deviceHandler; /**< The device handler used for command buffer
                           operations. */
+  std::unique_ptr<scheduler::Scheduler>
+      m_scheduler; /**< Tracks the submissions of all queues */
+  std::unique_ptr<profiling::Profiler>
+      m_profiler; /**< Times the submissions of all queues */
+  std::unique_ptr<transfer::TransferEngine>
+      m_transferEngine; /**< Created by getTransferEngine() */
+  std::unique_ptr<staging::StagingRing>
+      m_stagingRing; /**< Created by getStagingRing() */
+  std::unique_ptr<recording::ParallelRecorder>
+      m_recorder;            /**< Created by getRecorder() */
+  std::mutex m_stagingMutex; /**< Guards the creation of all three */
 
   /**
    * \brief Creates the Vulkan command pool.
@@ -8,6 +8,7 @@
 #include <iostream>
 #include <limits>
 #include <optional>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan.h>
 
@@ -32,6 +33,7 @@ struct QueueFamilyIndices {
     std::optional<uint32_t> presentFamily;
     std::optional<uint32_t> computeFamily;
     std::optional<uint32_t> transferFamily;
+    std::optional<uint32_t> asyncComputeFamily;
 
     // Check if all required queue families are present
     [[nodiscard]] inline bool isComplete() const {
@@ -42,8 +44,18 @@ struct QueueFamilyIndices {
     [[nodiscard]] inline bool hasDedicatedTransfer() const {
         return transferFamily.has_value();
     }
+
+    // Check if a second, compute-only family is available
+    [[nodiscard]] inline bool hasAsyncCompute() const {
+        return asyncComputeFamily.has_value();
+    }
 };
 
+namespace tracing {
+// Marks a failed VK_CHECK in the trace; defined in trace.cpp
+void vkError(VkResult result);
+} // namespace tracing
+
 // Macro for checking Vulkan function calls for errors
 #define VK_CHECK(f)                                                            \
     {                                                                          \
@@ -51,6 +63,7 @@ struct QueueFamilyIndices {
         if (res != VK_SUCCESS) {                                               \
             std::cout << "Fatal : VkResult is \"" << res << "\" in "           \
                       << __FILE__ << " at line " << __LINE__ << "\n";          \
+            tracing::vkError(res);                                             \
             assert(res == VK_SUCCESS);                                         \
         }                                                                      \
     }
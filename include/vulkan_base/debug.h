@@ -4,6 +4,7 @@
 #define DEBUG_H
 
 #include "common.h"
+#include "vulkan_base/trace.h"
 #include <iostream>
 
 namespace debug {
@@ -61,6 +62,7 @@ debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
   UNUSED(pCallbackData);
   UNUSED(pUserData);
   std::cerr << "validation layer: " << pCallbackData->pMessage << '\n';
+  tracing::Tracer::instance().instant(pCallbackData->pMessage, "validation");
 
   return VK_FALSE;
 } /**< the debug callback */
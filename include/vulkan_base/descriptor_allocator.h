@@ -0,0 +1,201 @@
+#pragma once
+
+#ifndef DESCRIPTOR_ALLOCATOR_H
+#define DESCRIPTOR_ALLOCATOR_H
+
+#include "common.h"
+#include "vulkan_base/reflection.h"
+#include "vulkan_base/vk_device.h"
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace descriptor {
+static constexpr uint32_t DEFAULT_SETS_PER_POOL =
+    64; /**< Sets in the first pool */
+static constexpr uint32_t MAX_SETS_PER_POOL =
+    4096; /**< Pools double in size up to this many sets */
+
+/**
+ * \struct PoolRatio
+ *
+ * \brief How many descriptors of a type a pool holds per set.
+ */
+struct PoolRatio {
+  VkDescriptorType type; /**< The descriptor type */
+  float ratio;           /**< Descriptors of type per set */
+};
+
+/**
+ * \brief Ratios for compute shaders, which mostly bind storage buffers.
+ */
+std::vector<PoolRatio> defaultRatios();
+
+/**
+ * \brief Ratios that fit sets of bindings exactly.
+ */
+std::vector<PoolRatio>
+ratiosOf(std::vector<reflection::Binding> const &bindings);
+
+/**
+ * \class Allocator
+ *
+ * \brief Allocates descriptor sets from a growing chain of pools.
+ *
+ * Sets come from the current pool until it runs out, then from a new pool
+ * twice as large, so no job has to size a pool of its own. reset() returns
+ * every set of every pool at once, which is cheaper than freeing them one by
+ * one, and is meant to be called once per batch of work.
+ *
+ * Sets with the same layout and buffer ranges are cached: asking for them
+ * again returns the set written the first time instead of allocating and
+ * updating another one. All methods are thread safe.
+ */
+class Allocator {
+public:
+  Allocator(Allocator &&) = delete;
+  Allocator(Allocator const &) = delete;
+  Allocator &operator=(Allocator &&) = delete;
+  Allocator &operator=(Allocator const &) = delete;
+
+  /**
+   * \brief Creates an allocator without any pool yet.
+   *
+   * \param deviceHandler The device.
+   * \param ratios Descriptors per set of each type in every pool.
+   * \param setsPerPool The sets of the first pool.
+   */
+  Allocator(std::shared_ptr<device::DeviceHandler> deviceHandler,
+            std::vector<PoolRatio> ratios = defaultRatios(),
+            uint32_t setsPerPool = DEFAULT_SETS_PER_POOL);
+
+  /**
+   * \brief Destroys the pools, and with them every set.
+   */
+  ~Allocator();
+
+  /**
+   * \fn VkDescriptorSet allocate(VkDescriptorSetLayout layout)
+   *
+   * \brief Allocates a set of layout, without writing it.
+   *
+   * \throw std::runtime_error if layout does not fit an empty pool.
+   */
+  VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+
+  /**
+   * \fn VkDescriptorSet get(VkDescriptorSetLayout layout,
+   * std::vector<reflection::Binding> const &bindings,
+   * std::vector<VkDescriptorBufferInfo> const &bufferInfos)
+   *
+   * \brief A set of layout with bufferInfos bound to its buffer bindings.
+   *
+   * Binds like createDescriptorSet, but returns the cached set if the same
+   * ranges were bound to layout before. The set must not be updated by the
+   * caller, as others may share it.
+   */
+  VkDescriptorSet get(VkDescriptorSetLayout layout,
+                      std::vector<reflection::Binding> const &bindings,
+                      std::vector<VkDescriptorBufferInfo> const &bufferInfos);
+
+  /**
+   * \fn void forget(VkBuffer buffer)
+   *
+   * \brief Drops the cached sets that bind buffer, before it is destroyed.
+   *
+   * The sets stay allocated until reset(), but a new buffer that happens to
+   * get the same handle will not be served a stale set.
+   */
+  void forget(VkBuffer buffer);
+
+  /**
+   * \fn void reset()
+   *
+   * \brief Returns every set to its pool and empties the cache.
+   *
+   * No set handed out before may still be in use by the device.
+   */
+  void reset();
+
+  /**
+   * \fn size_t pools() const
+   *
+   * \brief The number of pools created so far.
+   */
+  [[nodiscard]] size_t pools() const;
+
+  /**
+   * \fn size_t cacheHits() const
+   *
+   * \brief The number of get() calls served from the cache.
+   */
+  [[nodiscard]] size_t cacheHits() const;
+
+private:
+  /**
+   * \struct Write
+   *
+   * \brief A buffer range bound to a binding, part of a cache key.
+   */
+  struct Write {
+    uint32_t binding;      /**< The binding */
+    VkDescriptorType type; /**< Its descriptor type */
+    VkBuffer buffer;       /**< The bound buffer */
+    VkDeviceSize offset;   /**< Offset of the range */
+    VkDeviceSize range;    /**< Size of the range */
+
+    bool operator==(Write const &other) const = default;
+  };
+
+  /**
+   * \struct Key
+   *
+   * \brief What identifies a cached set.
+   */
+  struct Key {
+    VkDescriptorSetLayout layout; /**< The layout of the set */
+    std::vector<Write> writes;    /**< Every buffer it binds */
+
+    bool operator==(Key const &other) const = default;
+  };
+
+  /**
+   * \struct KeyHash
+   *
+   * \brief Hashes the layout and every write of a Key.
+   */
+  struct KeyHash {
+    size_t operator()(Key const &key) const;
+  };
+
+  /**
+   * \fn VkDescriptorPool m_createPool()
+   *
+   * \brief Creates a pool of m_setsPerPool sets and doubles it for the next.
+   */
+  VkDescriptorPool m_createPool();
+
+  /**
+   * \fn VkDescriptorSet m_allocate(VkDescriptorSetLayout layout)
+   *
+   * \brief allocate(), with m_mutex held.
+   */
+  VkDescriptorSet m_allocate(VkDescriptorSetLayout layout);
+
+  std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+  std::vector<PoolRatio> m_ratios;         /**< See the constructor */
+  uint32_t m_setsPerPool;                  /**< Sets of the next new pool */
+  VkDescriptorPool m_current = VK_NULL_HANDLE; /**< Allocated from now */
+  std::vector<VkDescriptorPool> m_full;    /**< Ran out, until reset() */
+  std::vector<VkDescriptorPool> m_ready;   /**< Reset, used before new ones */
+  size_t m_pools = 0;                      /**< See pools() */
+  std::unordered_map<Key, VkDescriptorSet, KeyHash>
+      m_cache;                             /**< Sets written by get() */
+  size_t m_hits = 0;                       /**< See cacheHits() */
+  mutable std::mutex m_mutex;              /**< Guards all of the above */
+};
+} // namespace descriptor
+
+#endif
@@ -4,15 +4,66 @@
 #define DESCRIPTOR_SET_MANIP_H
 
 #include "common.h"
+#include "vulkan_base/reflection.h"
 
-void createLayout(VkDevice device, VkDescriptorSetLayout *layout);
+#include <vector>
 
+void createLayout(VkDevice device, VkDescriptorSetLayout *layout,
+                  uint32_t bindingCount = 1);
+
+/**
+ * \brief Creates a layout with the reflected bindings of one set.
+ *
+ * flags is VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR for a set
+ * that is pushed at record time instead of allocated.
+ */
+void createLayout(VkDevice device, VkDescriptorSetLayout *layout,
+                  std::vector<reflection::Binding> const &bindings,
+                  VkDescriptorSetLayoutCreateFlags flags = 0);
+
+/**
+ * \brief The writes that bind bufferInfos to the buffer bindings of set.
+ *
+ * bufferInfos[i] is bound to the i-th buffer of bindings, with its reflected
+ * type; an array binding gets it as its first element. The writes point into
+ * bufferInfos, which must outlive them. set is ignored by a push.
+ *
+ * \throw std::runtime_error if the number of buffers differs, or a range is
+ * smaller than the block plus one element of its runtime array.
+ */
+std::vector<VkWriteDescriptorSet>
+bufferWrites(VkDescriptorSet set,
+             std::vector<reflection::Binding> const &bindings,
+             std::vector<VkDescriptorBufferInfo> const &bufferInfos);
+
+/**
+ * \brief Allocates a set and binds bufferInfos[i] to binding i.
+ */
 void createDescriptorSet(VkDevice device, VkDescriptorSetLayout *layout,
                          VkDescriptorPool &descriptorPool,
-                         VkDescriptorSet &descriptorSet, VkBuffer *buf,
-                         const uint32_t sizes[3]);
+                         VkDescriptorSet &descriptorSet,
+                         std::vector<VkDescriptorBufferInfo> const &bufferInfos);
+
+void createDescriptorPool(VkDevice device, VkDescriptorPool *descriptorPool,
+                          uint32_t maxSets = 1, uint32_t descriptorCount = 1);
 
-void createDescriptorPool(VkDevice device, VkDescriptorPool *descriptorPool);
+/**
+ * \brief Creates a pool with room for maxSets sets of the reflected bindings.
+ */
+void createDescriptorPool(VkDevice device, VkDescriptorPool *descriptorPool,
+                          std::vector<reflection::Binding> const &bindings,
+                          uint32_t maxSets = 1);
+
+/**
+ * \brief Allocates a set and binds bufferInfos to its buffer bindings.
+ *
+ * See bufferWrites for how the buffers are bound and checked.
+ */
+void createDescriptorSet(VkDevice device, VkDescriptorSetLayout *layout,
+                         VkDescriptorPool &descriptorPool,
+                         VkDescriptorSet &descriptorSet,
+                         std::vector<reflection::Binding> const &bindings,
+                         std::vector<VkDescriptorBufferInfo> const &bufferInfos);
 
 void cleanupDescriptors(VkDevice device, VkDescriptorSetLayout &layout,
                         VkDescriptorPool &pool);
@@ -0,0 +1,103 @@
+#pragma once
+
+#ifndef DEVICE_SELECTION_H
+#define DEVICE_SELECTION_H
+
+#include <array>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vulkan/vulkan.h>
+
+namespace selection {
+static constexpr long DISCRETE_GPU_BONUS = 1000; /**< Bonus for descrete GPU */
+static constexpr long INTEGRATED_GPU_BONUS =
+    200; /**< Bonus for integrated GPU */
+static constexpr long COMPUTE_QUEUE_BONUS =
+    50; /**< Bonus for every compute queue, up to MAX_SCORED_QUEUES */
+static constexpr uint32_t MAX_SCORED_QUEUES =
+    8; /**< Queues past this are not worth more */
+static constexpr long DEVICE_MEMORY_BONUS =
+    100; /**< Bonus for every GiB of the largest device-local heap */
+static constexpr uint32_t INVOCATIONS_PER_POINT =
+    16; /**< Workgroup invocations worth one point */
+
+/**
+ * \struct Candidate
+ *
+ * \brief What a selection policy gets to know about a physical device.
+ */
+struct Candidate {
+  VkPhysicalDevice physicalDevice = VK_NULL_HANDLE; /**< The device */
+  VkPhysicalDeviceProperties properties{};          /**< Its properties */
+  VkPhysicalDeviceFeatures features{}; /**< Its supported features */
+  std::array<uint8_t, VK_UUID_SIZE> uuid{}; /**< Its UUID */
+  uint32_t computeQueues = 0; /**< Queues over all compute capable families */
+  uint32_t subgroupSize = 0;  /**< The default subgroup size */
+  VkDeviceSize deviceLocalBytes = 0; /**< The largest device-local heap */
+  bool timelineSemaphore =
+      false; /**< Whether it supports timeline semaphores, which every
+                submission signals */
+};
+
+/**
+ * \brief Rates a candidate; the highest rated one is picked, and one rated 0
+ * or less is never picked.
+ */
+using Policy = std::function<long(Candidate const &)>;
+
+/**
+ * \fn Candidate describe(VkPhysicalDevice device)
+ *
+ * \brief Queries everything a policy looks at.
+ */
+Candidate describe(VkPhysicalDevice device);
+
+/**
+ * \fn std::string uuidHex(std::array<uint8_t, VK_UUID_SIZE> const &uuid)
+ *
+ * \brief The UUID as 32 lowercase hex digits.
+ */
+std::string uuidHex(std::array<uint8_t, VK_UUID_SIZE> const &uuid);
+
+/**
+ * \fn long computeScore(Candidate const &candidate)
+ *
+ * \brief The default policy, which prefers what compute kernels run fast on.
+ *
+ * Devices below Vulkan 1.2, without timeline semaphores or without double
+ * precision, which every integrand and the reduction compute in, are rated
+ * 0. For the others discrete over integrated GPUs, device memory, compute
+ * queues, the workgroup size limit and the subgroup size each add to the
+ * score, from at least 1.
+ */
+long computeScore(Candidate const &candidate);
+
+/**
+ * \fn Policy pinned(std::string const &selector, Policy fallback)
+ *
+ * \brief Only accepts the devices selector names, rated by fallback.
+ *
+ * \param selector A UUID as printed by uuidHex(), or a part of the device
+ * name.
+ * \param fallback Picks among several matches.
+ */
+Policy pinned(std::string const &selector, Policy fallback = computeScore);
+
+/**
+ * \fn Policy benchmarked(std::function<std::optional<double>(Candidate
+ * const &)> measure, Policy fallback)
+ *
+ * \brief Scales the fallback rating by a measured relative speed.
+ *
+ * \param measure Times a micro-benchmark on a candidate and returns its speed
+ * relative to some reference, or nothing if it was not measured; the rating
+ * of an unmeasured candidate is left as it is.
+ * \param fallback The rating being scaled.
+ */
+Policy benchmarked(
+    std::function<std::optional<double>(Candidate const &)> measure,
+    Policy fallback = computeScore);
+} // namespace selection
+
+#endif
@@ -0,0 +1,166 @@
+#pragma once
+
+#ifndef PARALLEL_RECORDER_H
+#define PARALLEL_RECORDER_H
+
+#include "common.h"
+#include "vulkan_base/profiler.h"
+#include "vulkan_base/scheduler.h"
+#include "vulkan_base/vk_device.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace recording {
+/**
+ * \brief Records one part of a submission into a secondary command buffer.
+ *
+ * The buffer has already been begun and is ended after the segment returns.
+ * Segments run on worker threads, so they must not share unguarded state.
+ */
+using Segment = std::function<void(VkCommandBuffer)>;
+
+/**
+ * \class ParallelRecorder
+ *
+ * \brief Records the segments of a submission on several threads.
+ *
+ * Command pools must not be used from two threads at once, so every worker
+ * thread owns a pool of its own and records each segment it picks up into a
+ * secondary command buffer from it. The secondaries are then executed, in
+ * the order of the segments, from one primary command buffer that is
+ * submitted through the scheduler. The command buffers return to their pools
+ * once the submission completes.
+ */
+class ParallelRecorder {
+public:
+  ParallelRecorder(ParallelRecorder &&) = delete;
+  ParallelRecorder(ParallelRecorder const &) = delete;
+  ParallelRecorder &operator=(ParallelRecorder &&) = delete;
+  ParallelRecorder &operator=(ParallelRecorder const &) = delete;
+
+  /**
+   * \brief Starts the worker threads and creates their pools.
+   *
+   * \param deviceHandler The device.
+   * \param scheduler The scheduler the primaries are submitted through,
+   * which must outlive the recorder.
+   * \param profiler If not null, times every submission; must outlive the
+   * recorder.
+   * \param threads The number of workers, 0 for one per hardware thread.
+   */
+  ParallelRecorder(std::shared_ptr<device::DeviceHandler> deviceHandler,
+                   scheduler::Scheduler &scheduler,
+                   profiling::Profiler *profiler = nullptr,
+                   size_t threads = 0);
+
+  /**
+   * \brief Waits for every submission, stops the workers and frees the pools.
+   */
+  ~ParallelRecorder();
+
+  /**
+   * \fn scheduler::Point submit(std::vector<Segment> const &segments,
+   * std::vector<scheduler::Wait> const &waits)
+   *
+   * \brief Records segments in parallel and submits them to the compute queue.
+   *
+   * Returns once the submission has been made. If a segment throws, nothing
+   * is submitted and the first exception is rethrown.
+   *
+   * \param segments The parts of the submission, executed in this order.
+   * \param waits Points of other queues the submission waits for.
+   *
+   * \return The point of the submission.
+   */
+  scheduler::Point submit(std::vector<Segment> const &segments,
+                          std::vector<scheduler::Wait> const &waits = {});
+
+  /**
+   * \fn size_t threads() const
+   *
+   * \brief The number of worker threads.
+   */
+  [[nodiscard]] size_t threads() const { return m_workers.size(); }
+
+private:
+  /**
+   * \struct Pool
+   *
+   * \brief A command pool and the buffers it handed out.
+   */
+  struct Pool {
+    VkCommandPool pool{};                /**< Used by one thread at a time */
+    std::deque<std::pair<scheduler::Point, VkCommandBuffer>>
+        pending;                         /**< Submitted, oldest first */
+    std::vector<VkCommandBuffer> free;   /**< Ready to be recorded */
+    std::mutex mutex;                    /**< Guards all of the above */
+  };
+
+  /**
+   * \struct Job
+   *
+   * \brief A segment waiting for a worker.
+   */
+  struct Job {
+    Segment const *segment;       /**< What to record */
+    VkCommandBuffer *cmd;         /**< Where the secondary goes */
+    size_t *worker;               /**< Where the worker index goes */
+  };
+
+  /**
+   * \fn void m_work(size_t index)
+   *
+   * \brief The loop of worker index.
+   */
+  void m_work(size_t index);
+
+  /**
+   * \fn void m_createPool(Pool &pool)
+   *
+   * \brief Creates the command pool of pool on the compute family.
+   */
+  void m_createPool(Pool &pool);
+
+  /**
+   * \fn VkCommandBuffer m_acquire(Pool &pool, VkCommandBufferLevel level)
+   *
+   * \brief Takes a completed command buffer of pool, or allocates one.
+   *
+   * pool.mutex must be held.
+   */
+  VkCommandBuffer m_acquire(Pool &pool, VkCommandBufferLevel level);
+
+  /**
+   * \fn void m_destroyPool(Pool &pool)
+   *
+   * \brief Waits for the buffers of pool and destroys it.
+   */
+  void m_destroyPool(Pool &pool);
+
+  std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+  scheduler::Scheduler &m_scheduler; /**< Submits the primaries */
+  profiling::Profiler *m_profiler;   /**< Times the primaries, may be null */
+  Pool m_primaries;                  /**< Pool of the primaries */
+  std::vector<std::unique_ptr<Pool>> m_pools; /**< One per worker */
+  std::vector<std::thread> m_workers;         /**< The worker threads */
+
+  std::mutex m_submitMutex;  /**< Serializes submit() */
+  std::mutex m_jobsMutex;    /**< Guards the members below */
+  std::condition_variable m_jobsReady; /**< Signaled when jobs are queued */
+  std::condition_variable m_jobsDone;  /**< Signaled when m_running drops */
+  std::deque<Job> m_jobs;              /**< Queued segments */
+  size_t m_running = 0;                /**< Segments not recorded yet */
+  std::exception_ptr m_error;          /**< First exception of a segment */
+  bool m_stop = false;                 /**< Whether the workers must exit */
+};
+} // namespace recording
+
+#endif
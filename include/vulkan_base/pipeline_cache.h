@@ -0,0 +1,95 @@
+#pragma once
+
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include "common.h"
+#include "vulkan_base/vk_device.h"
+
+#include <memory>
+#include <string>
+
+namespace pipeline_cache {
+static constexpr uint32_t CACHE_FILE_MAGIC =
+    0x43505643; /**< "CVPC", marks files written by PipelineCache */
+
+/**
+ * \struct CacheFileHeader
+ *
+ * \brief The header written in front of the driver's cache data.
+ *
+ * It pins the data to the exact device and driver it was produced by, so a
+ * driver update or a different GPU silently starts from an empty cache.
+ */
+struct CacheFileHeader {
+  uint32_t magic;         /**< Always CACHE_FILE_MAGIC */
+  uint32_t driverVersion; /**< VkPhysicalDeviceProperties::driverVersion */
+  uint32_t vendorID;      /**< VkPhysicalDeviceProperties::vendorID */
+  uint32_t deviceID;      /**< VkPhysicalDeviceProperties::deviceID */
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE]; /**< The cache UUID of the device */
+  uint64_t dataSize; /**< Size of the cache data following the header */
+};
+
+/**
+ * \class PipelineCache
+ *
+ * \brief A VkPipelineCache persisted on disk.
+ *
+ * The cache is loaded from disk when constructed, can be shared by every
+ * pipeline created on the device and is written back when destroyed. The
+ * file is replaced atomically, so a crash while saving never leaves a
+ * truncated cache behind.
+ */
+class PipelineCache {
+public:
+  PipelineCache(PipelineCache &&) = delete;
+  PipelineCache(PipelineCache const &) = delete;
+  PipelineCache &operator=(PipelineCache &&) = delete;
+  PipelineCache &operator=(PipelineCache const &) = delete;
+
+  /**
+   * \brief Creates the pipeline cache, seeded from path if it is valid.
+   *
+   * \param deviceHandler The device the cache belongs to.
+   * \param path The file the cache is loaded from and saved to.
+   */
+  PipelineCache(std::shared_ptr<device::DeviceHandler> deviceHandler,
+                std::string path);
+
+  /**
+   * \brief Saves the cache and destroys it.
+   */
+  ~PipelineCache();
+
+  /**
+   * \fn void save() const
+   *
+   * \brief Writes the cache data to the file.
+   *
+   * The data is written to a temporary file next to the target, which is
+   * then renamed over it.
+   */
+  void save() const;
+
+  operator VkPipelineCache const &() const { return cache; }
+
+  VkPipelineCache cache = VK_NULL_HANDLE; /**< The Vulkan pipeline cache */
+
+private:
+  /**
+   * \fn std::vector<char> m_load() const
+   *
+   * \brief Reads the cache data from the file.
+   *
+   * \return The cache data, or nothing if the file is missing, corrupt or
+   * was written by another device or driver.
+   */
+  [[nodiscard]] std::vector<char> m_load() const;
+
+  std::shared_ptr<device::DeviceHandler>
+      m_deviceHandler; /**< The device the cache belongs to */
+  std::string m_path;  /**< The file backing the cache */
+};
+} // namespace pipeline_cache
+
+#endif
@@ -0,0 +1,289 @@
+#pragma once
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "common.h"
+#include "vulkan_base/scheduler.h"
+#include "vulkan_base/trace.h"
+#include "vulkan_base/vk_device.h"
+
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace profiling {
+static constexpr uint32_t DEFAULT_PROFILER_SCOPES =
+    1024; /**< Scopes that can wait for their results at once */
+static constexpr size_t PROFILER_SAMPLES =
+    4096; /**< Latest samples kept per name for the percentiles */
+static constexpr uint32_t NO_SCOPE =
+    ~0U; /**< Returned by begin() when nothing was recorded */
+
+/**
+ * \enum Mode
+ *
+ * \brief How much the profiler measures.
+ */
+enum class Mode {
+  Off,        /**< Nothing */
+  Batches,    /**< Whole submissions: batches, streams, replays, copies */
+  Dispatches, /**< Every dispatch as well */
+};
+
+/**
+ * \enum Level
+ *
+ * \brief The granularity of a scope.
+ */
+enum class Level {
+  Batch = 1,    /**< Measured by Mode::Batches and Mode::Dispatches */
+  Dispatch = 2, /**< Only measured by Mode::Dispatches */
+};
+
+/**
+ * \struct Stats
+ *
+ * \brief The statistics of the samples of one name, in nanoseconds.
+ *
+ * count, min, max and total cover every sample, the percentiles the latest
+ * PROFILER_SAMPLES.
+ */
+struct Stats {
+  uint64_t count = 0; /**< Number of samples */
+  double min = 0.0;   /**< Shortest sample */
+  double p50 = 0.0;   /**< Median */
+  double p99 = 0.0;   /**< 99th percentile */
+  double max = 0.0;   /**< Longest sample */
+  double total = 0.0; /**< Sum of all samples */
+};
+
+/**
+ * \class Profiler
+ *
+ * \brief Measures GPU time with timestamp queries.
+ *
+ * A scope writes a timestamp into a command buffer before and after the
+ * commands it wraps. Its result is read back by collect(), which only takes
+ * the results that are already available and never waits, so it can be
+ * called after every submission. The ticks are converted with
+ * timestampPeriod and aggregated per name. Host-measured durations, like
+ * pipeline creation, can be added with addSample().
+ *
+ * The query pool is reset from the host, so on devices without the
+ * hostQueryReset feature no scope is measured; host samples are still
+ * aggregated.
+ *
+ * While the tracer is enabled, every collected scope is also added to it as
+ * a span of its queue. The ticks are converted to host time with
+ * VK_EXT_calibrated_timestamps when the device has it, recalibrating on
+ * every collect. Otherwise the offset is estimated once, from a timestamp
+ * written by a submission the host waits for, and may drift.
+ */
+class Profiler {
+public:
+  Profiler(Profiler &&) = delete;
+  Profiler(Profiler const &) = delete;
+  Profiler &operator=(Profiler &&) = delete;
+  Profiler &operator=(Profiler const &) = delete;
+
+  /**
+   * \brief Creates the query pool.
+   *
+   * \param deviceHandler The device.
+   * \param scheduler Gives the families of the queues, and submits the
+   * calibration timestamp when there are no calibrated timestamps.
+   * \param mode What to measure.
+   * \param scopes The number of scopes that can be in flight.
+   */
+  Profiler(std::shared_ptr<device::DeviceHandler> deviceHandler,
+           scheduler::Scheduler &scheduler, Mode mode = Mode::Batches,
+           uint32_t scopes = DEFAULT_PROFILER_SCOPES);
+
+  /**
+   * \brief Destroys the query pool.
+   */
+  ~Profiler();
+
+  /**
+   * \fn void setMode(Mode mode)
+   *
+   * \brief Changes what is measured from now on.
+   */
+  void setMode(Mode mode);
+
+  /**
+   * \fn Mode mode() const
+   *
+   * \brief What is measured.
+   */
+  [[nodiscard]] Mode mode() const;
+
+  /**
+   * \fn bool enabled(Level level) const
+   *
+   * \brief Whether scopes of level are measured.
+   */
+  [[nodiscard]] bool enabled(Level level) const;
+
+  /**
+   * \fn uint32_t begin(VkCommandBuffer cmd, std::string const &name, Level
+   * level, scheduler::QueueType queue)
+   *
+   * \brief Writes the first timestamp of a scope into cmd.
+   *
+   * \param cmd A command buffer in the recording state.
+   * \param name What the scope is aggregated under.
+   * \param level The granularity of the scope.
+   * \param queue The queue cmd is submitted to.
+   *
+   * \return The scope to pass to end(), or NO_SCOPE if the level is not
+   * measured, the queue has no timestamps or every scope is in flight.
+   */
+  uint32_t begin(VkCommandBuffer cmd, std::string const &name, Level level,
+                 scheduler::QueueType queue = scheduler::QueueType::Compute);
+
+  /**
+   * \fn void end(VkCommandBuffer cmd, uint32_t scope)
+   *
+   * \brief Writes the last timestamp of scope into cmd.
+   *
+   * Does nothing for NO_SCOPE.
+   */
+  void end(VkCommandBuffer cmd, uint32_t scope);
+
+  /**
+   * \fn void discard(uint32_t scope)
+   *
+   * \brief Frees scope, whose command buffer is never going to be submitted.
+   *
+   * Does nothing for NO_SCOPE.
+   */
+  void discard(uint32_t scope);
+
+  /**
+   * \fn void collect()
+   *
+   * \brief Aggregates the scopes whose results are available, without waiting.
+   */
+  void collect();
+
+  /**
+   * \fn void addSample(std::string const &name, double nanoseconds)
+   *
+   * \brief Aggregates a duration measured on the host.
+   */
+  void addSample(std::string const &name, double nanoseconds);
+
+  /**
+   * \fn Stats stats(std::string const &name)
+   *
+   * \brief The statistics of name, all zero if it has no samples.
+   */
+  [[nodiscard]] Stats stats(std::string const &name);
+
+  /**
+   * \fn std::map<std::string, Stats> statistics()
+   *
+   * \brief The statistics of every name.
+   */
+  [[nodiscard]] std::map<std::string, Stats> statistics();
+
+  /**
+   * \fn uint64_t dropped() const
+   *
+   * \brief The number of scopes skipped because every scope was in flight.
+   */
+  [[nodiscard]] uint64_t dropped() const;
+
+  /**
+   * \fn void report(std::ostream &out)
+   *
+   * \brief Collects and prints a table of the statistics, in microseconds.
+   */
+  void report(std::ostream &out);
+
+private:
+  /**
+   * \struct Scope
+   *
+   * \brief A pair of timestamp queries.
+   */
+  struct Scope {
+    std::string name;   /**< What the scope is aggregated under */
+    scheduler::QueueType queue{}; /**< The queue it was written on */
+    uint64_t mask = 0;  /**< Valid bits of queue */
+    bool used = false;  /**< Whether its results are still to be read */
+  };
+
+  /**
+   * \struct Samples
+   *
+   * \brief The samples of one name.
+   */
+  struct Samples {
+    Stats stats;                 /**< Everything but the percentiles */
+    std::vector<double> latest;  /**< Ring of the latest samples */
+    size_t next = 0;             /**< Where the next sample goes */
+  };
+
+  /**
+   * \fn void m_collect()
+   *
+   * \brief collect(), with m_mutex held.
+   */
+  void m_collect();
+
+  /**
+   * \fn void m_calibrate()
+   *
+   * \brief Relates a device timestamp to a host time, with m_mutex held.
+   */
+  void m_calibrate();
+
+  /**
+   * \fn uint64_t m_toHost(uint64_t ticks, uint64_t mask) const
+   *
+   * \brief Converts a timestamp with mask valid bits to Tracer::now() time.
+   */
+  [[nodiscard]] uint64_t m_toHost(uint64_t ticks, uint64_t mask) const;
+
+  /**
+   * \fn void m_add(std::string const &name, double nanoseconds)
+   *
+   * \brief addSample(), with m_mutex held.
+   */
+  void m_add(std::string const &name, double nanoseconds);
+
+  /**
+   * \fn Stats m_stats(Samples const &samples)
+   *
+   * \brief The statistics of samples, including the percentiles.
+   */
+  [[nodiscard]] static Stats m_stats(Samples const &samples);
+
+  std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+  scheduler::Scheduler &m_scheduler; /**< Submits the calibration */
+  Mode m_mode;                       /**< What is measured */
+  VkQueryPool m_pool{};              /**< Two timestamps per scope */
+  std::vector<Scope> m_scopes;       /**< The scopes of m_pool */
+  uint32_t m_next = 0;               /**< Where to look for a free scope */
+  double m_period;                   /**< Nanoseconds per tick */
+  std::array<uint64_t, scheduler::QUEUE_TYPE_COUNT>
+      m_masks{};                     /**< Valid bits per QueueType */
+  PFN_vkGetCalibratedTimestampsEXT m_getCalibratedTimestamps =
+      nullptr;                       /**< Null without the extension */
+  bool m_calibrated = false;         /**< Whether the anchors are set */
+  uint64_t m_deviceAnchor = 0;       /**< A device timestamp... */
+  uint64_t m_hostAnchor = 0;         /**< ...and the host time it was at */
+  std::map<std::string, Samples> m_samples; /**< By name */
+  uint64_t m_dropped = 0;                   /**< See dropped() */
+  mutable std::mutex m_mutex;               /**< Guards all of the above */
+};
+} // namespace profiling
+
+#endif
@@ -0,0 +1,94 @@
+#pragma once
+
+#ifndef REFLECTION_H
+#define REFLECTION_H
+
+#include "common.h"
+
+#include <array>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace reflection {
+/**
+ * \struct Binding
+ *
+ * \brief A descriptor a shader declares.
+ */
+struct Binding {
+  uint32_t set = 0;      /**< The descriptor set */
+  uint32_t binding = 0;  /**< The binding in set */
+  VkDescriptorType type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER; /**< Its type */
+  uint32_t count = 1;    /**< Elements of a descriptor array, else 1 */
+  VkDeviceSize size = 0; /**< Bytes of a buffer block before a runtime array */
+  VkDeviceSize stride = 0; /**< Bytes per element of a trailing runtime
+                              array, 0 if the block has none */
+  std::string name;      /**< The block or variable name, if not stripped */
+};
+
+/**
+ * \struct ShaderLayout
+ *
+ * \brief The interface of a compute shader, as read from its SPIR-V.
+ */
+struct ShaderLayout {
+  std::vector<Binding> bindings; /**< Sorted by set, then binding */
+  uint32_t pushConstantSize = 0; /**< Bytes of the push constant block */
+  std::array<uint32_t, 3> localSize = {1, 1,
+                                       1}; /**< The workgroup size */
+  std::array<std::optional<uint32_t>, 3>
+      localSizeSpecIds; /**< The specialization constant of each axis of the
+                           workgroup size, empty if it is fixed */
+  std::string entryPoint = "main";         /**< The compute entry point */
+  bool deviceAddresses =
+      false; /**< Whether the shader reads buffers through their device
+                addresses, which the device must then support */
+
+  /**
+   * \fn uint32_t setCount() const
+   *
+   * \brief One past the highest set any binding is in.
+   */
+  [[nodiscard]] uint32_t setCount() const;
+
+  /**
+   * \fn std::vector<Binding> set(uint32_t set) const
+   *
+   * \brief The bindings of set.
+   */
+  [[nodiscard]] std::vector<Binding> set(uint32_t set) const;
+
+  /**
+   * \fn std::array<uint32_t, 3> groupCount(std::array<uint32_t, 3> const
+   * &invocations) const
+   *
+   * \brief The workgroups needed to cover invocations with localSize.
+   */
+  [[nodiscard]] std::array<uint32_t, 3>
+  groupCount(std::array<uint32_t, 3> const &invocations) const;
+};
+
+/**
+ * \fn ShaderLayout reflect(std::vector<uint32_t> const &code)
+ *
+ * \brief Reads the descriptors, push constants and workgroup size of code.
+ *
+ * Only the instructions that describe the interface are parsed: names,
+ * decorations, types, constants, variables and execution modes. Sizes follow
+ * the Offset and ArrayStride decorations, so they are those of the std140 or
+ * std430 layout the shader was compiled with; a buffer reference in a block
+ * is the 8 bytes of its address.
+ *
+ * \param code A SPIR-V module with one compute entry point.
+ *
+ * \throw std::runtime_error if code is not SPIR-V, or declares something
+ * the descriptor helpers cannot create, like a runtime descriptor array.
+ *
+ * A workgroup size set by specialization constants is reported with their
+ * default values, and the constant of each axis in localSizeSpecIds.
+ */
+ShaderLayout reflect(std::vector<uint32_t> const &code);
+} // namespace reflection
+
+#endif
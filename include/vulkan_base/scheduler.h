@@ -0,0 +1,343 @@
+#pragma once
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "common.h"
+#include "vulkan_base/sync_objects.h"
+#include "vulkan_base/vk_device.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace scheduler {
+/**
+ * \enum QueueType
+ *
+ * \brief The queues submissions can be scheduled on.
+ */
+enum class QueueType {
+  Compute,  /**< DeviceHandler::computeQueue */
+  Transfer, /**< DeviceHandler::getTransferQueue() */
+};
+
+static constexpr size_t QUEUE_TYPE_COUNT = 2; /**< Number of QueueTypes */
+
+/**
+ * \struct Point
+ *
+ * \brief A value on the timeline of a queue.
+ *
+ * A submission is done once semaphore reaches value. A default point is
+ * always reached.
+ */
+struct Point {
+  VkSemaphore semaphore = VK_NULL_HANDLE; /**< A timeline semaphore */
+  uint64_t value = 0; /**< The value semaphore reaches with the submission */
+};
+
+/**
+ * \struct Wait
+ *
+ * \brief A point a submission waits for before stage.
+ *
+ * The point may be on the timeline of the submitting queue: submission order
+ * alone does not make one batch wait for the previous one.
+ */
+struct Wait {
+  Point point;                /**< The point to wait for */
+  VkPipelineStageFlags stage; /**< The stages of the submission that wait */
+};
+
+class Scheduler;
+
+/**
+ * \class Lane
+ *
+ * \brief A compute queue of the pool, held for as long as the Lane lives.
+ *
+ * Submissions made through one lane start in order on its queue, but may
+ * overlap and finish out of order; one that uses the results of an earlier
+ * one needs a Wait on its point or a barrier. Those of different lanes may
+ * run concurrently and are only ordered by Waits. A lane must not outlive
+ * its Scheduler.
+ */
+class Lane {
+public:
+  Lane(Lane const &) = delete;
+  Lane &operator=(Lane &&) = delete;
+  Lane &operator=(Lane const &) = delete;
+  Lane(Lane &&other) noexcept;
+
+  /**
+   * \brief Gives the queue back to the pool.
+   */
+  ~Lane();
+
+  /**
+   * \fn VkQueue queue() const
+   *
+   * \brief The Vulkan queue of the lane.
+   */
+  [[nodiscard]] VkQueue queue() const;
+
+  /**
+   * \fn uint32_t family() const
+   *
+   * \brief The queue family of the lane, which its command buffers must be
+   * allocated from.
+   */
+  [[nodiscard]] uint32_t family() const;
+
+private:
+  friend class Scheduler;
+
+  Lane(Scheduler *scheduler, size_t timeline);
+
+  Scheduler *m_scheduler; /**< The pool, null once moved from */
+  size_t m_timeline;      /**< The index of the lane's timeline */
+};
+
+/**
+ * \class Scheduler
+ *
+ * \brief Submits command buffers and tracks them with timeline semaphores.
+ *
+ * Every queue has a timeline semaphore from a SyncObjects, and every
+ * submission to the queue signals the next value of it. The returned Point
+ * can be waited on or polled from the host, or passed as a Wait to a
+ * submission on another queue, so no fence is needed per submission. When
+ * there is no dedicated transfer queue, QueueType::Transfer shares the
+ * timeline of the compute queue. Submissions to a queue are serialized by a
+ * mutex, so the scheduler may be used from several threads.
+ *
+ * Every queue of the compute family, and of the async compute family, also
+ * has a timeline. acquire() hands these out as Lanes, each time the one held
+ * by the fewest lanes, so independent jobs that each hold a lane run on
+ * different queues while there are enough of them. QueueType::Compute is
+ * the timeline of the first queue of the compute family.
+ */
+class Scheduler {
+public:
+  Scheduler(Scheduler &&) = delete;
+  Scheduler(Scheduler const &) = delete;
+  Scheduler &operator=(Scheduler &&) = delete;
+  Scheduler &operator=(Scheduler const &) = delete;
+
+  /**
+   * \brief Creates the timelines of the queues of deviceHandler.
+   *
+   * \param deviceHandler The device, created with timeline semaphores.
+   */
+  explicit Scheduler(std::shared_ptr<device::DeviceHandler> deviceHandler);
+
+  /**
+   * \brief Waits for every submission.
+   */
+  ~Scheduler();
+
+  /**
+   * \fn Point submit(QueueType queue, std::vector<VkCommandBuffer> const
+   * &cmds, std::vector<Wait> const &waits, VkFence fence)
+   *
+   * \brief Submits cmds to queue after waits.
+   *
+   * \param queue The queue to submit to.
+   * \param cmds Ended command buffers, may be empty.
+   * \param waits Points of any queue to wait for.
+   * \param fence An optional fence, for code that still needs one.
+   *
+   * \return The point the submission signals.
+   */
+  Point submit(QueueType queue, std::vector<VkCommandBuffer> const &cmds,
+               std::vector<Wait> const &waits = {},
+               VkFence fence = VK_NULL_HANDLE);
+
+  /**
+   * \fn Point submit(QueueType queue, VkCommandBuffer cmd, std::vector<Wait>
+   * const &waits)
+   *
+   * \brief Submits a single command buffer.
+   */
+  Point submit(QueueType queue, VkCommandBuffer cmd,
+               std::vector<Wait> const &waits = {});
+
+  /**
+   * \fn Lane acquire(std::optional<uint32_t> family)
+   *
+   * \brief The least used compute queue, of family if given.
+   *
+   * Ties go round-robin. Without a family, only queues of the compute family
+   * are handed out, so command buffers from the pool of the
+   * CommandBufferHandler can be submitted on the lane and exclusive buffers
+   * need no ownership transfer. Pass DeviceHandler::queueFamilies'
+   * asyncComputeFamily, with command buffers from a pool of that family, to
+   * use the async compute queues.
+   *
+   * \throw std::runtime_error if the device has no queue of family.
+   */
+  [[nodiscard]] Lane acquire(std::optional<uint32_t> family = std::nullopt);
+
+  /**
+   * \fn Point submit(Lane const &lane, std::vector<VkCommandBuffer> const
+   * &cmds, std::vector<Wait> const &waits, VkFence fence)
+   *
+   * \brief Submits cmds to the queue of lane after waits.
+   */
+  Point submit(Lane const &lane, std::vector<VkCommandBuffer> const &cmds,
+               std::vector<Wait> const &waits = {},
+               VkFence fence = VK_NULL_HANDLE);
+
+  /**
+   * \fn Point submit(Lane const &lane, VkCommandBuffer cmd,
+   * std::vector<Wait> const &waits)
+   *
+   * \brief Submits a single command buffer to the queue of lane.
+   */
+  Point submit(Lane const &lane, VkCommandBuffer cmd,
+               std::vector<Wait> const &waits = {});
+
+  /**
+   * \fn Point last(Lane const &lane)
+   *
+   * \brief The point of the latest submission to the queue of lane.
+   */
+  [[nodiscard]] Point last(Lane const &lane);
+
+  /**
+   * \fn Point last(QueueType queue)
+   *
+   * \brief The point of the latest submission to queue.
+   */
+  [[nodiscard]] Point last(QueueType queue);
+
+  /**
+   * \fn uint64_t completed(QueueType queue) const
+   *
+   * \brief The value the timeline of queue has reached.
+   */
+  [[nodiscard]] uint64_t completed(QueueType queue) const;
+
+  /**
+   * \fn void wait(Point const &point) const
+   *
+   * \brief Waits on the host until point is reached, then invalidates the
+   * ranges noted against it with memory::Allocator::markRead().
+   */
+  void wait(Point const &point) const;
+
+  /**
+   * \fn bool poll(Point const &point) const
+   *
+   * \brief Whether point has been reached, without waiting; see wait().
+   */
+  [[nodiscard]] bool poll(Point const &point) const;
+
+  /**
+   * \fn void waitIdle(QueueType queue)
+   *
+   * \brief Waits for every submission made to queue so far.
+   */
+  void waitIdle(QueueType queue);
+
+  /**
+   * \fn VkQueue queue(QueueType queue) const
+   *
+   * \brief The Vulkan queue behind queue.
+   */
+  [[nodiscard]] VkQueue queue(QueueType queue) const;
+
+  /**
+   * \fn uint32_t family(QueueType queue) const
+   *
+   * \brief The queue family of queue.
+   */
+  [[nodiscard]] uint32_t family(QueueType queue) const;
+
+  /**
+   * \fn QueueType typeOf(VkQueue queue) const
+   *
+   * \brief The type of a queue of the device.
+   */
+  [[nodiscard]] QueueType typeOf(VkQueue queue) const;
+
+private:
+  friend class Lane;
+
+  /**
+   * \struct Timeline
+   *
+   * \brief The submission state of one VkQueue.
+   */
+  struct Timeline {
+    VkQueue queue = VK_NULL_HANDLE;   /**< The queue */
+    uint32_t family = 0;              /**< The family of queue */
+    VkSemaphore semaphore{};          /**< Signaled by every submission */
+    uint64_t nextValue = 1;           /**< Value of the next submission */
+    size_t lanes = 0;                 /**< Lanes holding the queue */
+    std::mutex mutex;                 /**< Orders the signaled values */
+    std::atomic<uint64_t> reached{0}; /**< Latest value the host saw */
+  };
+
+  /**
+   * \fn Timeline &m_timeline(QueueType queue)
+   *
+   * \brief The timeline queue is submitted on.
+   */
+  Timeline &m_timeline(QueueType queue);
+  [[nodiscard]] Timeline const &m_timeline(QueueType queue) const;
+
+  /**
+   * \fn Point m_submit(Timeline &timeline, std::vector<VkCommandBuffer>
+   * const &cmds, std::vector<Wait> const &waits, VkFence fence)
+   *
+   * \brief Submits cmds on timeline, signaling its next value.
+   */
+  Point m_submit(Timeline &timeline, std::vector<VkCommandBuffer> const &cmds,
+                 std::vector<Wait> const &waits, VkFence fence);
+
+  /**
+   * \fn Point m_last(Timeline &timeline)
+   *
+   * \brief The point of the latest submission on timeline.
+   */
+  static Point m_last(Timeline &timeline);
+
+  /**
+   * \fn void m_reached(VkSemaphore semaphore, uint64_t value) const
+   *
+   * \brief Notes that the host saw the timeline of semaphore reach value.
+   */
+  void m_reached(VkSemaphore semaphore, uint64_t value) const;
+
+  /**
+   * \fn bool m_passed(Point const &point) const
+   *
+   * \brief Whether the host already saw point reached.
+   */
+  [[nodiscard]] bool m_passed(Point const &point) const;
+
+  /**
+   * \fn void m_release(size_t timeline)
+   *
+   * \brief Drops a lane from the count of timeline.
+   */
+  void m_release(size_t timeline);
+
+  std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+  std::unique_ptr<SyncObjects> m_sync; /**< Owns the timeline semaphores */
+  std::vector<std::unique_ptr<Timeline>>
+      m_timelines; /**< The compute queues in DeviceHandler::computeQueues
+                      order, then the async compute queues, then the
+                      dedicated transfer queue if there is one */
+  size_t m_transfer = 0; /**< Index of the Transfer timeline */
+  bool m_dedicatedTransfer = false; /**< Whether Transfer has its own queue */
+  std::mutex m_laneMutex; /**< Guards the lane counts and m_nextLane */
+  size_t m_nextLane = 0;  /**< Where the next search for a lane starts */
+};
+} // namespace scheduler
+
+#endif
@@ -0,0 +1,132 @@
+#pragma once
+
+#ifndef SHADER_REGISTRY_H
+#define SHADER_REGISTRY_H
+
+#include <map>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+namespace shaders {
+/**
+ * \struct Embedded
+ *
+ * \brief A SPIR-V module compiled into the binary.
+ */
+struct Embedded {
+  char const *name;     /**< The name of the .spv file, e. g. reduce.comp.spv */
+  uint32_t const *code; /**< The words of the module */
+  size_t wordCount;     /**< The number of words */
+};
+
+/**
+ * \fn std::span<Embedded const> embedded()
+ *
+ * \brief Every module the build compiled.
+ *
+ * Defined in the source the Shaders target generates from the .spv files.
+ */
+std::span<Embedded const> embedded();
+
+/**
+ * \class Registry
+ *
+ * \brief Looks shaders up by name and caches their modules.
+ *
+ * The code comes from the modules embedded into the binary, so creating a
+ * pipeline reads no files. During development an override directory can be
+ * set, and a .spv file there takes the place of the embedded module of the
+ * same name. Each shader is loaded once and its VkShaderModule created once,
+ * however many pipelines are created from it; the modules live as long as
+ * the registry.
+ */
+class Registry {
+public:
+  Registry(Registry &&) = delete;
+  Registry(Registry const &) = delete;
+  Registry &operator=(Registry &&) = delete;
+  Registry &operator=(Registry const &) = delete;
+
+  /**
+   * \brief Creates an empty registry for device.
+   */
+  explicit Registry(VkDevice device);
+
+  /**
+   * \brief Destroys the cached modules.
+   */
+  ~Registry();
+
+  /**
+   * \fn void setOverrideDirectory(std::string directory)
+   *
+   * \brief Looks for .spv files in directory before the embedded modules.
+   *
+   * Only affects shaders that have not been loaded yet.
+   */
+  void setOverrideDirectory(std::string directory);
+
+  /**
+   * \fn bool contains(std::string const &name)
+   *
+   * \brief Whether a shader named name can be loaded.
+   */
+  [[nodiscard]] bool contains(std::string const &name);
+
+  /**
+   * \fn std::vector<uint32_t> const &code(std::string const &name)
+   *
+   * \brief The SPIR-V words of the shader, loaded on first use.
+   *
+   * \throw std::runtime_error if there is no shader named name.
+   */
+  std::vector<uint32_t> const &code(std::string const &name);
+
+  /**
+   * \fn VkShaderModule module(std::string const &name)
+   *
+   * \brief The module of the shader, created on first use.
+   *
+   * \throw std::runtime_error if there is no shader named name.
+   */
+  VkShaderModule module(std::string const &name);
+
+private:
+  /**
+   * \struct Entry
+   *
+   * \brief A shader that has been loaded.
+   */
+  struct Entry {
+    std::vector<uint32_t> code;             /**< Its words */
+    VkShaderModule module = VK_NULL_HANDLE; /**< Created on first use */
+  };
+
+  VkDevice m_device;               /**< The device the modules belong to */
+  std::string m_overrideDirectory; /**< Searched first if not empty */
+  std::map<std::string, Entry> m_entries; /**< The loaded shaders by name */
+  std::mutex m_mutex; /**< Pipelines may be created on several threads */
+
+  /**
+   * \fn Entry &m_load(std::string const &name)
+   *
+   * \brief The entry of name, loading it if needed. Called with m_mutex
+   * held.
+   *
+   * \throw std::runtime_error if there is no shader named name.
+   */
+  Entry &m_load(std::string const &name);
+
+  /**
+   * \fn std::string m_overridePath(std::string const &name) const
+   *
+   * \brief The override file of name, empty if there is none.
+   */
+  [[nodiscard]] std::string m_overridePath(std::string const &name) const;
+};
+} // namespace shaders
+
+#endif
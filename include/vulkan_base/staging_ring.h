@@ -0,0 +1,145 @@
+#pragma once
+
+#ifndef STAGING_RING_H
+#define STAGING_RING_H
+
+#include "common.h"
+#include "vulkan_base/transfer.h"
+#include "vulkan_base/vk_device.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+
+namespace staging {
+static constexpr VkDeviceSize DEFAULT_STAGING_SIZE =
+    VkDeviceSize{16} << 20; /**< Default size of the ring in bytes */
+static constexpr VkDeviceSize STAGING_CHUNK_FRACTION =
+    4; /**< Uploads are split into chunks of at most capacity / this */
+
+/**
+ * \class StagingRing
+ *
+ * \brief A persistently mapped host-visible buffer uploads are staged in.
+ *
+ * Every upload is copied into the next free region of the ring and a copy
+ * into the destination buffer is submitted through a TransferEngine. The
+ * region is reclaimed once the transfer timeline passes the copy, so uploads
+ * neither allocate nor map memory, and only wait for the GPU when the ring is
+ * full. Large uploads are split into chunks so that the ring keeps several of
+ * them in flight.
+ */
+class StagingRing {
+public:
+  StagingRing(StagingRing &&) = delete;
+  StagingRing(StagingRing const &) = delete;
+  StagingRing &operator=(StagingRing &&) = delete;
+  StagingRing &operator=(StagingRing const &) = delete;
+
+  /**
+   * \brief Creates the ring.
+   *
+   * \param deviceHandler The device.
+   * \param transferEngine The engine the copies are submitted to, which
+   * must outlive the ring.
+   * \param capacity The size of the ring in bytes.
+   */
+  StagingRing(std::shared_ptr<device::DeviceHandler> deviceHandler,
+              transfer::TransferEngine &transferEngine,
+              VkDeviceSize capacity = DEFAULT_STAGING_SIZE);
+
+  /**
+   * \brief Waits for all uploads and frees the ring.
+   */
+  ~StagingRing();
+
+  /**
+   * \fn transfer::Token upload(void const *data, VkDeviceSize size, VkBuffer
+   * dst, VkDeviceSize dstOffset, VkSharingMode sharingMode,
+   * std::vector<scheduler::Point> const &after)
+   *
+   * \brief Copies size bytes of data into dst through the ring.
+   *
+   * Returns once data has been copied into the ring, so the caller may reuse
+   * it right away; the copy into dst may still be in flight. dst is handed
+   * to the compute family with the last chunk.
+   *
+   * \param data The data to upload.
+   * \param size The size of data in bytes.
+   * \param dst The destination buffer, with TRANSFER_DST usage.
+   * \param dstOffset The offset in dst to copy to.
+   * \param sharingMode The sharing mode of dst.
+   * \param after Points of other lanes still using dst; see
+   * transfer::TransferEngine::copy().
+   *
+   * \return The token of the upload.
+   */
+  transfer::Token upload(void const *data, VkDeviceSize size, VkBuffer dst,
+                         VkDeviceSize dstOffset = 0,
+                         VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+                         std::vector<scheduler::Point> const &after = {});
+
+  /**
+   * \fn void wait(transfer::Token const &token) const
+   *
+   * \brief Waits until the upload that returned token has reached dst.
+   *
+   * \param token A token returned by upload().
+   */
+  void wait(transfer::Token const &token) const;
+
+  /**
+   * \fn VkDeviceSize capacity() const
+   *
+   * \brief The size of the ring in bytes.
+   */
+  [[nodiscard]] VkDeviceSize capacity() const { return m_capacity; }
+
+private:
+  /**
+   * \struct Region
+   *
+   * \brief A part of the ring a submitted copy reads from.
+   */
+  struct Region {
+    VkDeviceSize begin; /**< First byte of the region */
+    VkDeviceSize end;   /**< One past the last byte of the region */
+    uint64_t value;     /**< Transfer timeline value of the copy */
+  };
+
+  /**
+   * \fn bool m_reserve(VkDeviceSize size, VkDeviceSize &offset)
+   *
+   * \brief Finds size free bytes in the ring, without waiting.
+   *
+   * \return False if the ring has no room for size right now.
+   */
+  bool m_reserve(VkDeviceSize size, VkDeviceSize &offset) const;
+
+  /**
+   * \fn void m_retireOldest()
+   *
+   * \brief Waits for the oldest copy in flight and reclaims its region.
+   */
+  void m_retireOldest();
+
+  /**
+   * \fn void m_retireCompleted()
+   *
+   * \brief Reclaims the regions of all copies that have already finished.
+   */
+  void m_retireCompleted();
+
+  std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+  transfer::TransferEngine &m_transferEngine; /**< Submits the copies */
+  VkDeviceSize m_capacity;                    /**< Size of the ring */
+  VkDeviceSize m_alignment;                   /**< Alignment of every region */
+  VkBuffer m_buffer = VK_NULL_HANDLE;         /**< The ring itself */
+  memory::Allocation m_allocation{};          /**< Memory of m_buffer */
+  VkDeviceSize m_head = 0;       /**< Where the next region goes */
+  std::deque<Region> m_inFlight; /**< Oldest copy first */
+  std::mutex m_mutex;            /**< Guards all of the above */
+};
+} // namespace staging
+
+#endif
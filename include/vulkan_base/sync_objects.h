@@ -16,7 +16,9 @@ class SyncObjects {
     SyncObjects &operator=(SyncObjects &&) = delete;
     SyncObjects &operator=(SyncObjects const &) = delete;
 
-    std::optional<std::vector<VkSemaphore>> timed_semaphores{};
+    std::optional<std::vector<VkSemaphore>>
+        timed_semaphores{}; /**< Timeline semaphores starting at 0, if asked
+                               for **/
     std::vector<VkSemaphore> semaphores{};
     std::vector<VkFence> fences{};
 
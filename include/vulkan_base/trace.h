@@ -0,0 +1,200 @@
+#pragma once
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace tracing {
+static constexpr size_t MAX_TRACE_EVENTS =
+    1 << 20; /**< Events kept before new ones are dropped */
+
+/**
+ * \class Tracer
+ *
+ * \brief Collects host and GPU spans into one Chrome trace.
+ *
+ * There is one tracer per process, so spans can be recorded before any
+ * device exists. It is disabled by default, and a disabled tracer records
+ * nothing. Host spans are timed with std::chrono::steady_clock, in
+ * nanoseconds, and are shown per thread. GPU spans are added by the
+ * profiler once their timestamps are converted to the same clock, and are
+ * shown per queue. write() saves everything as a JSON file that
+ * chrome://tracing and Perfetto open.
+ */
+class Tracer {
+public:
+  Tracer(Tracer &&) = delete;
+  Tracer(Tracer const &) = delete;
+  Tracer &operator=(Tracer &&) = delete;
+  Tracer &operator=(Tracer const &) = delete;
+
+  /**
+   * \fn static Tracer &instance()
+   *
+   * \brief The tracer of the process.
+   */
+  static Tracer &instance();
+
+  /**
+   * \fn static uint64_t now()
+   *
+   * \brief The host time spans use, in nanoseconds.
+   *
+   * On Linux this is CLOCK_MONOTONIC, the clock GPU timestamps are
+   * calibrated against.
+   */
+  static uint64_t now();
+
+  /**
+   * \fn void setEnabled(bool enabled)
+   *
+   * \brief Starts or stops recording.
+   */
+  void setEnabled(bool enabled);
+
+  /**
+   * \fn bool enabled() const
+   *
+   * \brief Whether spans are recorded.
+   */
+  [[nodiscard]] bool enabled() const {
+    return m_enabled.load(std::memory_order_relaxed);
+  }
+
+  /**
+   * \fn void hostSpan(std::string const &name, char const *category,
+   * uint64_t begin, uint64_t end)
+   *
+   * \brief Records a span of the calling thread, with times from now().
+   */
+  void hostSpan(std::string const &name, char const *category, uint64_t begin,
+                uint64_t end);
+
+  /**
+   * \fn void gpuSpan(std::string const &name, char const *queue, uint64_t
+   * begin, uint64_t end)
+   *
+   * \brief Records a span of queue, with times converted to now().
+   */
+  void gpuSpan(std::string const &name, char const *queue, uint64_t begin,
+               uint64_t end);
+
+  /**
+   * \fn void instant(std::string const &name, char const *category)
+   *
+   * \brief Records a point in time of the calling thread, like a message.
+   */
+  void instant(std::string const &name, char const *category);
+
+  /**
+   * \fn void write(std::ostream &out) const
+   *
+   * \brief Writes the recorded events as Chrome trace JSON.
+   */
+  void write(std::ostream &out) const;
+
+  /**
+   * \fn void write(std::string const &path) const
+   *
+   * \brief Writes the recorded events to the file at path.
+   *
+   * \throw std::runtime_error if the file cannot be written.
+   */
+  void write(std::string const &path) const;
+
+  /**
+   * \fn void clear()
+   *
+   * \brief Forgets every recorded event.
+   */
+  void clear();
+
+  /**
+   * \fn uint64_t dropped() const
+   *
+   * \brief The number of events dropped after MAX_TRACE_EVENTS.
+   */
+  [[nodiscard]] uint64_t dropped() const;
+
+private:
+  Tracer();
+
+  /**
+   * \struct Event
+   *
+   * \brief A span or an instant on a track.
+   */
+  struct Event {
+    std::string name;     /**< What happened */
+    char const *category; /**< Groups events in the viewer */
+    uint64_t begin;       /**< Host nanoseconds */
+    uint64_t end;         /**< Equal to begin for instants */
+    char phase;           /**< 'X' for spans, 'i' for instants */
+    bool gpu;             /**< Whether track is a queue or a thread */
+    uint32_t track;       /**< Index into m_threads or m_queues */
+  };
+
+  /**
+   * \fn void m_add(Event event)
+   *
+   * \brief Stores event, with m_mutex held.
+   */
+  void m_add(Event event);
+
+  /**
+   * \fn uint32_t m_thread()
+   *
+   * \brief The track of the calling thread, with m_mutex held.
+   */
+  uint32_t m_thread();
+
+  std::atomic<bool> m_enabled{false};   /**< See enabled() */
+  uint64_t m_origin;                    /**< now() at creation */
+  std::vector<Event> m_events;          /**< In the order they were added */
+  std::map<std::thread::id, uint32_t> m_threads; /**< Thread tracks */
+  std::vector<std::string> m_queues;    /**< GPU tracks, by name */
+  uint64_t m_dropped = 0;               /**< See dropped() */
+  mutable std::mutex m_mutex;           /**< Guards all but m_enabled */
+};
+
+/**
+ * \class Span
+ *
+ * \brief Records a host span from its construction to its destruction.
+ */
+class Span {
+public:
+  Span(Span &&) = delete;
+  Span(Span const &) = delete;
+  Span &operator=(Span &&) = delete;
+  Span &operator=(Span const &) = delete;
+
+  /**
+   * \brief Starts the span if the tracer is enabled.
+   *
+   * \param name What the span is shown as.
+   * \param category A string literal grouping similar spans.
+   */
+  Span(std::string name, char const *category);
+
+  /**
+   * \brief Ends the span.
+   */
+  ~Span();
+
+private:
+  std::string m_name;     /**< See the constructor */
+  char const *m_category; /**< See the constructor */
+  uint64_t m_begin = 0;   /**< 0 when the tracer was disabled */
+};
+} // namespace tracing
+
+#endif
@@ -0,0 +1,218 @@
+#pragma once
+
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include "common.h"
+#include "vulkan_base/profiler.h"
+#include "vulkan_base/scheduler.h"
+#include "vulkan_base/vk_device.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace transfer {
+/**
+ * \enum Handoff
+ *
+ * \brief Which way a copy moves a buffer between the queue families.
+ */
+enum class Handoff {
+  None,      /**< No compute work depends on the copy */
+  ToCompute, /**< dst is read by compute work submitted after the copy */
+  FromCompute, /**< src was written by compute work submitted before, and
+                   is handed back after the copy */
+};
+
+/**
+ * \brief Marks the completion of a copy.
+ *
+ * The token can be waited on from the host, or used as a
+ * scheduler::Wait in another submission.
+ */
+using Token = scheduler::Point;
+
+/**
+ * \class TransferEngine
+ *
+ * \brief Submits buffer copies to the transfer queue without waiting.
+ *
+ * Every copy is submitted through a scheduler::Scheduler and returns the
+ * point it signals as a Token,
+ * so the caller can record the next chunk while the previous one is still
+ * in flight. When the device has a dedicated transfer family, exclusive
+ * buffers are released and acquired between it and the compute family: an
+ * upload with Handoff::ToCompute, or the source of a Handoff::FromCompute,
+ * is acquired back on the compute queue by the engine itself, so compute
+ * work submitted afterwards can use the buffer without waiting on the token.
+ * Without a dedicated family the copies go to the compute queue and only
+ * barriers are recorded.
+ */
+class TransferEngine {
+public:
+  TransferEngine(TransferEngine &&) = delete;
+  TransferEngine(TransferEngine const &) = delete;
+  TransferEngine &operator=(TransferEngine &&) = delete;
+  TransferEngine &operator=(TransferEngine const &) = delete;
+
+  /**
+   * \brief Creates the command pools of both families.
+   *
+   * \param deviceHandler The device.
+   * \param scheduler The scheduler the copies are submitted through, which
+   * must outlive the engine.
+   * \param profiler If not null, times every copy; must outlive the engine.
+   */
+  TransferEngine(std::shared_ptr<device::DeviceHandler> deviceHandler,
+                 scheduler::Scheduler &scheduler,
+                 profiling::Profiler *profiler = nullptr);
+
+  /**
+   * \brief Waits for every copy and frees the engine.
+   */
+  ~TransferEngine();
+
+  /**
+   * \fn Token copy(VkBuffer src, VkBuffer dst, VkBufferCopy const &region,
+   * Handoff handoff, VkSharingMode sharingMode, uint64_t *transferValue,
+   * std::vector<scheduler::Point> const &after)
+   *
+   * \brief Copies region of src into dst on the transfer queue.
+   *
+   * With Handoff::ToCompute, dst is released to the compute family after the
+   * copy and acquired on the compute queue. With Handoff::FromCompute, src is
+   * released by the compute queue and acquired before the copy, then
+   * released again after it and acquired back on the compute queue, so it
+   * keeps its contents for the compute work that follows. Ownership always
+   * covers the whole buffer, so an
+   * exclusive dst of Handoff::ToCompute keeps only what was copied into it
+   * on the transfer queue.
+   *
+   * \param src The buffer to copy from.
+   * \param dst The buffer to copy to.
+   * \param region The ranges to copy.
+   * \param handoff Which buffer changes queue family, if any.
+   * \param sharingMode The sharing mode of the buffer that changes family.
+   * Concurrent buffers only get barriers.
+   * \param transferValue If not null, set to the transfer timeline value
+   * after which src may be overwritten.
+   * \param after Points the copy, and the release of src, wait for. The
+   * copy always waits for the latest submission to QueueType::Compute, so
+   * only the submissions of other lanes that wrote src or use dst go here.
+   *
+   * \return The token of the whole copy, including the acquires.
+   */
+  Token copy(VkBuffer src, VkBuffer dst, VkBufferCopy const &region,
+             Handoff handoff = Handoff::None,
+             VkSharingMode sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+             uint64_t *transferValue = nullptr,
+             std::vector<scheduler::Point> const &after = {});
+
+  /**
+   * \fn void wait(Token const &token) const
+   *
+   * \brief Waits on the host until token is reached.
+   */
+  void wait(Token const &token) const;
+
+  /**
+   * \fn bool poll(Token const &token) const
+   *
+   * \brief Whether token has been reached, without waiting.
+   */
+  [[nodiscard]] bool poll(Token const &token) const;
+
+  /**
+   * \fn void waitTransfer(uint64_t value) const
+   *
+   * \brief Waits until the transfer timeline reaches value.
+   */
+  void waitTransfer(uint64_t value) const;
+
+  /**
+   * \fn uint64_t completedTransfer() const
+   *
+   * \brief The current value of the transfer timeline.
+   */
+  [[nodiscard]] uint64_t completedTransfer() const;
+
+  /**
+   * \fn bool dedicated() const
+   *
+   * \brief Whether copies run on a queue family of their own.
+   */
+  [[nodiscard]] bool dedicated() const { return m_dedicated; }
+
+private:
+  /**
+   * \struct Lane
+   *
+   * \brief A queue and the command pool of its submissions.
+   */
+  struct Lane {
+    scheduler::QueueType queue{};        /**< Where the commands go */
+    uint32_t family = 0;                 /**< The family of queue */
+    VkCommandPool pool{};                /**< Pool of cmds */
+    std::deque<std::pair<uint64_t, VkCommandBuffer>>
+        pending;                         /**< Submitted, oldest first */
+    std::vector<VkCommandBuffer> free;   /**< Ready to be recorded */
+  };
+
+  /**
+   * \fn void m_createLane(Lane &lane, scheduler::QueueType queue)
+   *
+   * \brief Creates the pool of lane.
+   */
+  void m_createLane(Lane &lane, scheduler::QueueType queue);
+
+  /**
+   * \fn void m_destroyLane(Lane &lane)
+   *
+   * \brief Waits for lane and destroys its pool.
+   */
+  void m_destroyLane(Lane &lane);
+
+  /**
+   * \fn VkCommandBuffer m_begin(Lane &lane)
+   *
+   * \brief Takes a finished command buffer of lane and begins it.
+   */
+  VkCommandBuffer m_begin(Lane &lane);
+
+  /**
+   * \fn Token m_submit(Lane &lane, VkCommandBuffer cmd,
+   * std::vector<scheduler::Wait> const &waits)
+   *
+   * \brief Ends cmd and submits it to the queue of lane.
+   *
+   * \return The point signaled by the submission.
+   */
+  Token m_submit(Lane &lane, VkCommandBuffer cmd,
+                 std::vector<scheduler::Wait> const &waits = {});
+
+  /**
+   * \fn VkBufferMemoryBarrier m_ownershipBarrier(VkBuffer buffer,
+   * VkSharingMode sharingMode, uint32_t srcFamily, uint32_t dstFamily) const
+   *
+   * \brief A barrier moving all of buffer from srcFamily to dstFamily.
+   *
+   * The families are ignored for concurrent buffers, and when there is no
+   * dedicated transfer family.
+   */
+  [[nodiscard]] VkBufferMemoryBarrier
+  m_ownershipBarrier(VkBuffer buffer, VkSharingMode sharingMode,
+                     uint32_t srcFamily, uint32_t dstFamily) const;
+
+  std::shared_ptr<device::DeviceHandler> m_deviceHandler;
+  scheduler::Scheduler &m_scheduler; /**< Submits every command buffer */
+  profiling::Profiler *m_profiler;   /**< Times the copies, may be null */
+  bool m_dedicated = false; /**< Whether m_transfer has its own family */
+  Lane m_transfer;          /**< The copies */
+  Lane m_compute;           /**< Releases and acquires on the compute queue */
+  std::mutex m_mutex;       /**< Guards both lanes */
+};
+} // namespace transfer
+
+#endif
@@ -1,6 +1,9 @@
 #pragma once
 #include "common.h"
 
+#include <string>
+#include <vector>
+
 namespace utils {
 /**
  * \fn bool fileExists(const std::string &filename)
@@ -23,6 +26,26 @@ void exitFatal(const std::string &message, int32_t exitCode);
 
 uint32_t alignedSize(uint32_t value, uint32_t alignment);
 
+/**
+ * \fn std::vector<uint32_t> readSpirv(const char *fileName)
+ *
+ * \brief Reads a SPIR-V file into words
+ *
+ * \param fileName The .spv file
+ *
+ * \return The words of the module, empty if the file cannot be opened
+ */
+std::vector<uint32_t> readSpirv(const char *fileName);
+
+/**
+ * \fn VkShaderModule createShaderModule(std::vector<uint32_t> const &code,
+ * VkDevice device)
+ *
+ * \brief Creates a shader module from SPIR-V words
+ */
+VkShaderModule createShaderModule(std::vector<uint32_t> const &code,
+                                  VkDevice device);
+
 VkShaderModule loadShader(const char *fileName, VkDevice device);
 
 } // namespace utils
@@ -5,14 +5,17 @@
 #define DEVICE_H
 
 #include "common.h"
+#include "vulkan_base/allocator.h"
+#include "vulkan_base/device_selection.h"
+#include "vulkan_base/shader_registry.h"
+#include <array>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <vulkan/vulkan.h>
 
 namespace device {
-static constexpr int DISCRETE_GPU_BONUS = 1000; /**< Bonus for descrete GPU */
-static constexpr int INTEGRATED_GPU_BONUS =
-    200; /**< Bonus for integrated GPU */
-
 /**
  * \class DeviceHandler
  *
@@ -31,7 +34,7 @@ public:
 
   /**
    * \fn DeviceHandler(std::vector<const char *> &, std::vector<const char *>
-   * &, VkInstance, VkSurfaceKHR)
+   * &, VkInstance, VkPhysicalDeviceFeatures2 *, selection::Policy const &)
    *
    * \brief Constructs a DeviceHandler object.
    *
@@ -42,11 +45,13 @@ public:
    * \param vkInstance The Vulkan instance associated
    * with the device.
    * \param pNext The pNext with extensions.
-   * device.
+   * \param policy Rates the physical devices that have a compute queue and
+   * the required extensions; the highest rated one is used.
    */
   DeviceHandler(std::vector<const char *> &devExt,
                 std::vector<const char *> &validations, VkInstance vkInstance,
-                VkPhysicalDeviceFeatures2 *pNext = VK_NULL_HANDLE);
+                VkPhysicalDeviceFeatures2 *pNext = VK_NULL_HANDLE,
+                selection::Policy const &policy = selection::computeScore);
 
   /**
    * \fn ~DeviceHandler()
@@ -80,6 +85,12 @@ public:
 
   VkQueue graphicsQueue = VK_NULL_HANDLE; /**< The graphics queue. */
   VkQueue computeQueue = VK_NULL_HANDLE; /**< The graphics queue. */
+  std::vector<VkQueue>
+      computeQueues; /**< Every queue of the compute family, computeQueue
+                        first */
+  std::vector<VkQueue>
+      asyncComputeQueues; /**< Every queue of the async compute family, if
+                             there is one */
   VkQueue presentQueue = VK_NULL_HANDLE;  /**< The present queue. */
   VkQueue transferQueue = VK_NULL_HANDLE; /**< The transfer queue. */
   VkPhysicalDeviceMemoryProperties
@@ -88,6 +99,29 @@ public:
                                                for use on the physical device */
   VkPhysicalDeviceProperties
       properties{}; /**< The device physica properties, e. g. memory */
+  QueueFamilyIndices
+      queueFamilies{}; /**< The families computeQueue and transferQueue are
+                          from */
+  bool calibratedTimestamps =
+      false; /**< Whether VK_EXT_calibrated_timestamps is enabled and can
+                relate the device clock to CLOCK_MONOTONIC */
+  bool pushDescriptors =
+      false; /**< Whether VK_KHR_push_descriptor is enabled */
+  uint32_t maxPushDescriptors =
+      0; /**< Descriptors one push may write, 0 without push descriptors */
+  bool bufferDeviceAddress =
+      false; /**< Whether buffers can be created with
+                VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT */
+  bool subgroupSizeControl =
+      false; /**< Whether compute pipelines can require a subgroup size */
+  bool hostQueryReset =
+      false; /**< Whether query pools can be reset from the host */
+  bool subgroupArithmetic =
+      false; /**< Whether compute shaders have subgroup arithmetic */
+  uint32_t minSubgroupSize = 0; /**< Smallest size a pipeline may require */
+  uint32_t maxSubgroupSize = 0; /**< Largest size a pipeline may require */
+  std::array<uint8_t, VK_UUID_SIZE>
+      deviceUUID{}; /**< Identifies the physical device across runs */
 
   /**
    * \fn inline VkQueue getTransferQueue()
@@ -101,19 +135,39 @@ public:
     return transferQueue != VK_NULL_HANDLE ? transferQueue : computeQueue;
   }
 
+  /**
+   * \fn VkResult submit(VkQueue queue, uint32_t submitCount, VkSubmitInfo
+   * const *submits, VkFence fence) const
+   *
+   * \brief vkQueueSubmit, serialized with every other submission to queue.
+   *
+   * Submissions to different queues do not wait for each other, so threads
+   * that feed different queues of the pool run side by side. Host writes
+   * noted with memory::Allocator::markWritten() are flushed first.
+   *
+   * \throw std::runtime_error if queue is not a queue of this device.
+   */
+  VkResult submit(VkQueue queue, uint32_t submitCount,
+                  VkSubmitInfo const *submits, VkFence fence) const;
+
   VkPhysicalDevice physicalDevice = VK_NULL_HANDLE; /**< The physical device. */
   VkDevice logicalDevice = VK_NULL_HANDLE;          /**< The logical device. */
 
+  std::unique_ptr<memory::Allocator>
+      allocator; /**< Sub-allocates the memory of all buffers */
+  std::unique_ptr<shaders::Registry>
+      shaderRegistry; /**< Loads the shaders of every pipeline and caches
+                         their modules */
+
   /**
-   * \fn inline void cleanupDevice(VkAllocationCallbacks *pAllocator) const
+   * \fn void cleanupDevice(VkAllocationCallbacks *pAllocator)
    *
-   * \brief Cleans up the logical device.
+   * \brief Destroys the shader modules, frees the memory pools and cleans up
+   * the logical device.
    *
    * \param pAllocator The optional allocator to use for device cleanup.
    */
-  inline void cleanupDevice(VkAllocationCallbacks *pAllocator) const {
-    vkDestroyDevice(logicalDevice, pAllocator);
-  }
+  void cleanupDevice(VkAllocationCallbacks *pAllocator);
   /**
    * Get the index of a memory type that has all the requested property bits
    * set
@@ -134,6 +188,23 @@ public:
   uint32_t getMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties,
                          VkBool32 *memTypeFound = nullptr) const;
 
+  /**
+   * \fn uint32_t getMemoryType(uint32_t typeBits, memory::Usage intent)
+   * const
+   *
+   * \brief The index of the memory type among typeBits that suits intent
+   * best.
+   *
+   * Kernels get device-local memory that the host cannot see, uploads get
+   * device-local, host-visible memory when the device has resizable BAR,
+   * and readbacks and host random access get host-cached memory, coherent
+   * if there is a choice. Every device has host-visible memory, so there is
+   * always a fallback.
+   *
+   * \throw std::runtime_error if typeBits allows no usable memory type.
+   */
+  uint32_t getMemoryType(uint32_t typeBits, memory::Usage intent) const;
+
   /**
    * Create a buffer on the device
    *
@@ -145,8 +216,8 @@ public:
    * the buffer in byes
    * \param buffer Pointer to the buffer handle acquired by
    * the function
-   * \param memory Pointer to the memory handle acquired by the
-   * function
+   * \param allocation Pointer to the memory range acquired by the
+   * function from allocator
    * \param data Pointer to the data that should be copied to the
    * buffer after creation (optional, if not set, no data is copied over)
    *
@@ -156,7 +227,18 @@ public:
   VkResult createBuffer(VkBufferUsageFlags usageFlags,
                         VkMemoryPropertyFlags memoryPropertyFlags,
                         VkDeviceSize size, VkBuffer *buffer,
-                        VkDeviceMemory *memory, void *data) const;
+                        memory::Allocation *allocation, void *data) const;
+
+  /**
+   * \fn void destroyBuffer(VkBuffer buffer, memory::Allocation &allocation)
+   * const
+   *
+   * \brief Destroys a buffer made by createBuffer and frees its memory.
+   *
+   * \param buffer The buffer to destroy.
+   * \param allocation The memory of the buffer, reset by the call.
+   */
+  void destroyBuffer(VkBuffer buffer, memory::Allocation &allocation) const;
 
 private:
   std::vector<const char *>
@@ -165,6 +247,8 @@ private:
       &m_validationLayers; /**< The enabled validation layers. */
   VkInstance m_vkInstance; /**< The Vulkan instance associated with the
                               device. */
+  std::map<VkQueue, std::unique_ptr<std::mutex>>
+      m_queueLocks; /**< Serializes the submissions to every queue */
   /**
    * \fn bool m_checkDeviceExtensions(VkPhysicalDevice device)
    *
@@ -189,31 +273,44 @@ private:
   bool m_deviceIsSuitable(VkPhysicalDevice device);
 
   /**
-   * \fn void m_pickDevice()
-   * \brief Picks the most suitable physical device based on its rating.
+   * \fn bool m_supportsExtension(VkPhysicalDevice device, char const *name)
+   *
+   * \brief Checks if device supports the optional extension name.
+   *
+   * \param device The physical device to check.
+   * \param name The extension name.
+   *
+   * \return True if the extension is available.
    */
-  void m_pickDevice();
+  bool m_supportsExtension(VkPhysicalDevice device, char const *name);
 
   /**
-   * \fn void m_createLogicalDevice(VkAllocationCallbacks *pAllocator)
+   * \fn bool m_supportsCalibration(VkPhysicalDevice device)
    *
-   * \brief Creates the logical device.
+   * \brief Checks if device can calibrate its timestamps against
+   * CLOCK_MONOTONIC.
    *
-   * \param pAllocator The optional allocator to use for device creation.
+   * \param device The physical device to check.
+   *
+   * \return True if VK_EXT_calibrated_timestamps has both time domains.
    */
-  void m_createLogicalDevice(VkPhysicalDeviceFeatures2 *pNext = VK_NULL_HANDLE,
-                             VkAllocationCallbacks *pAllocator = nullptr);
+  bool m_supportsCalibration(VkPhysicalDevice device);
 
   /**
-   * \fn int m_rateDevice(VkPhysicalDevice device)
-   *
-   * \brief Rates the suitability of the specified physical device.
+   * \fn void m_pickDevice(selection::Policy const &policy)
+   * \brief Picks the suitable physical device policy rates highest.
+   */
+  void m_pickDevice(selection::Policy const &policy);
+
+  /**
+   * \fn void m_createLogicalDevice(VkAllocationCallbacks *pAllocator)
    *
-   * \param device The physical device to rate.
+   * \brief Creates the logical device.
    *
-   * \return The rating of the device.
+   * \param pAllocator The optional allocator to use for device creation.
    */
-  long int m_rateDevice(VkPhysicalDevice device);
+  void m_createLogicalDevice(VkPhysicalDeviceFeatures2 *pNext = VK_NULL_HANDLE,
+                             VkAllocationCallbacks *pAllocator = nullptr);
 };
 } // namespace device
 
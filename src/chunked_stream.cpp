@@ -0,0 +1,135 @@
+#include "chunked_stream.h"
+#include "vulkan_base/create_info.h"
+#include "vulkan_base/trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+ChunkedStream::ChunkedStream(
+    std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &commandBuffer,
+    SimpleComputePipeline &pipeline, size_t inputStride, size_t outputStride,
+    size_t chunkElements, size_t depth)
+    : m_deviceHandler(deviceHandler), m_pipeline(pipeline),
+      m_inputStride(inputStride), m_outputStride(outputStride),
+      m_chunkElements(chunkElements), m_stream(deviceHandler, commandBuffer,
+                                               depth) {
+    if (m_inputStride == 0 || m_outputStride == 0) {
+        throw std::runtime_error("Chunked elements need a size");
+    }
+    size_t const stride = std::max(m_inputStride, m_outputStride);
+    size_t const range =
+        deviceHandler->properties.limits.maxStorageBufferRange;
+    if (m_chunkElements == 0) {
+        m_chunkElements = std::max<size_t>(
+            std::min<size_t>(range, DEFAULT_CHUNK_BYTES) / stride, 1);
+    } else if (m_chunkElements * stride > range) {
+        throw std::runtime_error(
+            "A chunk of " + std::to_string(m_chunkElements) +
+            " elements exceeds maxStorageBufferRange of " +
+            std::to_string(range) + " bytes");
+    }
+
+    m_slots.resize(depth);
+    for (Slot &slot : m_slots) {
+        // The kernel reads the input from VRAM, the host reads the output
+        // from cached memory
+        slot.input = std::make_unique<buffer::Buffer>(
+            deviceHandler, commandBuffer,
+            VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            memory::Usage::GpuOnly, VK_SHARING_MODE_EXCLUSIVE,
+            m_chunkElements * m_inputStride);
+        slot.output = std::make_unique<buffer::Buffer>(
+            deviceHandler, commandBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            memory::Usage::Readback, VK_SHARING_MODE_EXCLUSIVE,
+            m_chunkElements * m_outputStride);
+        slot.output->map();
+    }
+}
+
+ChunkedStream::~ChunkedStream() { m_stream.waitAll(); }
+
+void ChunkedStream::run(void const *input, void *output, size_t count,
+                        void const *pConst, size_t pconst_size) {
+    tracing::Span span("chunked run", "compute");
+    auto const *src = static_cast<char const *>(input);
+    auto *dst = static_cast<char *>(output);
+
+    std::vector<char> constants(sizeof(ChunkPushConstants) + pconst_size);
+    if (pconst_size > 0) {
+        std::memcpy(constants.data() + sizeof(ChunkPushConstants), pConst,
+                    pconst_size);
+    }
+
+    uint32_t const maxGroups =
+        m_deviceHandler->properties.limits.maxComputeWorkGroupCount[0];
+
+    for (size_t base = 0; base < count; base += m_chunkElements) {
+        Slot &slot = m_slots[m_nextSlot];
+        m_nextSlot = (m_nextSlot + 1) % m_slots.size();
+
+        // Also keeps the upload from overwriting an input still being read
+        m_drain(slot);
+
+        size_t const n = std::min(m_chunkElements, count - base);
+        VkDeviceSize const inputBytes = n * m_inputStride;
+        VkDeviceSize const outputBytes = n * m_outputStride;
+        transfer::Token const uploaded =
+            slot.input->copyAsync(src + base * m_inputStride, inputBytes);
+
+        ChunkPushConstants const header{
+            static_cast<uint32_t>(base),
+            static_cast<uint32_t>(static_cast<uint64_t>(base) >> 32),
+            static_cast<uint32_t>(n), 0};
+        std::memcpy(constants.data(), &header, sizeof(header));
+
+        std::array<uint32_t, 3> groups =
+            m_pipeline.groupCount({static_cast<uint32_t>(n), 1, 1});
+        // The kernels loop over the chunk, so fewer groups also cover it
+        groups[0] = std::min(groups[0], maxGroups);
+
+        VkBuffer const result = slot.output->buffer;
+        slot.computed = m_stream.submit(
+            [&](VkCommandBuffer cmd) {
+                m_pipeline.record(cmd,
+                                  {{slot.input->buffer, 0, inputBytes},
+                                   {result, 0, outputBytes}},
+                                  constants.data(), constants.size(), groups);
+
+                VkBufferMemoryBarrier barrier =
+                    create_info::bufferMemoryBarrier();
+                barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+                barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+                barrier.buffer = result;
+                barrier.offset = 0;
+                barrier.size = outputBytes;
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                     VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr,
+                                     1, &barrier, 0, nullptr);
+            },
+            // The stream's lane may not be the queue the upload was
+            // acquired on
+            {{uploaded, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT}});
+        slot.output->markRead(slot.computed, 0, outputBytes);
+        slot.destination = dst + base * m_outputStride;
+        slot.count = n;
+    }
+
+    for (size_t i = 0; i < m_slots.size(); i++) {
+        m_drain(m_slots[(m_nextSlot + i) % m_slots.size()]);
+    }
+}
+
+void ChunkedStream::m_drain(Slot &slot) {
+    if (slot.count == 0) {
+        return;
+    }
+    // Also invalidates the output, which run() noted against the point
+    m_stream.wait(slot.computed);
+    std::memcpy(slot.destination, slot.output->mapped,
+                slot.count * m_outputStride);
+    slot.count = 0;
+}
@@ -0,0 +1,76 @@
+#include "compute_stream.h"
+#include "vulkan_base/create_info.h"
+#include "vulkan_base/trace.h"
+
+ComputeStream::ComputeStream(
+    std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &commandBuffer,
+    size_t depth)
+    : m_deviceHandler(deviceHandler), m_commandBuffer(commandBuffer),
+      m_scheduler(commandBuffer->getScheduler()),
+      m_lane(m_scheduler.acquire()) {
+    m_cmds.resize(depth);
+    m_points.resize(depth);
+    for (auto &cmd : m_cmds) {
+        cmd = m_commandBuffer->createCommandBuffer(
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+    }
+}
+
+ComputeStream::~ComputeStream() {
+    waitAll();
+    vkFreeCommandBuffers(*m_deviceHandler, m_commandBuffer->commandPool,
+                         static_cast<uint32_t>(m_cmds.size()), m_cmds.data());
+}
+
+scheduler::Point
+ComputeStream::submit(std::function<void(VkCommandBuffer)> const &record,
+                      std::vector<scheduler::Wait> const &waits) {
+    size_t const slot = m_nextSlot;
+    m_nextSlot = (m_nextSlot + 1) % m_cmds.size();
+    VkCommandBuffer cmd = m_cmds[slot];
+
+    // Only the submission made depth submissions ago can still hold the slot
+    m_scheduler.wait(m_points[slot]);
+    VK_CHECK(vkResetCommandBuffer(cmd, 0));
+
+    VkCommandBufferBeginInfo beginInfo = create_info::commandBufferBeginInfo();
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    {
+        tracing::Span span("record stream", "record");
+        VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+        profiling::Profiler &profiler = m_commandBuffer->getProfiler();
+        uint32_t const scope =
+            profiler.begin(cmd, "stream", profiling::Level::Batch);
+        record(cmd);
+        profiler.end(cmd, scope);
+        VK_CHECK(vkEndCommandBuffer(cmd));
+    }
+
+    m_points[slot] = m_scheduler.submit(m_lane, cmd, waits);
+    return m_points[slot];
+}
+
+scheduler::Point
+ComputeStream::dispatch(SimpleComputePipeline &pipeline,
+                        VkDescriptorSet const *descriptorSet,
+                        void const *pConst, size_t pconst_size,
+                        std::array<uint32_t, 3> const &disp_sizes) {
+    return submit([&](VkCommandBuffer cmd) {
+        pipeline.record(cmd, descriptorSet, pConst, pconst_size, disp_sizes);
+    });
+}
+
+void ComputeStream::wait(scheduler::Point const &point) const {
+    m_scheduler.wait(point);
+}
+
+bool ComputeStream::poll(scheduler::Point const &point) const {
+    return m_scheduler.poll(point);
+}
+
+void ComputeStream::waitAll() const {
+    for (scheduler::Point const &point : m_points) {
+        m_scheduler.wait(point);
+    }
+}
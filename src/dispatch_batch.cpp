@@ -0,0 +1,208 @@
+#include "dispatch_batch.h"
+#include "vulkan_base/create_info.h"
+#include "vulkan_base/trace.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+VkDeviceSize rangeEnd(BufferAccess const &access) {
+    if (access.size == VK_WHOLE_SIZE) {
+        return std::numeric_limits<VkDeviceSize>::max();
+    }
+    return access.offset + access.size;
+}
+} // namespace
+
+DispatchBatch::DispatchBatch(
+    std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &commandBuffer)
+    : m_deviceHandler(deviceHandler), m_commandBuffer(commandBuffer),
+      m_scheduler(commandBuffer->getScheduler()) {}
+
+DispatchBatch::~DispatchBatch() {
+    if (m_cmd != VK_NULL_HANDLE) {
+        // The open batch is dropped; its scope would otherwise stay taken
+        m_commandBuffer->getProfiler().discard(m_scope);
+        VK_CHECK(vkEndCommandBuffer(m_cmd));
+        m_free.push_back(m_cmd);
+    }
+    for (auto const &[point, cmd] : m_pending) {
+        m_scheduler.wait(point);
+        m_free.push_back(cmd);
+    }
+    if (!m_free.empty()) {
+        vkFreeCommandBuffers(*m_deviceHandler, m_commandBuffer->commandPool,
+                             static_cast<uint32_t>(m_free.size()),
+                             m_free.data());
+    }
+}
+
+void DispatchBatch::m_begin() {
+    if (m_cmd != VK_NULL_HANDLE) {
+        return;
+    }
+
+    while (!m_pending.empty() && m_scheduler.poll(m_pending.front().first)) {
+        m_free.push_back(m_pending.front().second);
+        m_pending.pop_front();
+    }
+
+    if (m_free.empty()) {
+        m_cmd = m_commandBuffer->createCommandBuffer(
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+    } else {
+        m_cmd = m_free.back();
+        m_free.pop_back();
+        VK_CHECK(vkResetCommandBuffer(m_cmd, 0));
+    }
+
+    VkCommandBufferBeginInfo beginInfo = create_info::commandBufferBeginInfo();
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(m_cmd, &beginInfo));
+
+    // Submission order alone does not make the writes of earlier
+    // submissions to the queue visible to this one.
+    VkMemoryBarrier queueBarrier = create_info::memoryBarrier();
+    queueBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    queueBarrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(m_cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &queueBarrier, 0, nullptr, 0, nullptr);
+
+    m_scope = m_commandBuffer->getProfiler().begin(m_cmd, "batch",
+                                                   profiling::Level::Batch);
+}
+
+void DispatchBatch::m_barrier(std::vector<BufferAccess> const &accesses) {
+    std::vector<VkBufferMemoryBarrier> barriers;
+    bool hazard = false;
+
+    for (BufferAccess const &access : accesses) {
+        auto used = m_used.find(access.buffer);
+        if (used == m_used.end()) {
+            continue;
+        }
+
+        bool const reads = access.access != Access::Write;
+        bool const writes = access.access != Access::Read;
+        bool readAfterWrite = false;
+        bool afterAccess = false;
+        for (Range const &range : used->second) {
+            if (range.begin >= rangeEnd(access) || access.offset >= range.end) {
+                continue;
+            }
+            readAfterWrite |= reads && range.written;
+            afterAccess |= writes;
+        }
+        if (!readAfterWrite && !afterAccess) {
+            continue;
+        }
+        hazard = true;
+
+        // Write-after-read only needs the execution dependency, the rest
+        // also needs the earlier writes made visible.
+        bool const written = std::any_of(
+            used->second.begin(), used->second.end(),
+            [](Range const &range) { return range.written; });
+        if (!written) {
+            continue;
+        }
+
+        VkBufferMemoryBarrier barrier = create_info::bufferMemoryBarrier();
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask =
+            VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.buffer = access.buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+        if (std::none_of(barriers.begin(), barriers.end(),
+                         [&](VkBufferMemoryBarrier const &other) {
+                             return other.buffer == access.buffer;
+                         })) {
+            barriers.push_back(barrier);
+        }
+    }
+
+    if (!hazard) {
+        return;
+    }
+
+    vkCmdPipelineBarrier(m_cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()),
+                         barriers.data(), 0, nullptr);
+    m_barriers++;
+
+    // Every earlier dispatch now executes before the next one, so only the
+    // writes to buffers left out of the barrier are still pending.
+    for (auto used = m_used.begin(); used != m_used.end();) {
+        bool const covered =
+            std::any_of(barriers.begin(), barriers.end(),
+                        [&](VkBufferMemoryBarrier const &barrier) {
+                            return barrier.buffer == used->first;
+                        });
+        auto &ranges = used->second;
+        if (covered) {
+            ranges.clear();
+        } else {
+            ranges.erase(std::remove_if(ranges.begin(), ranges.end(),
+                                        [](Range const &range) {
+                                            return !range.written;
+                                        }),
+                         ranges.end());
+        }
+        used = ranges.empty() ? m_used.erase(used) : std::next(used);
+    }
+}
+
+DispatchBatch &DispatchBatch::add(SimpleComputePipeline &pipeline,
+                                  VkDescriptorSet const *descriptorSet,
+                                  void const *pConst, size_t pconst_size,
+                                  std::array<uint32_t, 3> const &disp_sizes,
+                                  std::vector<BufferAccess> const &accesses) {
+    tracing::Span span("record dispatch", "record");
+    m_begin();
+    m_barrier(accesses);
+
+    pipeline.record(m_cmd, descriptorSet, pConst, pconst_size, disp_sizes);
+    m_dispatches++;
+
+    for (BufferAccess const &access : accesses) {
+        m_used[access.buffer].push_back(
+            {access.offset, rangeEnd(access), access.access != Access::Read});
+    }
+    return *this;
+}
+
+scheduler::Point
+DispatchBatch::submit(std::vector<scheduler::Wait> const &waits) {
+    if (m_cmd == VK_NULL_HANDLE) {
+        return {};
+    }
+
+    m_commandBuffer->getProfiler().end(m_cmd, m_scope);
+
+    VkMemoryBarrier hostBarrier = create_info::memoryBarrier();
+    hostBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(m_cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0,
+                         nullptr, 0, nullptr);
+    VK_CHECK(vkEndCommandBuffer(m_cmd));
+
+    scheduler::Point const point =
+        m_scheduler.submit(scheduler::QueueType::Compute, m_cmd, waits);
+    m_pending.emplace_back(point, m_cmd);
+
+    m_cmd = VK_NULL_HANDLE;
+    m_used.clear();
+    m_dispatches = 0;
+    m_barriers = 0;
+    return point;
+}
+
+void DispatchBatch::wait(scheduler::Point const &point) const {
+    m_scheduler.wait(point);
+}
@@ -0,0 +1,138 @@
+#include "integrator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+Integrator::Integrator(
+    std::string const &shader, QuadratureRule rule, std::string const &reduce,
+    std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &commandBuffer,
+    std::array<uint32_t, 3> const &grid, VkPipelineCache pipelineCache,
+    tuning::Config const &workgroup)
+    : m_deviceHandler(deviceHandler), m_commandBuffer(commandBuffer),
+      m_grid(grid), m_order(ruleOrder(rule)) {
+    m_pipeline = std::make_unique<SimpleComputePipeline>(
+        shader, m_deviceHandler, pipelineCache, DescriptorMode::Sets,
+        workgroup);
+
+    // The grid is rounded up to whole workgroups; the extra cells are past
+    // every active range, so they write zeros the reduction can sum
+    m_groups = m_pipeline->groupCount(m_grid);
+    std::array<uint32_t, 3> const &localSize =
+        m_pipeline->reflection().localSize;
+    uint32_t const cells =
+        m_groups[0] * localSize[0] * m_groups[1] * localSize[1];
+
+    m_results = std::make_unique<buffer::Buffer>(
+        m_deviceHandler, m_commandBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        memory::Usage::GpuOnly, VK_SHARING_MODE_EXCLUSIVE,
+        sizeof(double) * cells);
+
+    // One set for the integrand and two for the reduction, all binding two
+    // storage buffers, fit in the first pool
+    m_descriptors = std::make_unique<descriptor::Allocator>(
+        m_deviceHandler,
+        std::vector<descriptor::PoolRatio>{
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2.0F}},
+        3);
+    m_reduction = std::make_unique<Reduction>(
+        reduce, m_deviceHandler, m_commandBuffer, m_results->buffer,
+        m_results->size, *m_descriptors, pipelineCache);
+
+    // Every round reads the previous result back, so one slot is enough
+    m_dispatch = std::make_unique<RecordedDispatch>(
+        m_deviceHandler, m_commandBuffer, sizeof(IntegralParams), 1);
+
+    m_descriptorSet = m_descriptors->get(
+        *m_pipeline->descriptorSetLayout(), m_pipeline->reflection().set(0),
+        {
+            {m_results->buffer, 0, m_results->size},
+            m_dispatch->paramsInfo(0),
+        });
+
+    // The whole grid is dispatched every round; cells past active only
+    // write zeros, so the reduction always sums all of them.
+    m_dispatch->record([this, cells](VkCommandBuffer cmd, size_t) {
+        m_pipeline->record(cmd, &m_descriptorSet, nullptr, 0, m_groups);
+        m_reduction->record(cmd, cells);
+    });
+}
+
+Integrator::~Integrator() {
+    m_dispatch.reset();
+    m_pipeline.reset();
+}
+
+double Integrator::m_evaluate(IntegralPushContant const &pConst) {
+    // The shader splits the steps of each axis between the active cells, so
+    // more cells than steps would only leave some of them empty.
+    IntegralParams params{};
+    params.bounds = pConst;
+    params.active = {
+        std::min(m_grid[0], static_cast<uint32_t>(pConst.splits_x)),
+        std::min(m_grid[1], static_cast<uint32_t>(pConst.splits_y)),
+    };
+
+    m_dispatch->wait(m_dispatch->replay(&params));
+
+    double const sum = m_reduction->result();
+
+    double const step_x = (pConst.end_x - pConst.start_x) / pConst.splits_x;
+    double const step_y = (pConst.end_y - pConst.start_y) / pConst.splits_y;
+    return sum * step_x * step_y;
+}
+
+double Integrator::benchmark(IntegralPushContant const &pConst,
+                             size_t rounds) {
+    // The first round pays for whatever the driver defers to the first use
+    m_evaluate(pConst);
+
+    auto const start = std::chrono::steady_clock::now();
+    for (size_t round = 0; round < rounds; round++) {
+        m_evaluate(pConst);
+    }
+    return std::chrono::duration<double, std::nano>(
+               std::chrono::steady_clock::now() - start)
+               .count() /
+           static_cast<double>(std::max<size_t>(rounds, 1));
+}
+
+IntegrationResult
+Integrator::integrate(IntegralPushContant bounds,
+                      std::unordered_map<std::string, double> const &config) {
+    double const abs_err = config.at("abs_err");
+    double const rel_err = config.at("rel_err");
+    auto const max_iter = static_cast<size_t>(config.at("max_iter"));
+
+    bounds.splits_x = config.at("init_steps_x");
+    bounds.splits_y = config.at("init_steps_y");
+
+    IntegrationResult result{};
+    result.value = m_evaluate(bounds);
+
+    while (result.iterations < max_iter) {
+        bounds.splits_x *= 2;
+        bounds.splits_y *= 2;
+        result.iterations++;
+
+        double const previous = result.value;
+        result.value = m_evaluate(bounds);
+
+        // Runge rule: halving the step of a rule of order p shrinks its
+        // error by 2^p, so the finer estimate is off by the difference
+        // over 2^p - 1.
+        result.abs_err = std::abs(result.value - previous) /
+                         static_cast<double>((1U << m_order) - 1);
+        result.rel_err = result.value != 0.0
+                             ? result.abs_err / std::abs(result.value)
+                             : result.abs_err;
+
+        if (result.abs_err <= abs_err && result.rel_err <= rel_err) {
+            result.converged = true;
+            break;
+        }
+    }
+
+    return result;
+}
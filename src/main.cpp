@@ -1,42 +1,124 @@
+#include "chunked_stream.h"
 #include "exceptions.h"
+#include "integrator.h"
 #include "parse_file.h"
+#include "shader_variants.h"
 #include "simple_compute_pipeline.h"
 #include "sync_objects.h"
+#include "vulkan_base/autotune.h"
 #include "vulkan_base/buffer.h"
 #include "vulkan_base/command_buffer.h"
-#include "vulkan_base/descriptor_set_manip.h"
+#include "vulkan_base/device_selection.h"
+#include "vulkan_base/pipeline_cache.h"
+#include "vulkan_base/trace.h"
 #include "vulkan_base/sync_objects.h"
 #include "vulkan_base/vk_device.h"
 #include "vulkan_base/vk_instance.h"
 
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
 #include <memory>
 #include <vulkan/vulkan_core.h>
 
-int main() {
-    std::vector<const char *> validation_layers = {
-        "VK_LAYER_KHRONOS_validation",
-    };
-    std::vector<const char *> devExt = {
-        VK_KHR_SHADER_NON_SEMANTIC_INFO_EXTENSION_NAME,
-        // VK_KHR_SPIRV_1_4_EXTENSION_NAME,
-        // VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME,
-        // VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
-    };
+namespace {
+constexpr char const *PIPELINE_CACHE_FILE = "pipeline_cache.bin";
+constexpr char const *PROFILE_ENV =
+    "INTEGRATE_PROFILE"; /**< off, batch or dispatch; prints GPU times */
+constexpr char const *TRACE_ENV =
+    "INTEGRATE_TRACE"; /**< Path to write a Chrome trace of the run to */
+constexpr char const *TUNE_ENV =
+    "INTEGRATE_TUNE"; /**< Set to tune kernels the database has no entry for */
+constexpr char const *DEVICE_ENV =
+    "INTEGRATE_DEVICE"; /**< UUID or part of the name of the device to use */
+constexpr char const *ACCUMULATE_ENV =
+    "INTEGRATE_ACCUMULATE"; /**< fp64 or fp32 to force the precision */
+constexpr char const *CHUNK_ENV =
+    "INTEGRATE_CHUNK"; /**< Elements per chunk to stream the demo in, or 0 */
+constexpr char const *SHADER_DIR_ENV =
+    "INTEGRATE_SHADER_DIR"; /**< .spv files here replace the embedded ones */
+constexpr char const *CACHE_DIR_ENV =
+    "INTEGRATE_CACHE_DIR"; /**< Where the caches go instead of next to the
+                              executable */
+constexpr char const *TUNING_DB_FILE = "tuning.txt";
+constexpr size_t TUNE_ROUNDS = 3; /**< Evaluations timed per candidate */
+
+// The directory of the pipeline cache and the tuning database, created if
+// it is missing: CACHE_DIR_ENV if set, otherwise the directory of the
+// executable, so the caches are found from any working directory
+std::filesystem::path cacheDirectory(char const *argv0) {
+    std::filesystem::path dir;
+    if (char const *configured = std::getenv(CACHE_DIR_ENV)) {
+        dir = configured;
+    } else {
+        std::error_code err;
+        dir = std::filesystem::read_symlink("/proc/self/exe", err);
+        if (err) {
+            dir = std::filesystem::absolute(argv0);
+        }
+        dir = dir.parent_path();
+    }
+    std::filesystem::create_directories(dir);
+    return dir;
+}
+
+int runChunkedDemo(
+    std::shared_ptr<device::DeviceHandler> const &device,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &cmd_buf,
+    VkPipelineCache pipelineCache, size_t chunk) {
+    const int n_vals = 10'000'000;
+
+    // The array stays on the host and only depth chunks of it are on the
+    // device at a time
+    std::vector<int> vals(n_vals);
+    for (int i = 0; i < n_vals; i++) {
+        vals[i] = i;
+    }
+    std::vector<int> mismatches(n_vals);
+
+    // Every chunk binds other buffers, so they are pushed
+    auto pipeline = SimpleComputePipeline(
+        "compute.comp.chunked.spv", device, pipelineCache,
+        DescriptorMode::Push);
+    ChunkedStream stream(device, cmd_buf, pipeline, sizeof(int), sizeof(int),
+                         chunk);
+    stream.run(vals.data(), mismatches.data(), vals.size());
+
+    std::cout << "Streamed " << n_vals << " values in chunks of "
+              << stream.chunkElements() << ", "
+              << std::count(mismatches.begin(), mismatches.end(), 1)
+              << " out of place\n";
+
+    return No_Exception;
+}
+
+int runDemo(std::shared_ptr<device::DeviceHandler> const &device,
+            std::shared_ptr<command_buffer::CommandBufferHandler> const
+                &cmd_buf,
+            VkPipelineCache pipelineCache) {
+    if (char const *chunk = std::getenv(CHUNK_ENV)) {
+        return runChunkedDemo(device, cmd_buf, pipelineCache,
+                              std::strtoull(chunk, nullptr, 10));
+    }
 
     const int n_vals = 10'000'000;
-    auto instance = std::make_unique<vk_instance::Instance>();
-    auto device = std::make_shared<device::DeviceHandler>(
-        devExt, validation_layers, *instance, nullptr);
-    auto cmd_buf =
-        std::make_shared<command_buffer::CommandBufferHandler>(device);
     auto sync_objs = std::make_shared<SyncObjects>(device, 1);
 
     std::array<uint32_t, 3> sizes = {100, 100, 100};
 
+    // With device addresses the kernel gets a pointer to the input in its
+    // push constants and needs no descriptors at all
+    bool const addressed = device->bufferDeviceAddress;
+    VkBufferUsageFlags const usage =
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+        (addressed ? VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT : 0);
+
+    // Written once by the host and read by the kernel, so it lives in VRAM
+    // when the device has resizable BAR
     auto buf = std::make_shared<buffer::Buffer>(
-        device, cmd_buf, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
-        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        device, cmd_buf, usage, memory::Usage::Upload,
         VK_SHARING_MODE_EXCLUSIVE, sizeof(int) * n_vals);
     buf->map();
     int *vals = reinterpret_cast<int *>(buf->mapped);
@@ -48,28 +130,180 @@ int main() {
             vals[9'999'999 - (i / 2)] = 9'999'999 - (i / 2);
         }
     }
+    buf->markWritten();
 
-    VkDescriptorSetLayout layout{};
-    createLayout(*device, &layout);
+    VkCommandBuffer cbuf =
+        cmd_buf->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, VK_FALSE);
 
-    VkDescriptorPool pool{};
-    createDescriptorPool(*device, &pool);
+    if (addressed) {
+        struct {
+            int32_t n_vals;
+            VkDeviceAddress vals;
+        } const pConst{n_vals, buf->address};
 
-    VkDescriptorSet descriptorSet{};
-    createDescriptorSet(*device, &layout, pool, descriptorSet, &buf->buffer,
-                        sizes.data());
+        auto pipeline = SimpleComputePipeline("compute.comp.address.spv",
+                                              device, pipelineCache);
+        pipeline.dispatch_s(cbuf, nullptr, *sync_objs, 0, &pConst,
+                            sizeof(pConst), sizes);
+    } else {
+        // A one-shot dispatch, so its buffer is pushed rather than written
+        // into a set allocated for it
+        auto pipeline = SimpleComputePipeline(
+            "compute.comp.spv", device, pipelineCache, DescriptorMode::Push);
+        pipeline.dispatch_s(cbuf, {{buf->buffer, 0, buf->size}}, *sync_objs,
+                            0, &n_vals, sizeof(n_vals), sizes);
+    }
 
-    std::string path = "./build/shaders/compute.comp.spv";
-    auto pipeline = SimpleComputePipeline(path, device, &layout);
+    vkFreeCommandBuffers(*device, cmd_buf->commandPool, 1, &cbuf);
 
-    VkCommandBuffer cbuf =
-        cmd_buf->createCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, VK_FALSE);
+    return No_Exception;
+}
 
-    pipeline.dispatch_s(cbuf, &descriptorSet, *sync_objs, 0, &n_vals,
-                        sizeof(n_vals), sizes);
+int runIntegration(
+    std::shared_ptr<device::DeviceHandler> const &device,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &cmd_buf,
+    VkPipelineCache pipelineCache, int func, std::string const &config_path,
+    std::filesystem::path const &cache_dir) {
+    auto config = process_config(config_path);
+    for (auto const *key : {"x_start", "x_end", "y_start", "y_end"}) {
+        if (!config.contains(key)) {
+            std::cerr << "Missing required parameter " << key << "\n";
+            return Missing_Required_Parameter;
+        }
+    }
 
-    vkFreeCommandBuffers(*device, cmd_buf->commandPool, 1, &cbuf);
-    cleanupDescriptors(*device, layout, pool);
+    IntegralPushContant bounds{};
+    bounds.start_x = config["x_start"];
+    bounds.end_x = config["x_end"];
+    bounds.start_y = config["y_start"];
+    bounds.end_y = config["y_end"];
 
-    return 0;
+    std::string const reduce = "reduce.comp.spv";
+
+    // The build has every integrand for every rule and precision; the
+    // precision is left to the device unless it is forced
+    QuadratureRule const rule = config.contains("rule") && config["rule"] == 1
+                                    ? QuadratureRule::Midpoint
+                                    : QuadratureRule::Rectangle;
+    std::optional<Accumulation> accumulation;
+    if (char const *forced = std::getenv(ACCUMULATE_ENV)) {
+        accumulation = std::string(forced) == "fp32" ? Accumulation::Fp32
+                                                     : Accumulation::Fp64;
+    }
+    std::vector<ShaderVariant> const variants =
+        variantsOf(static_cast<uint32_t>(func), rule, accumulation);
+
+    // The tuned variant and workgroup of the device, found by timing one
+    // estimate at the initial step with every candidate
+    tuning::Database tuning_db((cache_dir / TUNING_DB_FILE).string());
+    bool const tuned = std::any_of(
+        variants.begin(), variants.end(), [&](ShaderVariant const &variant) {
+            return tuning_db.find(*device, variant.name).has_value();
+        });
+    VariantChoice choice = selectVariant(*device, tuning_db, variants);
+    if (!tuned && std::getenv(TUNE_ENV) != nullptr) {
+        IntegralPushContant sample = bounds;
+        sample.splits_x = config.at("init_steps_x");
+        sample.splits_y = config.at("init_steps_y");
+        choice = tuneVariant(
+            *device, tuning_db, variants,
+            [&](ShaderVariant const &variant,
+                tuning::Config const &candidate) {
+                Integrator candidate_integrator(
+                    variant.name, variant.rule, reduce, device, cmd_buf,
+                    DEFAULT_INTEGRATION_GRID, pipelineCache, candidate);
+                return candidate_integrator.benchmark(sample, TUNE_ROUNDS);
+            });
+        tuning_db.save();
+    }
+
+    Integrator integrator(choice.variant.name, choice.variant.rule, reduce,
+                          device, cmd_buf, DEFAULT_INTEGRATION_GRID,
+                          pipelineCache, choice.workgroup);
+
+    profiling::Profiler &profiler = cmd_buf->getProfiler();
+    char const *profile = std::getenv(PROFILE_ENV);
+    if (profile != nullptr) {
+        std::string const mode = profile;
+        profiler.setMode(mode == "off"        ? profiling::Mode::Off
+                         : mode == "dispatch" ? profiling::Mode::Dispatches
+                                              : profiling::Mode::Batches);
+    }
+
+    auto start = std::chrono::high_resolution_clock::now();
+    IntegrationResult result = integrator.integrate(bounds, config);
+    auto end = std::chrono::high_resolution_clock::now();
+
+    std::cout << std::setprecision(15) << result.value << "\n"
+              << result.abs_err << "\n"
+              << result.rel_err << "\n"
+              << std::chrono::duration_cast<std::chrono::microseconds>(end -
+                                                                       start)
+                     .count()
+              << "\n";
+
+    if (profile != nullptr) {
+        profiler.report(std::cerr);
+    }
+
+    return result.converged ? No_Exception : Unable_To_Reach_Desired_Accuracy;
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+    if (argc != 1 && argc != 3) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [<function number> <config file>]\n";
+        return Invalid_Number_Of_Arguments;
+    }
+
+    int func = 0;
+    if (argc == 3) {
+        func = std::atoi(argv[1]);
+        if (func < 1 || func > 3) {
+            std::cerr << "No such function: " << argv[1] << "\n";
+            return No_Such_Function;
+        }
+    }
+
+    char const *trace_path = std::getenv(TRACE_ENV);
+    tracing::Tracer::instance().setEnabled(trace_path != nullptr);
+
+    std::vector<const char *> validation_layers = {
+        "VK_LAYER_KHRONOS_validation",
+    };
+    std::vector<const char *> devExt = {
+        VK_KHR_SHADER_NON_SEMANTIC_INFO_EXTENSION_NAME,
+        // VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+        // VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME,
+        // VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME,
+    };
+
+    char const *pinned_device = std::getenv(DEVICE_ENV);
+    selection::Policy const policy =
+        pinned_device != nullptr ? selection::pinned(pinned_device)
+                                 : selection::computeScore;
+
+    auto instance = std::make_unique<vk_instance::Instance>();
+    auto device = std::make_shared<device::DeviceHandler>(
+        devExt, validation_layers, *instance, nullptr, policy);
+    if (char const *shader_dir = std::getenv(SHADER_DIR_ENV)) {
+        device->shaderRegistry->setOverrideDirectory(shader_dir);
+    }
+    auto cmd_buf =
+        std::make_shared<command_buffer::CommandBufferHandler>(device);
+    std::filesystem::path const cache_dir = cacheDirectory(argv[0]);
+    auto pipeline_cache = std::make_unique<pipeline_cache::PipelineCache>(
+        device, (cache_dir / PIPELINE_CACHE_FILE).string());
+
+    int const status =
+        argc == 1 ? runDemo(device, cmd_buf, *pipeline_cache)
+                  : runIntegration(device, cmd_buf, *pipeline_cache, func,
+                                   argv[2], cache_dir);
+
+    if (trace_path != nullptr) {
+        cmd_buf->getProfiler().collect();
+        tracing::Tracer::instance().write(trace_path);
+    }
+    return status;
 }
@@ -0,0 +1,119 @@
+#include "recorded_dispatch.h"
+#include "vulkan_base/create_info.h"
+#include "vulkan_base/trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+RecordedDispatch::RecordedDispatch(
+    std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &commandBuffer,
+    VkDeviceSize paramsSize, size_t depth)
+    : m_deviceHandler(deviceHandler), m_commandBuffer(commandBuffer),
+      m_scheduler(commandBuffer->getScheduler()),
+      m_lane(m_scheduler.acquire()), m_paramsSize(paramsSize) {
+    VkDeviceSize const alignment = std::max<VkDeviceSize>(
+        m_deviceHandler->properties.limits.minStorageBufferOffsetAlignment, 1);
+    m_stride = (m_paramsSize + alignment - 1) / alignment * alignment;
+
+    m_params = std::make_unique<buffer::Buffer>(
+        m_deviceHandler, m_commandBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        memory::Usage::Upload, VK_SHARING_MODE_EXCLUSIVE, m_stride * depth);
+    m_params->map();
+
+    m_cmds.resize(depth);
+    m_stamps.resize(depth);
+    m_points.resize(depth);
+    for (auto &cmd : m_cmds) {
+        cmd = m_commandBuffer->createCommandBuffer(
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+    }
+    for (auto &stamps : m_stamps) {
+        for (auto &cmd : stamps) {
+            cmd = m_commandBuffer->createCommandBuffer(
+                VK_COMMAND_BUFFER_LEVEL_PRIMARY, false);
+        }
+    }
+}
+
+RecordedDispatch::~RecordedDispatch() {
+    waitAll();
+    vkFreeCommandBuffers(*m_deviceHandler, m_commandBuffer->commandPool,
+                         static_cast<uint32_t>(m_cmds.size()), m_cmds.data());
+    for (auto &stamps : m_stamps) {
+        vkFreeCommandBuffers(*m_deviceHandler, m_commandBuffer->commandPool,
+                             static_cast<uint32_t>(stamps.size()),
+                             stamps.data());
+    }
+}
+
+VkDescriptorBufferInfo RecordedDispatch::paramsInfo(size_t slot) const {
+    return {m_params->buffer, m_stride * slot, m_paramsSize};
+}
+
+void RecordedDispatch::record(
+    std::function<void(VkCommandBuffer, size_t)> const &record) {
+    waitAll();
+    tracing::Span span("record replay", "record");
+
+    // No ONE_TIME_SUBMIT: the buffers are submitted again on every replay
+    VkCommandBufferBeginInfo beginInfo = create_info::commandBufferBeginInfo();
+    for (size_t slot = 0; slot < m_cmds.size(); slot++) {
+        VK_CHECK(vkResetCommandBuffer(m_cmds[slot], 0));
+        VK_CHECK(vkBeginCommandBuffer(m_cmds[slot], &beginInfo));
+        record(m_cmds[slot], slot);
+        VK_CHECK(vkEndCommandBuffer(m_cmds[slot]));
+    }
+    m_recorded = true;
+}
+
+scheduler::Point RecordedDispatch::replay(void const *params) {
+    if (!m_recorded) {
+        throw std::runtime_error("replaying a dispatch that was not recorded");
+    }
+
+    size_t const slot = m_nextSlot;
+    m_nextSlot = (m_nextSlot + 1) % m_cmds.size();
+
+    // The previous replay of the slot may still be reading its params
+    m_scheduler.wait(m_points[slot]);
+    std::memcpy(static_cast<char *>(m_params->mapped) + m_stride * slot,
+                params, m_paramsSize);
+    m_params->markWritten(m_stride * slot, m_paramsSize);
+
+    profiling::Profiler &profiler = m_commandBuffer->getProfiler();
+    if (!profiler.enabled(profiling::Level::Batch)) {
+        m_points[slot] = m_scheduler.submit(m_lane, m_cmds[slot]);
+        return m_points[slot];
+    }
+
+    auto &[before, after] = m_stamps[slot];
+    VkCommandBufferBeginInfo beginInfo = create_info::commandBufferBeginInfo();
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    VK_CHECK(vkResetCommandBuffer(before, 0));
+    VK_CHECK(vkBeginCommandBuffer(before, &beginInfo));
+    uint32_t const scope =
+        profiler.begin(before, "replay", profiling::Level::Batch);
+    VK_CHECK(vkEndCommandBuffer(before));
+
+    VK_CHECK(vkResetCommandBuffer(after, 0));
+    VK_CHECK(vkBeginCommandBuffer(after, &beginInfo));
+    profiler.end(after, scope);
+    VK_CHECK(vkEndCommandBuffer(after));
+
+    m_points[slot] =
+        m_scheduler.submit(m_lane, {before, m_cmds[slot], after});
+    return m_points[slot];
+}
+
+void RecordedDispatch::wait(scheduler::Point const &point) const {
+    m_scheduler.wait(point);
+}
+
+void RecordedDispatch::waitAll() const {
+    for (scheduler::Point const &point : m_points) {
+        m_scheduler.wait(point);
+    }
+}
@@ -0,0 +1,87 @@
+#include "reduction.h"
+#include "vulkan_base/create_info.h"
+
+#include <algorithm>
+
+namespace {
+std::string treeVariant(std::string const &shader) {
+    std::string const suffix = ".spv";
+    if (shader.ends_with(suffix)) {
+        return shader.substr(0, shader.size() - suffix.size()) + ".tree" +
+               suffix;
+    }
+    return shader + ".tree";
+}
+
+void computeBarrier(VkCommandBuffer buf, VkBuffer buffer,
+                    VkAccessFlags dstAccess, VkPipelineStageFlags dstStage) {
+    VkBufferMemoryBarrier barrier = create_info::bufferMemoryBarrier();
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = dstAccess;
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    vkCmdPipelineBarrier(buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, dstStage, 0,
+                         0, nullptr, 1, &barrier, 0, nullptr);
+}
+} // namespace
+
+Reduction::Reduction(
+    std::string const &shader,
+    std::shared_ptr<device::DeviceHandler> const &deviceHandler,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &commandBuffer,
+    VkBuffer input, VkDeviceSize inputRange,
+    descriptor::Allocator &descriptors, VkPipelineCache pipelineCache)
+    : m_deviceHandler(deviceHandler) {
+    m_partials = std::make_unique<buffer::Buffer>(
+        m_deviceHandler, commandBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        memory::Usage::GpuOnly, VK_SHARING_MODE_EXCLUSIVE,
+        sizeof(double) * REDUCE_MAX_WORKGROUPS);
+    m_result = std::make_unique<buffer::Buffer>(
+        m_deviceHandler, commandBuffer, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        memory::Usage::Readback, VK_SHARING_MODE_EXCLUSIVE, sizeof(double));
+    m_result->map();
+
+    m_pipeline = std::make_unique<SimpleComputePipeline>(
+        m_deviceHandler->subgroupArithmetic ? shader : treeVariant(shader),
+        m_deviceHandler, pipelineCache);
+
+    std::vector<reflection::Binding> const bindings =
+        m_pipeline->reflection().set(0);
+    VkDescriptorSetLayout const layout = *m_pipeline->descriptorSetLayout();
+    VkDescriptorBufferInfo const partials{m_partials->buffer, 0,
+                                          m_partials->size};
+    VkDescriptorBufferInfo const result{m_result->buffer, 0, m_result->size};
+    m_firstPass =
+        descriptors.get(layout, bindings, {{input, 0, inputRange}, partials});
+    m_secondPass = descriptors.get(layout, bindings, {partials, result});
+}
+
+Reduction::~Reduction() { m_pipeline.reset(); }
+
+void Reduction::record(VkCommandBuffer buf, uint32_t count) {
+    uint32_t const groups = std::clamp<uint32_t>(
+        m_pipeline->groupCount({count, 1, 1})[0], 1, REDUCE_MAX_WORKGROUPS);
+
+    VkMemoryBarrier inputBarrier = create_info::memoryBarrier();
+    inputBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    inputBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(buf, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1,
+                         &inputBarrier, 0, nullptr, 0, nullptr);
+
+    m_pipeline->record(buf, &m_firstPass, &count, sizeof(count),
+                       {groups, 1, 1});
+    computeBarrier(buf, m_partials->buffer, VK_ACCESS_SHADER_READ_BIT,
+                   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    m_pipeline->record(buf, &m_secondPass, &groups, sizeof(groups),
+                       {1, 1, 1});
+    computeBarrier(buf, m_result->buffer, VK_ACCESS_HOST_READ_BIT,
+                   VK_PIPELINE_STAGE_HOST_BIT);
+}
+
+double Reduction::result() const {
+    m_result->invalidate(sizeof(double));
+    return *static_cast<double const *>(m_result->mapped);
+}
@@ -0,0 +1,96 @@
+#include "shader_variants.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace {
+tuning::Config tileConfig() {
+    tuning::Config config;
+    config.localSize = {DEFAULT_TILE[0], DEFAULT_TILE[1], 1};
+    return config;
+}
+} // namespace
+
+std::vector<ShaderVariant>
+variantsOf(uint32_t integrand, QuadratureRule rule,
+           std::optional<Accumulation> accumulation) {
+    std::vector<ShaderVariant> variants;
+    for (Accumulation const precision :
+         {Accumulation::Fp64, Accumulation::Fp32}) {
+        if (accumulation.has_value() && *accumulation != precision) {
+            continue;
+        }
+        for (ShaderVariant const &variant : shaderVariants()) {
+            if (variant.integrand == integrand && variant.rule == rule &&
+                variant.accumulation == precision) {
+                variants.push_back(variant);
+            }
+        }
+    }
+    return variants;
+}
+
+VariantChoice selectVariant(device::DeviceHandler const &device,
+                            tuning::Database const &db,
+                            std::vector<ShaderVariant> const &candidates) {
+    if (device.enabledFeatures.shaderFloat64 != VK_TRUE) {
+        throw std::runtime_error(
+            "The integrands store their cell sums as doubles, which the "
+            "device does not support");
+    }
+
+    for (ShaderVariant const &variant : candidates) {
+        std::optional<tuning::Config> const tuned =
+            db.find(device, variant.name);
+        if (tuned.has_value()) {
+            return {variant, *tuned};
+        }
+    }
+
+    if (candidates.empty()) {
+        throw std::runtime_error("No integrand variant to select from");
+    }
+    return {candidates.front(), tileConfig()};
+}
+
+VariantChoice
+tuneVariant(device::DeviceHandler const &device, tuning::Database &db,
+            std::vector<ShaderVariant> const &candidates,
+            std::function<double(ShaderVariant const &,
+                                 tuning::Config const &)> const &measure) {
+    std::optional<VariantChoice> fp64;
+    std::optional<VariantChoice> fp32;
+    double fp64Time = 0.0;
+    double fp32Time = 0.0;
+
+    for (ShaderVariant const &variant : candidates) {
+        bool const doubles = variant.accumulation == Accumulation::Fp64;
+        std::optional<VariantChoice> &choice = doubles ? fp64 : fp32;
+        if (choice.has_value()) {
+            continue;
+        }
+        double &time = doubles ? fp64Time : fp32Time;
+        try {
+            tuning::Config const workgroup = tuning::tune(
+                variant.name, tuning::candidates(device, 2),
+                [&](tuning::Config const &config) {
+                    return measure(variant, config);
+                },
+                &time);
+            choice = VariantChoice{variant, workgroup};
+        } catch (std::runtime_error const &) {
+            // Left to the other precision
+        }
+    }
+
+    if (!fp64.has_value() && !fp32.has_value()) {
+        throw std::runtime_error("No integrand variant could be measured");
+    }
+    VariantChoice const &best =
+        fp32.has_value() &&
+                (!fp64.has_value() || fp64Time > FP64_WEAK_RATIO * fp32Time)
+            ? *fp32
+            : *fp64;
+    db.store(device, best.variant.name, best.workgroup);
+    return best;
+}
@@ -1,44 +1,188 @@
 #include "simple_compute_pipeline.h"
 #include "common.h"
+#include "vulkan_base/descriptor_set_manip.h"
 #include "vulkan_base/sync_objects.h"
+#include "vulkan_base/trace.h"
 #include "vulkan_base/utils.h"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <stdexcept>
 #include <vulkan/vulkan_core.h>
 
 SimpleComputePipeline::SimpleComputePipeline(
-    std::string shader_path,
+    std::string shader,
     std::shared_ptr<device::DeviceHandler> const &m_deviceHandler,
-    VkDescriptorSetLayout *layout)
-    : m_deviceHandler{m_deviceHandler}, m_descriptorSetLayout{layout} {
-    if (!utils::fileExists(shader_path)) {
+    VkDescriptorSetLayout *layout, uint32_t pconst_size,
+    VkPipelineCache pipelineCache)
+    : m_deviceHandler{m_deviceHandler},
+      m_name{std::filesystem::path(shader).filename().string()} {
+    m_reflect(shader);
+    if (pconst_size < m_reflection.pushConstantSize) {
+        throw std::runtime_error(
+            m_name + " has " + std::to_string(m_reflection.pushConstantSize) +
+            " bytes of push constants, but the range is " +
+            std::to_string(pconst_size));
+    }
+    m_setLayouts = {*layout};
+    // The caller's layout stays, but not the pipeline layout made from it
+    try {
+        m_create(m_deviceHandler->shaderRegistry->module(shader), pconst_size,
+                 pipelineCache, std::nullopt);
+    } catch (...) {
+        cleanup();
+        throw;
+    }
+}
+
+SimpleComputePipeline::SimpleComputePipeline(
+    std::string shader,
+    std::shared_ptr<device::DeviceHandler> const &m_deviceHandler,
+    VkPipelineCache pipelineCache, DescriptorMode mode,
+    std::optional<tuning::Config> const &workgroup)
+    : m_deviceHandler{m_deviceHandler},
+      m_name{std::filesystem::path(shader).filename().string()} {
+    m_reflect(shader);
+    m_bindings = m_reflection.set(0);
+
+    // A push writes every descriptor of the set at once, so set 0 must fit
+    // in one; otherwise it falls back to cached sets
+    uint32_t descriptorCount = 0;
+    for (reflection::Binding const &binding : m_bindings) {
+        descriptorCount += binding.count;
+    }
+    if (mode == DescriptorMode::Push && m_deviceHandler->pushDescriptors &&
+        descriptorCount <= m_deviceHandler->maxPushDescriptors) {
+        m_descriptorMode = DescriptorMode::Push;
+        m_pushDescriptorSet = reinterpret_cast<PFN_vkCmdPushDescriptorSetKHR>(
+            vkGetDeviceProcAddr(*m_deviceHandler, "vkCmdPushDescriptorSetKHR"));
+    } else if (!m_bindings.empty()) {
+        m_descriptors = std::make_unique<descriptor::Allocator>(
+            m_deviceHandler, descriptor::ratiosOf(m_bindings));
+    }
+
+    // Sets the shader skips still need a layout, an empty one
+    m_ownsLayouts = true;
+    m_setLayouts.resize(std::max(m_reflection.setCount(), 1U));
+    for (uint32_t set = 0; set < m_setLayouts.size(); set++) {
+        VkDescriptorSetLayoutCreateFlags const flags =
+            set == 0 && m_descriptorMode == DescriptorMode::Push
+                ? VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR
+                : 0;
+        createLayout(*m_deviceHandler, &m_setLayouts[set],
+                     m_reflection.set(set), flags);
+    }
+    // The destructor does not run if the constructor throws, and the tuner
+    // goes on after a configuration that failed
+    try {
+        m_create(m_deviceHandler->shaderRegistry->module(shader),
+                 m_reflection.pushConstantSize, pipelineCache, workgroup);
+    } catch (...) {
+        cleanup();
+        throw;
+    }
+}
+
+void SimpleComputePipeline::m_reflect(std::string const &shader) {
+    shaders::Registry &registry = *m_deviceHandler->shaderRegistry;
+    if (!registry.contains(shader)) {
         std::string msg{"No shader named "};
-        msg += shader_path;
+        msg += shader;
         msg += "\n";
         utils::exitFatal(msg, 2);
     }
 
-    // Create shader modules
-    VkShaderModule computeShaderModule =
-        utils::loadShader(shader_path.data(), *m_deviceHandler);
+    m_reflection = reflection::reflect(registry.code(shader));
+    if (m_reflection.deviceAddresses && !m_deviceHandler->bufferDeviceAddress) {
+        throw std::runtime_error(
+            m_name + " reads buffers through device addresses, which the "
+                     "device does not support");
+    }
+}
 
+void SimpleComputePipeline::m_create(
+    VkShaderModule module, uint32_t pconst_size, VkPipelineCache pipelineCache,
+    std::optional<tuning::Config> const &workgroup) {
     VkPipelineShaderStageCreateInfo computeShaderStageInfo{};
     computeShaderStageInfo.sType =
         VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
     computeShaderStageInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
-    computeShaderStageInfo.module = computeShaderModule;
-    computeShaderStageInfo.pName = "main";
+    computeShaderStageInfo.pName = m_reflection.entryPoint.c_str();
+
+    // The axes of the workgroup size the shader leaves to specialization
+    std::vector<VkSpecializationMapEntry> specEntries;
+    VkSpecializationInfo specInfo{};
+    VkPipelineShaderStageRequiredSubgroupSizeCreateInfoEXT subgroupInfo{};
+    if (workgroup.has_value()) {
+        VkPhysicalDeviceLimits const &limits =
+            m_deviceHandler->properties.limits;
+        std::array<uint32_t, 3> const &size = workgroup->localSize;
+        for (uint32_t axis = 0; axis < 3; axis++) {
+            std::optional<uint32_t> const &specId =
+                m_reflection.localSizeSpecIds[axis];
+            if (specId.has_value()) {
+                specEntries.push_back({*specId,
+                                       static_cast<uint32_t>(
+                                           axis * sizeof(uint32_t)),
+                                       sizeof(uint32_t)});
+            } else if (size[axis] != m_reflection.localSize[axis]) {
+                throw std::runtime_error(
+                    m_name + " fixes the workgroup size along axis " +
+                    std::to_string(axis));
+            }
+            if (size[axis] == 0 ||
+                size[axis] > limits.maxComputeWorkGroupSize[axis]) {
+                throw std::runtime_error(
+                    m_name + " workgroup size " + std::to_string(size[axis]) +
+                    " is past the device limit along axis " +
+                    std::to_string(axis));
+            }
+        }
+        if (size[0] * size[1] * size[2] >
+            limits.maxComputeWorkGroupInvocations) {
+            throw std::runtime_error(m_name +
+                                     " workgroup has too many invocations");
+        }
+        m_reflection.localSize = size;
+
+        specInfo.mapEntryCount = static_cast<uint32_t>(specEntries.size());
+        specInfo.pMapEntries = specEntries.data();
+        specInfo.dataSize = sizeof(size);
+        specInfo.pData = size.data();
+        computeShaderStageInfo.pSpecializationInfo = &specInfo;
+
+        uint32_t const subgroupSize = workgroup->subgroupSize;
+        if (subgroupSize != 0) {
+            if (!m_deviceHandler->subgroupSizeControl ||
+                subgroupSize < m_deviceHandler->minSubgroupSize ||
+                subgroupSize > m_deviceHandler->maxSubgroupSize) {
+                throw std::runtime_error(
+                    m_name + " cannot require a subgroup size of " +
+                    std::to_string(subgroupSize));
+            }
+            subgroupInfo.sType =
+                VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_REQUIRED_SUBGROUP_SIZE_CREATE_INFO_EXT;
+            subgroupInfo.requiredSubgroupSize = subgroupSize;
+            computeShaderStageInfo.pNext = &subgroupInfo;
+        }
+    }
+
+    // The module is shared with every other pipeline of the shader
+    computeShaderStageInfo.module = module;
 
     VkPushConstantRange push_constant;
     push_constant.offset = 0;
-    push_constant.size = sizeof(IntegralPushContant);
+    push_constant.size = pconst_size;
     push_constant.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
 
     VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
     pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    pipelineLayoutInfo.setLayoutCount = 1;
-    pipelineLayoutInfo.pSetLayouts = m_descriptorSetLayout;
+    pipelineLayoutInfo.setLayoutCount =
+        static_cast<uint32_t>(m_setLayouts.size());
+    pipelineLayoutInfo.pSetLayouts = m_setLayouts.data();
+    // Shaders that read their parameters from a buffer have no push constants
     pipelineLayoutInfo.pPushConstantRanges = &push_constant;
-    pipelineLayoutInfo.pushConstantRangeCount = 1;
+    pipelineLayoutInfo.pushConstantRangeCount = pconst_size > 0 ? 1 : 0;
 
     if (vkCreatePipelineLayout(*m_deviceHandler, &pipelineLayoutInfo, nullptr,
                                &pipelineLayout) != VK_SUCCESS) {
@@ -49,19 +193,47 @@ SimpleComputePipeline::SimpleComputePipeline(
     pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
     pipelineInfo.layout = pipelineLayout;
     pipelineInfo.stage = computeShaderStageInfo;
-    if (vkCreateComputePipelines(*m_deviceHandler, VK_NULL_HANDLE, 1,
+    tracing::Span span("create " + m_name, "pipeline");
+    auto const start = std::chrono::steady_clock::now();
+    if (vkCreateComputePipelines(*m_deviceHandler, pipelineCache, 1,
                                  &pipelineInfo, nullptr,
                                  &pipeline) != VK_SUCCESS) {
         throw std::runtime_error("failed to create compute pipeline!");
     }
-
-    vkDestroyShaderModule(*m_deviceHandler, computeShaderModule, nullptr);
+    m_createTime = std::chrono::duration<double, std::nano>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
 }
 
 void SimpleComputePipeline::cleanup() {
+    // The sets go with their pools, before the layouts they were made from
+    m_descriptors.reset();
     vkDestroyPipeline(m_deviceHandler->logicalDevice, pipeline, nullptr);
     vkDestroyPipelineLayout(m_deviceHandler->logicalDevice, pipelineLayout,
                             nullptr);
+    if (m_ownsLayouts) {
+        for (VkDescriptorSetLayout layout : m_setLayouts) {
+            vkDestroyDescriptorSetLayout(m_deviceHandler->logicalDevice,
+                                         layout, nullptr);
+        }
+    }
+}
+
+void SimpleComputePipeline::setProfiler(profiling::Profiler *profiler,
+                                        std::string const &name) {
+    m_profiler = profiler;
+    if (!name.empty()) {
+        m_name = name;
+    }
+    if (m_profiler != nullptr) {
+        m_profiler->addSample(m_name + " create", m_createTime);
+    }
+}
+
+void SimpleComputePipeline::forget(VkBuffer buffer) {
+    if (m_descriptors != nullptr) {
+        m_descriptors->forget(buffer);
+    }
 }
 
 void SimpleComputePipeline::pushConstant(VkCommandBuffer buf,
@@ -71,13 +243,72 @@ void SimpleComputePipeline::pushConstant(VkCommandBuffer buf,
                        pconst_size, push_const);
 }
 
-void SimpleComputePipeline::dispatch(
-    VkCommandBuffer buf, VkDescriptorSet const *descriptorSet,
-    SyncObjects const &objs, size_t iter, void const *pConst,
-    size_t pconst_size, std::array<uint32_t, 3> const &disp_sizes) {
+void SimpleComputePipeline::record(VkCommandBuffer buf,
+                                   VkDescriptorSet const *descriptorSet,
+                                   void const *pConst, size_t pconst_size,
+                                   std::array<uint32_t, 3> const &disp_sizes) {
+    vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    if (descriptorSet != nullptr) {
+        vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                pipelineLayout, 0, 1, descriptorSet, 0,
+                                nullptr);
+    }
+    m_record(buf, pConst, pconst_size, disp_sizes);
+}
+
+void SimpleComputePipeline::record(
+    VkCommandBuffer buf, std::vector<VkDescriptorBufferInfo> const &buffers,
+    void const *pConst, size_t pconst_size,
+    std::array<uint32_t, 3> const &disp_sizes) {
+    if (m_descriptorMode == DescriptorMode::Push) {
+        std::vector<VkWriteDescriptorSet> const writes =
+            bufferWrites(VK_NULL_HANDLE, m_bindings, buffers);
+        vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+        m_pushDescriptorSet(buf, VK_PIPELINE_BIND_POINT_COMPUTE,
+                            pipelineLayout, 0,
+                            static_cast<uint32_t>(writes.size()),
+                            writes.data());
+        m_record(buf, pConst, pconst_size, disp_sizes);
+        return;
+    }
+
+    if (m_descriptors == nullptr) {
+        throw std::runtime_error(
+            m_name + " has no reflected bindings to bind buffers to");
+    }
+    VkDescriptorSet const descriptorSet =
+        m_descriptors->get(m_setLayouts[0], m_bindings, buffers);
+    record(buf, &descriptorSet, pConst, pconst_size, disp_sizes);
+}
+
+void SimpleComputePipeline::m_record(
+    VkCommandBuffer buf, void const *pConst, size_t pconst_size,
+    std::array<uint32_t, 3> const &disp_sizes) {
+    if (pconst_size > 0) {
+        pushConstant(buf, pConst, pconst_size);
+    }
+    if (pConst != nullptr || pconst_size == 0) {
+        uint32_t const scope =
+            m_profiler != nullptr
+                ? m_profiler->begin(buf, m_name, profiling::Level::Dispatch)
+                : profiling::NO_SCOPE;
+        vkCmdDispatch(buf, disp_sizes[0], disp_sizes[1], disp_sizes[2]);
+        if (m_profiler != nullptr) {
+            m_profiler->end(buf, scope);
+        }
+    }
+}
+
+void SimpleComputePipeline::m_submit(VkCommandBuffer buf,
+                                     SyncObjects const &objs, size_t iter,
+                                     std::function<void()> const &record,
+                                     bool wait) {
     size_t const cur_it = iter % objs.fences.size();
-    vkWaitForFences(*m_deviceHandler, 1, &objs.fences[cur_it], VK_TRUE,
-                    DEFAULT_FENCE_TIMEOUT);
+    {
+        tracing::Span span("fence wait", "wait");
+        vkWaitForFences(*m_deviceHandler, 1, &objs.fences[cur_it], VK_TRUE,
+                        DEFAULT_FENCE_TIMEOUT);
+    }
     vkResetFences(*m_deviceHandler, 1, &objs.fences[cur_it]);
     vkResetCommandBuffer(buf, 0);
 
@@ -85,61 +316,60 @@ void SimpleComputePipeline::dispatch(
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
     VK_CHECK(vkBeginCommandBuffer(buf, &beginInfo));
-    vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-    vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
-                            0, 1, descriptorSet, 0, nullptr);
-    pushConstant(buf, pConst, pconst_size);
-    if (pConst != nullptr) {
-        vkCmdDispatch(buf, disp_sizes[0], disp_sizes[1], disp_sizes[2]);
-    }
-
+    record();
     VK_CHECK(vkEndCommandBuffer(buf));
 
     VkSubmitInfo submitInfo{};
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &buf;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &objs.semaphores[cur_it];
 
-    vkQueueWaitIdle(m_deviceHandler->computeQueue);
-    VK_CHECK(vkQueueSubmit(m_deviceHandler->computeQueue, 1, &submitInfo,
-                           objs.fences[cur_it]));
+    {
+        tracing::Span span("submit", "submit");
+        VK_CHECK(m_deviceHandler->submit(m_deviceHandler->computeQueue, 1,
+                                         &submitInfo, objs.fences[cur_it]));
+    }
+    if (wait) {
+        tracing::Span span("fence wait", "wait");
+        VK_CHECK(vkWaitForFences(*m_deviceHandler, 1, &objs.fences[cur_it],
+                                 VK_TRUE, DEFAULT_FENCE_TIMEOUT));
+    }
 }
 
-void SimpleComputePipeline::dispatch_s(
+void SimpleComputePipeline::dispatch(
     VkCommandBuffer buf, VkDescriptorSet const *descriptorSet,
     SyncObjects const &objs, size_t iter, void const *pConst,
     size_t pconst_size, std::array<uint32_t, 3> const &disp_sizes) {
-    size_t const cur_it = iter % objs.fences.size();
-    vkWaitForFences(*m_deviceHandler, 1, &objs.fences[cur_it], VK_TRUE,
-                    DEFAULT_FENCE_TIMEOUT);
-    vkResetFences(*m_deviceHandler, 1, &objs.fences[cur_it]);
-    vkResetCommandBuffer(buf, 0);
-
-    VkCommandBufferBeginInfo beginInfo{};
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-
-    VK_CHECK(vkBeginCommandBuffer(buf, &beginInfo));
-    vkCmdBindPipeline(buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
-    vkCmdBindDescriptorSets(buf, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout,
-                            0, 1, descriptorSet, 0, nullptr);
-    pushConstant(buf, pConst, pconst_size);
-    if (pConst != nullptr) {
-        vkCmdDispatch(buf, disp_sizes[0], disp_sizes[1], disp_sizes[2]);
-    }
+    m_submit(
+        buf, objs, iter,
+        [&] { record(buf, descriptorSet, pConst, pconst_size, disp_sizes); },
+        false);
+}
 
-    VK_CHECK(vkEndCommandBuffer(buf));
+void SimpleComputePipeline::dispatch(
+    VkCommandBuffer buf, std::vector<VkDescriptorBufferInfo> const &buffers,
+    SyncObjects const &objs, size_t iter, void const *pConst,
+    size_t pconst_size, std::array<uint32_t, 3> const &disp_sizes) {
+    m_submit(
+        buf, objs, iter,
+        [&] { record(buf, buffers, pConst, pconst_size, disp_sizes); }, false);
+}
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &buf;
-    submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &objs.semaphores[cur_it];
+void SimpleComputePipeline::dispatch_s(
+    VkCommandBuffer buf, VkDescriptorSet const *descriptorSet,
+    SyncObjects const &objs, size_t iter, void const *pConst,
+    size_t pconst_size, std::array<uint32_t, 3> const &disp_sizes) {
+    m_submit(
+        buf, objs, iter,
+        [&] { record(buf, descriptorSet, pConst, pconst_size, disp_sizes); },
+        true);
+}
 
-    vkQueueWaitIdle(m_deviceHandler->computeQueue);
-    VK_CHECK(vkQueueSubmit(m_deviceHandler->computeQueue, 1, &submitInfo,
-                           objs.fences[cur_it]));
-    vkQueueWaitIdle(m_deviceHandler->computeQueue);
+void SimpleComputePipeline::dispatch_s(
+    VkCommandBuffer buf, std::vector<VkDescriptorBufferInfo> const &buffers,
+    SyncObjects const &objs, size_t iter, void const *pConst,
+    size_t pconst_size, std::array<uint32_t, 3> const &disp_sizes) {
+    m_submit(
+        buf, objs, iter,
+        [&] { record(buf, buffers, pConst, pconst_size, disp_sizes); }, true);
 }
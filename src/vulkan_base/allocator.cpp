@@ -0,0 +1,451 @@
+#include "vulkan_base/allocator.h"
+#include "vulkan_base/create_info.h"
+#include "vulkan_base/vk_device.h"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+
+namespace memory {
+Allocator::Allocator(device::DeviceHandler const &deviceHandler,
+                     VkDeviceSize blockSize)
+    : m_deviceHandler(deviceHandler),
+      m_blockSizeLimit(std::bit_floor(blockSize)) {}
+
+Allocator::~Allocator() {
+    for (auto &[key, blocks] : m_pools) {
+        for (auto &block : blocks) {
+            vkFreeMemory(m_deviceHandler, block->memory, nullptr);
+        }
+    }
+}
+
+VkDeviceSize Allocator::m_blockSize(uint32_t memoryTypeIndex) const {
+    VkPhysicalDeviceMemoryProperties const &props =
+        m_deviceHandler.memoryProperties;
+    VkDeviceSize const heapSize =
+        props.memoryHeaps[props.memoryTypes[memoryTypeIndex].heapIndex].size;
+
+    // Small heaps (e. g. the 256MiB BAR heap) must not be eaten by one block
+    return std::max(
+        std::min(m_blockSizeLimit,
+                 std::bit_floor(heapSize / HEAP_BLOCK_FRACTION)),
+        MIN_ALLOCATION_SIZE);
+}
+
+VkDeviceMemory Allocator::m_allocateMemory(VkDeviceSize size,
+                                           uint32_t memoryTypeIndex,
+                                           VkMemoryAllocateFlags allocFlags,
+                                           VkBuffer buffer) {
+    VkMemoryAllocateInfo allocInfo =
+        create_info::memoryAllocInfo(size, memoryTypeIndex);
+
+    VkMemoryAllocateFlagsInfo allocFlagsInfo{};
+    if (allocFlags != 0) {
+        allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO;
+        allocFlagsInfo.flags = allocFlags;
+        allocFlagsInfo.pNext = allocInfo.pNext;
+        allocInfo.pNext = &allocFlagsInfo;
+    }
+
+    VkMemoryDedicatedAllocateInfo dedicatedInfo{};
+    if (buffer != VK_NULL_HANDLE) {
+        dedicatedInfo.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_ALLOCATE_INFO;
+        dedicatedInfo.buffer = buffer;
+        dedicatedInfo.pNext = allocInfo.pNext;
+        allocInfo.pNext = &dedicatedInfo;
+    }
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if (vkAllocateMemory(m_deviceHandler, &allocInfo, nullptr, &memory) !=
+        VK_SUCCESS) {
+        throw std::runtime_error("failed to allocate device memory!");
+    }
+    return memory;
+}
+
+Allocation Allocator::m_allocateDedicated(VkDeviceSize size,
+                                          uint32_t memoryTypeIndex,
+                                          VkMemoryAllocateFlags allocFlags,
+                                          VkBuffer buffer) {
+    Allocation allocation{};
+    allocation.memory =
+        m_allocateMemory(size, memoryTypeIndex, allocFlags, buffer);
+    allocation.size = size;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+
+    if (static_cast<bool>(m_deviceHandler.memoryProperties
+                              .memoryTypes[memoryTypeIndex]
+                              .propertyFlags &
+                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+        VK_CHECK(vkMapMemory(m_deviceHandler, allocation.memory, 0,
+                             VK_WHOLE_SIZE, 0, &allocation.mapped));
+    }
+    return allocation;
+}
+
+bool Allocator::m_takeBuddy(MemoryBlock &block, uint32_t order,
+                            VkDeviceSize &offset) {
+    uint32_t found = order;
+    while (found < block.freeLists.size() && block.freeLists[found].empty()) {
+        found++;
+    }
+    if (found >= block.freeLists.size()) {
+        return false;
+    }
+
+    auto first = block.freeLists[found].begin();
+    offset = *first;
+    block.freeLists[found].erase(first);
+
+    // Split down to the requested order, keeping the lower halves
+    while (found > order) {
+        found--;
+        block.freeLists[found].insert(offset + (MIN_ALLOCATION_SIZE << found));
+    }
+    block.used += MIN_ALLOCATION_SIZE << order;
+    return true;
+}
+
+Allocation Allocator::m_allocate(VkMemoryRequirements const &requirements,
+                                 uint32_t memoryTypeIndex, bool linear,
+                                 VkMemoryAllocateFlags allocFlags,
+                                 bool dedicated, VkBuffer buffer) {
+    VkDeviceSize const blockSize = m_blockSize(memoryTypeIndex);
+
+    VkDeviceSize size = std::max(requirements.size, requirements.alignment);
+    if (!linear) {
+        // Buddies are aligned to their size, so rounding up to whole pages
+        // keeps linear neighbours off the pages of this resource.
+        VkDeviceSize const granularity =
+            m_deviceHandler.properties.limits.bufferImageGranularity;
+        size = (size + granularity - 1) / granularity * granularity;
+    }
+
+    if (dedicated || size > blockSize / 2) {
+        return m_allocateDedicated(requirements.size, memoryTypeIndex,
+                                   allocFlags, buffer);
+    }
+
+    size = std::bit_ceil(std::max(size, MIN_ALLOCATION_SIZE));
+    auto const order =
+        static_cast<uint32_t>(std::countr_zero(size / MIN_ALLOCATION_SIZE));
+
+    auto &blocks = m_pools[{memoryTypeIndex, allocFlags}];
+
+    VkDeviceSize offset = 0;
+    MemoryBlock *block = nullptr;
+    for (auto &candidate : blocks) {
+        if (m_takeBuddy(*candidate, order, offset)) {
+            block = candidate.get();
+            break;
+        }
+    }
+
+    if (block == nullptr) {
+        auto fresh = std::make_unique<MemoryBlock>();
+        fresh->memory =
+            m_allocateMemory(blockSize, memoryTypeIndex, allocFlags);
+        fresh->size = blockSize;
+        fresh->memoryTypeIndex = memoryTypeIndex;
+        fresh->allocFlags = allocFlags;
+        fresh->freeLists.resize(
+            std::countr_zero(blockSize / MIN_ALLOCATION_SIZE) + 1);
+        fresh->freeLists.back().insert(0);
+
+        if (static_cast<bool>(m_deviceHandler.memoryProperties
+                                  .memoryTypes[memoryTypeIndex]
+                                  .propertyFlags &
+                              VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)) {
+            VK_CHECK(vkMapMemory(m_deviceHandler, fresh->memory, 0,
+                                 VK_WHOLE_SIZE, 0, &fresh->mapped));
+        }
+
+        m_takeBuddy(*fresh, order, offset);
+        block = fresh.get();
+        blocks.push_back(std::move(fresh));
+    }
+
+    Allocation allocation{};
+    allocation.memory = block->memory;
+    allocation.offset = offset;
+    allocation.size = size;
+    allocation.memoryTypeIndex = memoryTypeIndex;
+    allocation.block = block;
+    allocation.order = order;
+    if (block->mapped != nullptr) {
+        allocation.mapped = static_cast<char *>(block->mapped) + offset;
+    }
+    return allocation;
+}
+
+Allocation Allocator::allocate(VkMemoryRequirements const &requirements,
+                               VkMemoryPropertyFlags properties, bool linear,
+                               VkMemoryAllocateFlags allocFlags,
+                               bool dedicated) {
+    uint32_t const memoryTypeIndex =
+        m_deviceHandler.getMemoryType(requirements.memoryTypeBits, properties);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_allocate(requirements, memoryTypeIndex, linear, allocFlags,
+                      dedicated);
+}
+
+Allocation Allocator::allocateBuffer(VkBuffer buffer, VkBufferUsageFlags usage,
+                                     VkMemoryPropertyFlags properties) {
+    return m_allocateBuffer(buffer, usage, [&](uint32_t typeBits) {
+        return m_deviceHandler.getMemoryType(typeBits, properties);
+    });
+}
+
+Allocation Allocator::allocateBuffer(VkBuffer buffer, VkBufferUsageFlags usage,
+                                     Usage intent) {
+    return m_allocateBuffer(buffer, usage, [&](uint32_t typeBits) {
+        return m_deviceHandler.getMemoryType(typeBits, intent);
+    });
+}
+
+Allocation Allocator::m_allocateBuffer(
+    VkBuffer buffer, VkBufferUsageFlags usage,
+    std::function<uint32_t(uint32_t)> const &memoryType) {
+    VkMemoryDedicatedRequirements dedicatedReqs{};
+    dedicatedReqs.sType = VK_STRUCTURE_TYPE_MEMORY_DEDICATED_REQUIREMENTS;
+
+    VkMemoryRequirements2 memReqs{};
+    memReqs.sType = VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2;
+    memReqs.pNext = &dedicatedReqs;
+
+    VkBufferMemoryRequirementsInfo2 reqsInfo{};
+    reqsInfo.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_REQUIREMENTS_INFO_2;
+    reqsInfo.buffer = buffer;
+    vkGetBufferMemoryRequirements2(m_deviceHandler, &reqsInfo, &memReqs);
+
+    VkMemoryAllocateFlags allocFlags = 0;
+    if (static_cast<bool>(usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)) {
+        allocFlags |= VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT;
+    }
+
+    bool const dedicated =
+        static_cast<bool>(dedicatedReqs.prefersDedicatedAllocation) ||
+        static_cast<bool>(dedicatedReqs.requiresDedicatedAllocation);
+
+    uint32_t const memoryTypeIndex =
+        memoryType(memReqs.memoryRequirements.memoryTypeBits);
+
+    Allocation allocation{};
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        allocation = m_allocate(memReqs.memoryRequirements, memoryTypeIndex,
+                                true, allocFlags, dedicated, buffer);
+    }
+
+    VK_CHECK(vkBindBufferMemory(m_deviceHandler, buffer, allocation.memory,
+                                allocation.offset));
+    return allocation;
+}
+
+void Allocator::free(Allocation &allocation) {
+    if (allocation.memory == VK_NULL_HANDLE) {
+        return;
+    }
+
+    {
+        // The memory may be freed or handed out again before the next flush
+        std::lock_guard<std::mutex> lock(m_rangesMutex);
+        VkDeviceSize const end = allocation.offset + allocation.size;
+        auto drop = [&](PendingRanges &pending) {
+            auto found = pending.find(allocation.memory);
+            if (found == pending.end()) {
+                return;
+            }
+            std::erase_if(found->second, [&](Range const &range) {
+                return range.begin < end && allocation.offset < range.end;
+            });
+            if (found->second.empty()) {
+                pending.erase(found);
+            }
+        };
+        drop(m_written);
+        for (auto &[point, pending] : m_read) {
+            drop(pending);
+        }
+        std::erase_if(m_read,
+                      [](auto const &entry) { return entry.second.empty(); });
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (allocation.dedicated()) {
+        vkFreeMemory(m_deviceHandler, allocation.memory, nullptr);
+        allocation = {};
+        return;
+    }
+
+    MemoryBlock &block = *allocation.block;
+    VkDeviceSize offset = allocation.offset;
+    uint32_t order = allocation.order;
+    block.used -= MIN_ALLOCATION_SIZE << order;
+
+    // Merge with the buddy for as long as it is free as well
+    while (order + 1 < block.freeLists.size()) {
+        VkDeviceSize const buddy = offset ^ (MIN_ALLOCATION_SIZE << order);
+        auto found = block.freeLists[order].find(buddy);
+        if (found == block.freeLists[order].end()) {
+            break;
+        }
+        block.freeLists[order].erase(found);
+        offset = std::min(offset, buddy);
+        order++;
+    }
+    block.freeLists[order].insert(offset);
+
+    // Keep one block per pool around so that a burst of small buffers does
+    // not allocate and free a block every time.
+    auto &blocks = m_pools[{block.memoryTypeIndex, block.allocFlags}];
+    if (block.used == 0 && blocks.size() > 1) {
+        vkFreeMemory(m_deviceHandler, block.memory, nullptr);
+        std::erase_if(blocks, [&block](auto const &candidate) {
+            return candidate.get() == &block;
+        });
+    }
+
+    allocation = {};
+}
+std::optional<Allocator::Range>
+Allocator::m_atomRange(Allocation const &allocation, VkDeviceSize offset,
+                       VkDeviceSize size) const {
+    VkMemoryPropertyFlags const flags =
+        m_deviceHandler.memoryProperties.memoryTypes[allocation.memoryTypeIndex]
+            .propertyFlags;
+    if (allocation.mapped == nullptr ||
+        static_cast<bool>(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+        return std::nullopt;
+    }
+
+    VkDeviceSize const atom = std::max<VkDeviceSize>(
+        m_deviceHandler.properties.limits.nonCoherentAtomSize, 1);
+    VkDeviceSize const allocationEnd = allocation.offset + allocation.size;
+    VkDeviceSize const end = size == VK_WHOLE_SIZE
+                                 ? allocationEnd
+                                 : allocation.offset + offset + size;
+
+    // Buddies are aligned to at least MIN_ALLOCATION_SIZE, which no atom is
+    // bigger than, so widening never reaches into another allocation. A
+    // dedicated allocation ends where its memory does, which may be off an
+    // atom but is still a valid end.
+    Range range;
+    range.begin = (allocation.offset + offset) / atom * atom;
+    range.end = std::min((end + atom - 1) / atom * atom, allocationEnd);
+    return range;
+}
+
+std::vector<VkMappedMemoryRange>
+Allocator::m_coalesce(PendingRanges &pending) {
+    std::vector<VkMappedMemoryRange> mapped;
+    for (auto &[memory, ranges] : pending) {
+        std::sort(ranges.begin(), ranges.end(),
+                  [](Range const &a, Range const &b) {
+                      return a.begin < b.begin;
+                  });
+        Range merged = ranges.front();
+        auto emit = [&, memory = memory] {
+            VkMappedMemoryRange range{};
+            range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory = memory;
+            range.offset = merged.begin;
+            range.size = merged.end - merged.begin;
+            mapped.push_back(range);
+        };
+        for (Range const &range : ranges) {
+            if (range.begin > merged.end) {
+                emit();
+                merged = range;
+            } else {
+                merged.end = std::max(merged.end, range.end);
+            }
+        }
+        emit();
+    }
+    pending.clear();
+    return mapped;
+}
+
+void Allocator::flush(Allocation const &allocation, VkDeviceSize offset,
+                      VkDeviceSize size) {
+    std::optional<Range> const range = m_atomRange(allocation, offset, size);
+    if (!range.has_value()) {
+        return;
+    }
+    VkMappedMemoryRange mapped{};
+    mapped.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    mapped.memory = allocation.memory;
+    mapped.offset = range->begin;
+    mapped.size = range->end - range->begin;
+    VK_CHECK(vkFlushMappedMemoryRanges(m_deviceHandler, 1, &mapped));
+}
+
+void Allocator::invalidate(Allocation const &allocation, VkDeviceSize offset,
+                           VkDeviceSize size) {
+    std::optional<Range> const range = m_atomRange(allocation, offset, size);
+    if (!range.has_value()) {
+        return;
+    }
+    VkMappedMemoryRange mapped{};
+    mapped.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    mapped.memory = allocation.memory;
+    mapped.offset = range->begin;
+    mapped.size = range->end - range->begin;
+    VK_CHECK(vkInvalidateMappedMemoryRanges(m_deviceHandler, 1, &mapped));
+}
+
+void Allocator::markWritten(Allocation const &allocation, VkDeviceSize offset,
+                            VkDeviceSize size) {
+    if (std::optional<Range> range = m_atomRange(allocation, offset, size)) {
+        std::lock_guard<std::mutex> lock(m_rangesMutex);
+        m_written[allocation.memory].push_back(*range);
+    }
+}
+
+void Allocator::markRead(Allocation const &allocation, VkSemaphore semaphore,
+                         uint64_t value, VkDeviceSize offset,
+                         VkDeviceSize size) {
+    if (std::optional<Range> range = m_atomRange(allocation, offset, size)) {
+        std::lock_guard<std::mutex> lock(m_rangesMutex);
+        m_read[{semaphore, value}][allocation.memory].push_back(*range);
+    }
+}
+
+void Allocator::flushWritten() {
+    // Held throughout, so free() cannot release the memory in between
+    std::lock_guard<std::mutex> lock(m_rangesMutex);
+    if (m_written.empty()) {
+        return;
+    }
+    std::vector<VkMappedMemoryRange> const ranges = m_coalesce(m_written);
+    VK_CHECK(vkFlushMappedMemoryRanges(m_deviceHandler,
+                                       static_cast<uint32_t>(ranges.size()),
+                                       ranges.data()));
+}
+
+void Allocator::invalidateRead(VkSemaphore semaphore, uint64_t reached) {
+    // Held throughout, as in flushWritten()
+    std::lock_guard<std::mutex> lock(m_rangesMutex);
+    auto const first = m_read.lower_bound({semaphore, 0});
+    auto const last = m_read.upper_bound({semaphore, reached});
+    if (first == last) {
+        return;
+    }
+
+    PendingRanges done;
+    for (auto it = first; it != last; ++it) {
+        for (auto &[memory, ranges] : it->second) {
+            std::vector<Range> &merged = done[memory];
+            merged.insert(merged.end(), ranges.begin(), ranges.end());
+        }
+    }
+    m_read.erase(first, last);
+
+    std::vector<VkMappedMemoryRange> const ranges = m_coalesce(done);
+    VK_CHECK(vkInvalidateMappedMemoryRanges(
+        m_deviceHandler, static_cast<uint32_t>(ranges.size()), ranges.data()));
+}
+} // namespace memory
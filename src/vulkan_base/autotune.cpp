@@ -0,0 +1,153 @@
+#include "vulkan_base/autotune.h"
+#include "vulkan_base/trace.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace tuning {
+Config defaultConfig(uint32_t dimensions) {
+    Config config;
+    config.localSize = dimensions >= 2 ? std::array<uint32_t, 3>{8, 8, 1}
+                                       : std::array<uint32_t, 3>{64, 1, 1};
+    return config;
+}
+
+std::vector<Config> candidates(device::DeviceHandler const &device,
+                               uint32_t dimensions) {
+    VkPhysicalDeviceLimits const &limits = device.properties.limits;
+    uint32_t const maxInvocations =
+        std::min(MAX_TUNED_INVOCATIONS, limits.maxComputeWorkGroupInvocations);
+
+    // Without subgroup size control the driver's choice is the only one
+    std::vector<uint32_t> subgroupSizes = {0};
+    if (device.subgroupSizeControl) {
+        for (uint32_t size = device.minSubgroupSize;
+             size <= device.maxSubgroupSize && size != 0; size *= 2) {
+            subgroupSizes.push_back(size);
+        }
+    }
+
+    std::vector<Config> configs;
+    for (uint32_t invocations = MIN_TUNED_INVOCATIONS;
+         invocations <= maxInvocations; invocations *= 2) {
+        for (uint32_t x = invocations; x >= 1; x /= 2) {
+            uint32_t const y = invocations / x;
+            // Rows at least as wide as they are tall keep writes along x
+            // contiguous; a line has no rows at all
+            if ((dimensions < 2 && y != 1) || y > x ||
+                x > limits.maxComputeWorkGroupSize[0] ||
+                y > limits.maxComputeWorkGroupSize[1]) {
+                continue;
+            }
+            for (uint32_t subgroupSize : subgroupSizes) {
+                if (subgroupSize <= invocations) {
+                    configs.push_back({{x, y, 1}, subgroupSize});
+                }
+            }
+        }
+    }
+    return configs;
+}
+
+Config tune(std::string const &name, std::vector<Config> const &configs,
+            std::function<double(Config const &)> const &measure,
+            double *bestTime) {
+    tracing::Span span("tune " + name, "tune");
+
+    std::optional<Config> best;
+    double fastest = std::numeric_limits<double>::infinity();
+    for (Config const &config : configs) {
+        double time = 0.0;
+        try {
+            time = measure(config);
+        } catch (std::runtime_error const &) {
+            // Past a limit the candidates did not check, like shared memory
+            continue;
+        }
+        if (time < fastest) {
+            fastest = time;
+            best = config;
+        }
+    }
+
+    if (!best.has_value()) {
+        throw std::runtime_error("no configuration of " + name +
+                                 " could be measured");
+    }
+    if (bestTime != nullptr) {
+        *bestTime = fastest;
+    }
+    return *best;
+}
+
+Database::Database(std::string path) : m_path(std::move(path)) {
+    std::ifstream input(m_path);
+    std::string line;
+    while (std::getline(input, line)) {
+        std::istringstream fields(line);
+        std::string uuid;
+        std::string driver;
+        std::string kernel;
+        Config config;
+        if (fields >> uuid >> driver >> kernel >> config.localSize[0] >>
+            config.localSize[1] >> config.localSize[2] >>
+            config.subgroupSize) {
+            m_entries[uuid + " " + driver + " " + kernel] = config;
+        }
+    }
+}
+
+std::string Database::m_key(device::DeviceHandler const &device,
+                            std::string const &kernel) {
+    return selection::uuidHex(device.deviceUUID) + " " +
+           std::to_string(device.properties.driverVersion) + " " + kernel;
+}
+
+std::optional<Config> Database::find(device::DeviceHandler const &device,
+                                     std::string const &kernel) const {
+    auto found = m_entries.find(m_key(device, kernel));
+    if (found == m_entries.end()) {
+        return std::nullopt;
+    }
+    return found->second;
+}
+
+void Database::store(device::DeviceHandler const &device,
+                     std::string const &kernel, Config const &config) {
+    m_entries[m_key(device, kernel)] = config;
+}
+
+void Database::save() const {
+    std::string const tmpPath = m_path + ".tmp";
+    {
+        std::ofstream output(tmpPath, std::ios::out | std::ios::trunc);
+        if (!output.is_open()) {
+            std::cerr << "Could not write the tuning database to \""
+                      << tmpPath << "\"\n";
+            return;
+        }
+        for (auto const &[key, config] : m_entries) {
+            output << key << " " << config.localSize[0] << " "
+                   << config.localSize[1] << " " << config.localSize[2] << " "
+                   << config.subgroupSize << "\n";
+        }
+        if (!output.flush()) {
+            std::cerr << "Could not write the tuning database to \""
+                      << tmpPath << "\"\n";
+            return;
+        }
+    }
+
+    std::error_code err;
+    std::filesystem::rename(tmpPath, m_path, err);
+    if (err) {
+        std::cerr << "Could not replace the tuning database \"" << m_path
+                  << "\": " << err.message() << "\n";
+        std::filesystem::remove(tmpPath, err);
+    }
+}
+} // namespace tuning
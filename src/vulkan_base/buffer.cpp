@@ -1,6 +1,7 @@
 #include "vulkan_base/buffer.h"
 #include "vulkan_base/create_info.h"
 #include <cstring>
+#include <stdexcept>
 
 namespace buffer {
 Buffer::Buffer(
@@ -9,53 +10,72 @@ Buffer::Buffer(
     VkBufferUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropertyFlags,
     VkSharingMode sharingMode, VkDeviceSize size)
     : size(size), usageFlags(usageFlags),
-      memoryPropertyFlags(memoryPropertyFlags),
+      memoryPropertyFlags(memoryPropertyFlags), sharingMode(sharingMode),
       m_commandBuffer(std::move(m_commandBuffer)),
       m_deviceHandler(std::move(m_deviceHandler)) {
-    m_makeBuffer(size, usageFlags, memoryPropertyFlags, buffer, memory,
-                 sharingMode);
+    m_makeBuffer();
+    allocation = this->m_deviceHandler->allocator->allocateBuffer(
+        buffer, usageFlags, memoryPropertyFlags);
+    m_bound();
 }
 
-void Buffer::m_makeBuffer(VkDeviceSize bufsize, VkBufferUsageFlags buf_usage,
-                          VkMemoryPropertyFlags properties, VkBuffer &buf,
-                          VkDeviceMemory &bufferMemory,
-                          VkSharingMode sharingMode) {
+Buffer::Buffer(
+    std::shared_ptr<device::DeviceHandler> m_deviceHandler,
+    std::shared_ptr<command_buffer::CommandBufferHandler> m_commandBuffer,
+    VkBufferUsageFlags usageFlags, memory::Usage intent,
+    VkSharingMode sharingMode, VkDeviceSize size)
+    : size(size), usageFlags(usageFlags), sharingMode(sharingMode),
+      m_commandBuffer(std::move(m_commandBuffer)),
+      m_deviceHandler(std::move(m_deviceHandler)) {
+    m_makeBuffer();
+    allocation = this->m_deviceHandler->allocator->allocateBuffer(
+        buffer, usageFlags, intent);
+    m_bound();
+}
+
+void Buffer::m_makeBuffer() {
+    if (static_cast<bool>(usageFlags &
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) &&
+        !m_deviceHandler->bufferDeviceAddress) {
+        throw std::runtime_error("buffer device addresses are not supported!");
+    }
+
     VkBufferCreateInfo bufferInfo{};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferInfo.size = bufsize;
-    bufferInfo.usage = buf_usage;
+    bufferInfo.size = size;
+    bufferInfo.usage = usageFlags;
     bufferInfo.sharingMode = sharingMode;
 
-    VK_CHECK(vkCreateBuffer(*m_deviceHandler, &bufferInfo, nullptr, &buf));
-
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(*m_deviceHandler, buf, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo{};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = m_deviceHandler->getMemoryType(
-        memRequirements.memoryTypeBits, properties);
-
-    VK_CHECK(
-        vkAllocateMemory(*m_deviceHandler, &allocInfo, nullptr, &bufferMemory));
-
-    vkBindBufferMemory(*m_deviceHandler, buf, bufferMemory, 0);
+    VK_CHECK(vkCreateBuffer(*m_deviceHandler, &bufferInfo, nullptr, &buffer));
 }
 
-void Buffer::map() {
-    VK_CHECK(vkMapMemory(*m_deviceHandler, memory, 0, size, 0, &mapped));
+void Buffer::m_bound() {
+    memory = allocation.memory;
+    memoryPropertyFlags = m_deviceHandler->memoryProperties
+                              .memoryTypes[allocation.memoryTypeIndex]
+                              .propertyFlags;
+
+    if (static_cast<bool>(usageFlags &
+                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)) {
+        VkBufferDeviceAddressInfo addressInfo{};
+        addressInfo.sType = VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO;
+        addressInfo.buffer = buffer;
+        address = vkGetBufferDeviceAddress(*m_deviceHandler, &addressInfo);
+    }
 }
 
-void Buffer::unmap() {
-    if (mapped != nullptr) {
-        vkUnmapMemory(*m_deviceHandler, memory);
-        mapped = nullptr;
+void Buffer::map() {
+    if (allocation.mapped == nullptr) {
+        throw std::runtime_error("buffer memory is not host visible!");
     }
+    mapped = allocation.mapped;
 }
 
+void Buffer::unmap() { mapped = nullptr; }
+
 void Buffer::bind(VkDeviceSize offset) {
-    VK_CHECK(vkBindBufferMemory(*m_deviceHandler, buffer, memory, offset));
+    VK_CHECK(vkBindBufferMemory(*m_deviceHandler, buffer, memory,
+                                allocation.offset + offset));
 }
 
 void Buffer::setupDescriptor() {
@@ -64,23 +84,15 @@ void Buffer::setupDescriptor() {
     descriptor.range = size;
 }
 
-void Buffer::copy(void *data, VkDeviceSize bufsize) {
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-    m_makeBuffer(bufsize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                     VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                 stagingBuffer, stagingBufferMemory, VK_SHARING_MODE_EXCLUSIVE);
-
-    void *mem;
-    vkMapMemory(*m_deviceHandler, stagingBufferMemory, 0, bufsize, 0, &mem);
-    memcpy(mem, data, (size_t)bufsize);
-    vkUnmapMemory(*m_deviceHandler, stagingBufferMemory);
-
-    copyFrom(stagingBuffer);
+void Buffer::copy(void *data, VkDeviceSize bufsize,
+                  std::vector<scheduler::Point> const &after) {
+    wait(copyAsync(data, bufsize, after));
+}
 
-    vkDestroyBuffer(*m_deviceHandler, stagingBuffer, nullptr);
-    vkFreeMemory(*m_deviceHandler, stagingBufferMemory, nullptr);
+transfer::Token Buffer::copyAsync(void const *data, VkDeviceSize bufsize,
+                                  std::vector<scheduler::Point> const &after) {
+    return m_commandBuffer->getStagingRing().upload(data, bufsize, buffer, 0,
+                                                    sharingMode, after);
 }
 
 void Buffer::fastCopy(void *data, VkDeviceSize bufsize) {
@@ -88,85 +100,64 @@ void Buffer::fastCopy(void *data, VkDeviceSize bufsize) {
         map();
     }
     std::memcpy(mapped, data, (size_t)bufsize);
+    markWritten(0, bufsize);
 }
 
 void Buffer::flush(VkDeviceSize bufsize, VkDeviceSize offset) {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = bufsize;
-
-    VK_CHECK(vkFlushMappedMemoryRanges(*m_deviceHandler, 1, &mappedRange));
+    m_deviceHandler->allocator->flush(allocation, offset, bufsize);
 }
 
 void Buffer::invalidate(VkDeviceSize bufsize, VkDeviceSize offset) {
-    VkMappedMemoryRange mappedRange = {};
-    mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    mappedRange.memory = memory;
-    mappedRange.offset = offset;
-    mappedRange.size = bufsize;
-    VK_CHECK(vkInvalidateMappedMemoryRanges(*m_deviceHandler, 1, &mappedRange));
+    m_deviceHandler->allocator->invalidate(allocation, offset, bufsize);
+}
+
+void Buffer::markWritten(VkDeviceSize offset, VkDeviceSize bufsize) {
+    m_deviceHandler->allocator->markWritten(allocation, offset, bufsize);
+}
+
+void Buffer::markRead(scheduler::Point const &point, VkDeviceSize offset,
+                      VkDeviceSize bufsize) {
+    m_deviceHandler->allocator->markRead(allocation, point.semaphore,
+                                         point.value, offset, bufsize);
 }
 
 void Buffer::destroy() {
-    if (mapped != nullptr) {
-        unmap();
-    }
+    unmap();
     if (buffer != VK_NULL_HANDLE) {
-        vkDestroyBuffer(*m_deviceHandler, buffer, nullptr);
-    }
-    if (memory != nullptr) {
-        vkFreeMemory(*m_deviceHandler, memory, nullptr);
+        m_deviceHandler->destroyBuffer(buffer, allocation);
+        buffer = VK_NULL_HANDLE;
+        memory = VK_NULL_HANDLE;
+        address = 0;
     }
 }
 
-void Buffer::copyFrom(VkBuffer srcBuffer) {
-    VkCommandBufferAllocateInfo allocInfo =
-        create_info::commandBufferAllocInfo(m_commandBuffer->commandPool, 1);
-
-    VkCommandBuffer cmdBuffer{};
-    vkAllocateCommandBuffers(*m_deviceHandler, &allocInfo, &cmdBuffer);
-
-    VkCommandBufferBeginInfo beginInfo = create_info::commandBufferBeginInfo();
-
-    vkBeginCommandBuffer(cmdBuffer, &beginInfo);
-
-    VkBufferCopy copyRegion = create_info::copyRegion(size);
-    vkCmdCopyBuffer(cmdBuffer, srcBuffer, buffer, 1, &copyRegion);
-
-    vkEndCommandBuffer(cmdBuffer);
-
-    VkSubmitInfo submitInfo = create_info::submitInfo(1, &cmdBuffer);
-
-    VkQueue transferQueue = m_deviceHandler->getTransferQueue();
-
-    vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(transferQueue);
-
-    vkFreeCommandBuffers(*m_deviceHandler, m_commandBuffer->commandPool, 1,
-                         &cmdBuffer);
+void Buffer::copyFrom(VkBuffer srcBuffer,
+                      std::vector<scheduler::Point> const &after) {
+    wait(copyFromAsync(srcBuffer, after));
 }
 
-void Buffer::copyTo(VkBuffer dstBuffer) {
-    VkCommandBufferBeginInfo beginInfo = create_info::commandBufferBeginInfo();
-    VkCommandBuffer transferBuffer = m_commandBuffer->createCommandBuffer(
-        VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
-
-    vkBeginCommandBuffer(transferBuffer, &beginInfo);
-
-    VkBufferCopy copyRegion = create_info::copyRegion(size);
-    vkCmdCopyBuffer(transferBuffer, buffer, dstBuffer, 1, &copyRegion);
-
-    vkEndCommandBuffer(transferBuffer);
+transfer::Token
+Buffer::copyFromAsync(VkBuffer srcBuffer,
+                      std::vector<scheduler::Point> const &after) {
+    return m_commandBuffer->getTransferEngine().copy(
+        srcBuffer, buffer, create_info::copyRegion(size),
+        transfer::Handoff::ToCompute, sharingMode, nullptr, after);
+}
 
-    VkSubmitInfo submitInfo = create_info::submitInfo(1, &transferBuffer);
+void Buffer::copyTo(VkBuffer dstBuffer,
+                    std::vector<scheduler::Point> const &after) {
+    wait(copyToAsync(dstBuffer, after));
+}
 
-    VkQueue transferQueue = m_deviceHandler->getTransferQueue();
-    vkQueueSubmit(transferQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(transferQueue);
+transfer::Token
+Buffer::copyToAsync(VkBuffer dstBuffer,
+                    std::vector<scheduler::Point> const &after) {
+    return m_commandBuffer->getTransferEngine().copy(
+        buffer, dstBuffer, create_info::copyRegion(size),
+        transfer::Handoff::FromCompute, sharingMode, nullptr, after);
+}
 
-    vkFreeCommandBuffers(*m_deviceHandler, m_commandBuffer->commandPool, 1,
-                         &transferBuffer);
+void Buffer::wait(transfer::Token const &token) const {
+    m_commandBuffer->getTransferEngine().wait(token);
 }
 } // namespace buffer
@@ -6,6 +6,9 @@ CommandBufferHandler::CommandBufferHandler(
     std::shared_ptr<device::DeviceHandler> m_deviceHandler)
     : m_deviceHandler(m_deviceHandler) {
     m_createCommandPool();
+    m_scheduler = std::make_unique<scheduler::Scheduler>(this->m_deviceHandler);
+    m_profiler = std::make_unique<profiling::Profiler>(this->m_deviceHandler,
+                                                       *m_scheduler);
 }
 
 void CommandBufferHandler::m_createCommandPool() {
@@ -23,6 +26,11 @@ void CommandBufferHandler::m_createCommandPool() {
 }
 
 void CommandBufferHandler::cleanup() {
+    m_recorder.reset();
+    m_stagingRing.reset();
+    m_transferEngine.reset();
+    m_scheduler.reset();
+    m_profiler.reset();
     vkDestroyCommandPool(*m_deviceHandler, commandPool, nullptr);
 }
 
@@ -64,25 +72,39 @@ void CommandBufferHandler::flushCommandBuffer(VkCommandBuffer buf,
 
     VK_CHECK(vkEndCommandBuffer(buf));
 
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &buf;
-    // Create fence to ensure that the command buffer has finished executing
-    VkFenceCreateInfo fenceInfo{};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = 0;
-
-    VkFence fence{};
-    VK_CHECK(vkCreateFence(*m_deviceHandler, &fenceInfo, nullptr, &fence));
-    // Submit to the queue
-    VK_CHECK(vkQueueSubmit(queue, 1, &submitInfo, fence));
-    // Wait for the fence to signal that command buffer has finished executing
-    VK_CHECK(vkWaitForFences(*m_deviceHandler, 1, &fence, VK_TRUE,
-                             DEFAULT_FENCE_TIMEOUT));
-    vkDestroyFence(*m_deviceHandler, fence, nullptr);
+    // Wait for the timeline point of the submission instead of a new fence
+    m_scheduler->wait(m_scheduler->submit(m_scheduler->typeOf(queue), buf));
     if (free) {
         vkFreeCommandBuffers(*m_deviceHandler, commandPool, 1, &buf);
     }
 }
+
+transfer::TransferEngine &CommandBufferHandler::getTransferEngine() {
+    std::lock_guard<std::mutex> lock(m_stagingMutex);
+    if (!m_transferEngine) {
+        m_transferEngine =
+            std::make_unique<transfer::TransferEngine>(
+                m_deviceHandler, *m_scheduler, m_profiler.get());
+    }
+    return *m_transferEngine;
+}
+
+staging::StagingRing &CommandBufferHandler::getStagingRing() {
+    transfer::TransferEngine &engine = getTransferEngine();
+    std::lock_guard<std::mutex> lock(m_stagingMutex);
+    if (!m_stagingRing) {
+        m_stagingRing =
+            std::make_unique<staging::StagingRing>(m_deviceHandler, engine);
+    }
+    return *m_stagingRing;
+}
+
+recording::ParallelRecorder &CommandBufferHandler::getRecorder() {
+    std::lock_guard<std::mutex> lock(m_stagingMutex);
+    if (!m_recorder) {
+        m_recorder = std::make_unique<recording::ParallelRecorder>(
+            m_deviceHandler, *m_scheduler, m_profiler.get());
+    }
+    return *m_recorder;
+}
 } // namespace command_buffer
@@ -0,0 +1,213 @@
+#include "vulkan_base/descriptor_allocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <stdexcept>
+
+namespace descriptor {
+namespace {
+void hashCombine(size_t &seed, size_t value) {
+    seed ^= value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2);
+}
+} // namespace
+
+std::vector<PoolRatio> defaultRatios() {
+    return {
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 4.0F},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1.0F},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1.0F},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1.0F},
+    };
+}
+
+std::vector<PoolRatio>
+ratiosOf(std::vector<reflection::Binding> const &bindings) {
+    std::map<VkDescriptorType, float> counts;
+    for (reflection::Binding const &binding : bindings) {
+        counts[binding.type] += static_cast<float>(binding.count);
+    }
+
+    std::vector<PoolRatio> ratios;
+    for (auto const &[type, count] : counts) {
+        ratios.push_back({type, count});
+    }
+    return ratios;
+}
+
+size_t Allocator::KeyHash::operator()(Key const &key) const {
+    size_t seed = std::hash<VkDescriptorSetLayout>{}(key.layout);
+    for (Write const &write : key.writes) {
+        hashCombine(seed, write.binding);
+        hashCombine(seed, static_cast<size_t>(write.type));
+        hashCombine(seed, std::hash<VkBuffer>{}(write.buffer));
+        hashCombine(seed, write.offset);
+        hashCombine(seed, write.range);
+    }
+    return seed;
+}
+
+Allocator::Allocator(std::shared_ptr<device::DeviceHandler> deviceHandler,
+                     std::vector<PoolRatio> ratios, uint32_t setsPerPool)
+    : m_deviceHandler(std::move(deviceHandler)), m_ratios(std::move(ratios)),
+      m_setsPerPool(std::max(setsPerPool, 1U)) {}
+
+Allocator::~Allocator() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_current != VK_NULL_HANDLE) {
+        vkDestroyDescriptorPool(*m_deviceHandler, m_current, nullptr);
+    }
+    for (VkDescriptorPool pool : m_full) {
+        vkDestroyDescriptorPool(*m_deviceHandler, pool, nullptr);
+    }
+    for (VkDescriptorPool pool : m_ready) {
+        vkDestroyDescriptorPool(*m_deviceHandler, pool, nullptr);
+    }
+}
+
+VkDescriptorPool Allocator::m_createPool() {
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (PoolRatio const &ratio : m_ratios) {
+        poolSizes.push_back(
+            {ratio.type, std::max(static_cast<uint32_t>(std::ceil(
+                                      ratio.ratio *
+                                      static_cast<float>(m_setsPerPool))),
+                                  1U)});
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = m_setsPerPool;
+
+    VkDescriptorPool pool{};
+    VK_CHECK(vkCreateDescriptorPool(*m_deviceHandler, &poolInfo, nullptr,
+                                    &pool));
+    m_setsPerPool = std::min(m_setsPerPool * 2, MAX_SETS_PER_POOL);
+    m_pools++;
+    return pool;
+}
+
+VkDescriptorSet Allocator::m_allocate(VkDescriptorSetLayout layout) {
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    // The current pool first, then a reset or a new one; a set that does
+    // not fit an empty pool never will
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (m_current == VK_NULL_HANDLE) {
+            if (!m_ready.empty()) {
+                m_current = m_ready.back();
+                m_ready.pop_back();
+            } else {
+                m_current = m_createPool();
+            }
+        }
+
+        allocInfo.descriptorPool = m_current;
+        VkDescriptorSet set{};
+        VkResult const res =
+            vkAllocateDescriptorSets(*m_deviceHandler, &allocInfo, &set);
+        if (res == VK_SUCCESS) {
+            return set;
+        }
+        if (res != VK_ERROR_OUT_OF_POOL_MEMORY &&
+            res != VK_ERROR_FRAGMENTED_POOL) {
+            VK_CHECK(res);
+        }
+        m_full.push_back(m_current);
+        m_current = VK_NULL_HANDLE;
+    }
+    throw std::runtime_error(
+        "descriptor set layout does not fit the pool ratios");
+}
+
+VkDescriptorSet Allocator::allocate(VkDescriptorSetLayout layout) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_allocate(layout);
+}
+
+VkDescriptorSet
+Allocator::get(VkDescriptorSetLayout layout,
+               std::vector<reflection::Binding> const &bindings,
+               std::vector<VkDescriptorBufferInfo> const &bufferInfos) {
+    Key key{layout, {}};
+    for (reflection::Binding const &binding : bindings) {
+        if (binding.type != VK_DESCRIPTOR_TYPE_STORAGE_BUFFER &&
+            binding.type != VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+            continue;
+        }
+        size_t const i = key.writes.size();
+        if (i >= bufferInfos.size()) {
+            throw std::runtime_error("fewer buffers than the shader declares");
+        }
+        key.writes.push_back({binding.binding, binding.type,
+                              bufferInfos[i].buffer, bufferInfos[i].offset,
+                              bufferInfos[i].range});
+    }
+    if (key.writes.size() != bufferInfos.size()) {
+        throw std::runtime_error("more buffers than the shader declares");
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto cached = m_cache.find(key);
+    if (cached != m_cache.end()) {
+        m_hits++;
+        return cached->second;
+    }
+
+    VkDescriptorSet set = m_allocate(layout);
+    std::vector<VkWriteDescriptorSet> descriptorWrites(key.writes.size());
+    for (size_t i = 0; i < key.writes.size(); i++) {
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].dstSet = set;
+        descriptorWrites[i].dstBinding = key.writes[i].binding;
+        descriptorWrites[i].descriptorType = key.writes[i].type;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+    }
+    vkUpdateDescriptorSets(*m_deviceHandler,
+                           static_cast<uint32_t>(descriptorWrites.size()),
+                           descriptorWrites.data(), 0, nullptr);
+
+    m_cache.emplace(std::move(key), set);
+    return set;
+}
+
+void Allocator::forget(VkBuffer buffer) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::erase_if(m_cache, [&](auto const &entry) {
+        return std::any_of(
+            entry.first.writes.begin(), entry.first.writes.end(),
+            [&](Write const &write) { return write.buffer == buffer; });
+    });
+}
+
+void Allocator::reset() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cache.clear();
+    if (m_current != VK_NULL_HANDLE) {
+        m_full.push_back(m_current);
+        m_current = VK_NULL_HANDLE;
+    }
+    for (VkDescriptorPool pool : m_full) {
+        VK_CHECK(vkResetDescriptorPool(*m_deviceHandler, pool, 0));
+        m_ready.push_back(pool);
+    }
+    m_full.clear();
+}
+
+size_t Allocator::pools() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_pools;
+}
+
+size_t Allocator::cacheHits() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hits;
+}
+} // namespace descriptor
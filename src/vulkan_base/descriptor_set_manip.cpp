@@ -1,40 +1,165 @@
 #include "vulkan_base/descriptor_set_manip.h"
 #include "vulkan_base/create_info.h"
+
+#include <map>
+#include <stdexcept>
+#include <string>
 #include <vector>
 
-void createLayout(VkDevice device, VkDescriptorSetLayout *layout) {
-    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings = {
-        create_info::descriptorSetLayoutBinding(
-            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, 0),
-    };
+void createLayout(VkDevice device, VkDescriptorSetLayout *layout,
+                  uint32_t bindingCount) {
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+    for (uint32_t i = 0; i < bindingCount; i++) {
+        setLayoutBindings.push_back(create_info::descriptorSetLayoutBinding(
+            VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_SHADER_STAGE_COMPUTE_BIT, i));
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutInfo{};
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.bindingCount = bindingCount;
+    layoutInfo.pBindings = setLayoutBindings.data();
+
+    VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, layout));
+}
+
+void createLayout(VkDevice device, VkDescriptorSetLayout *layout,
+                  std::vector<reflection::Binding> const &bindings,
+                  VkDescriptorSetLayoutCreateFlags flags) {
+    std::vector<VkDescriptorSetLayoutBinding> setLayoutBindings;
+    for (reflection::Binding const &binding : bindings) {
+        setLayoutBindings.push_back(create_info::descriptorSetLayoutBinding(
+            binding.type, VK_SHADER_STAGE_COMPUTE_BIT, binding.binding,
+            binding.count));
+    }
 
     VkDescriptorSetLayoutCreateInfo layoutInfo{};
     layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-    layoutInfo.bindingCount = 1;
+    layoutInfo.flags = flags;
+    layoutInfo.bindingCount = static_cast<uint32_t>(setLayoutBindings.size());
     layoutInfo.pBindings = setLayoutBindings.data();
 
     VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, layout));
 }
 
-void createDescriptorPool(VkDevice device, VkDescriptorPool *descriptorPool) {
+void createDescriptorPool(VkDevice device, VkDescriptorPool *descriptorPool,
+                          std::vector<reflection::Binding> const &bindings,
+                          uint32_t maxSets) {
+    std::map<VkDescriptorType, uint32_t> counts;
+    for (reflection::Binding const &binding : bindings) {
+        counts[binding.type] += binding.count * maxSets;
+    }
+
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for (auto const &[type, count] : counts) {
+        poolSizes.push_back({type, count});
+    }
+
+    VkDescriptorPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
+    poolInfo.pPoolSizes = poolSizes.data();
+    poolInfo.maxSets = maxSets;
+
+    VK_CHECK(
+        vkCreateDescriptorPool(device, &poolInfo, nullptr, descriptorPool));
+}
+
+void createDescriptorPool(VkDevice device, VkDescriptorPool *descriptorPool,
+                          uint32_t maxSets, uint32_t descriptorCount) {
     std::array<VkDescriptorPoolSize, 1> poolSizes{};
     poolSizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[0].descriptorCount = 1;
+    poolSizes[0].descriptorCount = descriptorCount;
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
     poolInfo.poolSizeCount = 1;
     poolInfo.pPoolSizes = poolSizes.data();
-    poolInfo.maxSets = 1;
+    poolInfo.maxSets = maxSets;
 
     VK_CHECK(
         vkCreateDescriptorPool(device, &poolInfo, nullptr, descriptorPool));
 }
 
-void createDescriptorSet(VkDevice device, VkDescriptorSetLayout *layout,
-                         VkDescriptorPool &descriptorPool,
-                         VkDescriptorSet &descriptorSet, VkBuffer *buf,
-                         const uint32_t sizes[3]) {
+void createDescriptorSet(
+    VkDevice device, VkDescriptorSetLayout *layout,
+    VkDescriptorPool &descriptorPool, VkDescriptorSet &descriptorSet,
+    std::vector<VkDescriptorBufferInfo> const &bufferInfos) {
+    VkDescriptorSetAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = descriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = layout;
+
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
+
+    std::vector<VkWriteDescriptorSet> descriptorWrites(bufferInfos.size());
+    for (size_t i = 0; i < bufferInfos.size(); i++) {
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].dstSet = descriptorSet;
+        descriptorWrites[i].dstBinding = static_cast<uint32_t>(i);
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+    }
+
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()),
+                           descriptorWrites.data(), 0, nullptr);
+}
+
+std::vector<VkWriteDescriptorSet>
+bufferWrites(VkDescriptorSet set,
+             std::vector<reflection::Binding> const &bindings,
+             std::vector<VkDescriptorBufferInfo> const &bufferInfos) {
+    std::vector<reflection::Binding> buffers;
+    for (reflection::Binding const &binding : bindings) {
+        if (binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+            binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+            buffers.push_back(binding);
+        }
+    }
+    if (buffers.size() != bufferInfos.size()) {
+        throw std::runtime_error(
+            "the shader declares " + std::to_string(buffers.size()) +
+            " buffers, but " + std::to_string(bufferInfos.size()) +
+            " were given");
+    }
+
+    // A whole-size range is checked by the validation layers instead
+    for (size_t i = 0; i < buffers.size(); i++) {
+        VkDeviceSize const range = bufferInfos[i].range;
+        if (range != VK_WHOLE_SIZE &&
+            range < buffers[i].size + buffers[i].stride) {
+            throw std::runtime_error(
+                "range of binding " + std::to_string(buffers[i].binding) +
+                " (" + buffers[i].name + ") is " + std::to_string(range) +
+                " bytes, the shader needs at least " +
+                std::to_string(buffers[i].size + buffers[i].stride));
+        }
+    }
+
+    std::vector<VkWriteDescriptorSet> descriptorWrites(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++) {
+        descriptorWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptorWrites[i].dstSet = set;
+        descriptorWrites[i].dstBinding = buffers[i].binding;
+        descriptorWrites[i].dstArrayElement = 0;
+        descriptorWrites[i].descriptorType = buffers[i].type;
+        descriptorWrites[i].descriptorCount = 1;
+        descriptorWrites[i].pBufferInfo = &bufferInfos[i];
+    }
+    return descriptorWrites;
+}
+
+void createDescriptorSet(
+    VkDevice device, VkDescriptorSetLayout *layout,
+    VkDescriptorPool &descriptorPool, VkDescriptorSet &descriptorSet,
+    std::vector<reflection::Binding> const &bindings,
+    std::vector<VkDescriptorBufferInfo> const &bufferInfos) {
+    // Checked before anything is allocated from the pool
+    std::vector<VkWriteDescriptorSet> descriptorWrites =
+        bufferWrites(VK_NULL_HANDLE, bindings, bufferInfos);
+
     VkDescriptorSetAllocateInfo allocInfo{};
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.descriptorPool = descriptorPool;
@@ -43,21 +168,11 @@ void createDescriptorSet(VkDevice device, VkDescriptorSetLayout *layout,
 
     VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet));
 
-    VkDescriptorBufferInfo storageBufferInfo{};
-    storageBufferInfo.buffer = *buf;
-    storageBufferInfo.offset = 0;
-    storageBufferInfo.range = sizeof(double) * sizes[0] * sizes[1];
-
-    std::array<VkWriteDescriptorSet, 1> descriptorWrites{};
-    descriptorWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[0].dstSet = descriptorSet;
-    descriptorWrites[0].dstBinding = 0;
-    descriptorWrites[0].dstArrayElement = 0;
-    descriptorWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    descriptorWrites[0].descriptorCount = 1;
-    descriptorWrites[0].pBufferInfo = &storageBufferInfo;
-
-    vkUpdateDescriptorSets(device, 1, descriptorWrites.data(), 0, nullptr);
+    for (VkWriteDescriptorSet &write : descriptorWrites) {
+        write.dstSet = descriptorSet;
+    }
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(descriptorWrites.size()),
+                           descriptorWrites.data(), 0, nullptr);
 }
 
 void cleanupDescriptors(VkDevice device, VkDescriptorSetLayout &layout,
@@ -0,0 +1,138 @@
+#include "vulkan_base/device_selection.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace selection {
+Candidate describe(VkPhysicalDevice device) {
+    Candidate candidate;
+    candidate.physicalDevice = device;
+
+    VkPhysicalDeviceIDProperties idProperties{};
+    idProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ID_PROPERTIES;
+    VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+    subgroupProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    subgroupProperties.pNext = &idProperties;
+    VkPhysicalDeviceProperties2 properties2{};
+    properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties2.pNext = &subgroupProperties;
+    vkGetPhysicalDeviceProperties2(device, &properties2);
+
+    candidate.properties = properties2.properties;
+    candidate.subgroupSize = subgroupProperties.subgroupSize;
+    std::copy(std::begin(idProperties.deviceUUID),
+              std::end(idProperties.deviceUUID), candidate.uuid.begin());
+    vkGetPhysicalDeviceFeatures(device, &candidate.features);
+
+    // Vulkan 1.2 features are only defined for devices that support it
+    if (candidate.properties.apiVersion >= VK_API_VERSION_1_2) {
+        VkPhysicalDeviceVulkan12Features features12{};
+        features12.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+        VkPhysicalDeviceFeatures2 features2{};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &features12;
+        vkGetPhysicalDeviceFeatures2(device, &features2);
+        candidate.timelineSemaphore = features12.timelineSemaphore == VK_TRUE;
+    }
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount,
+                                             families.data());
+    for (auto const &family : families) {
+        if (static_cast<bool>(family.queueFlags & VK_QUEUE_COMPUTE_BIT)) {
+            candidate.computeQueues += family.queueCount;
+        }
+    }
+
+    VkPhysicalDeviceMemoryProperties memory{};
+    vkGetPhysicalDeviceMemoryProperties(device, &memory);
+    for (uint32_t i = 0; i < memory.memoryHeapCount; i++) {
+        if (static_cast<bool>(memory.memoryHeaps[i].flags &
+                              VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+            candidate.deviceLocalBytes = std::max(
+                candidate.deviceLocalBytes, memory.memoryHeaps[i].size);
+        }
+    }
+
+    return candidate;
+}
+
+std::string uuidHex(std::array<uint8_t, VK_UUID_SIZE> const &uuid) {
+    std::ostringstream hex;
+    hex << std::hex << std::setfill('0');
+    for (uint8_t byte : uuid) {
+        hex << std::setw(2) << static_cast<uint32_t>(byte);
+    }
+    return hex.str();
+}
+
+long computeScore(Candidate const &candidate) {
+    // Every submission signals a timeline semaphore, and the kernels sum in
+    // doubles
+    if (candidate.properties.apiVersion < VK_API_VERSION_1_2 ||
+        !candidate.timelineSemaphore ||
+        candidate.features.shaderFloat64 != VK_TRUE) {
+        return 0;
+    }
+
+    long score = 1;
+
+    switch (candidate.properties.deviceType) {
+    case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+        score += DISCRETE_GPU_BONUS;
+        break;
+    case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+        score += INTEGRATED_GPU_BONUS;
+        break;
+    default:
+        break;
+    }
+
+    score += COMPUTE_QUEUE_BONUS *
+             std::min(candidate.computeQueues, MAX_SCORED_QUEUES);
+    score += DEVICE_MEMORY_BONUS *
+             static_cast<long>(candidate.deviceLocalBytes >> 30);
+    score += candidate.properties.limits.maxComputeWorkGroupInvocations /
+             INVOCATIONS_PER_POINT;
+    score += candidate.subgroupSize;
+
+    return score;
+}
+
+Policy pinned(std::string const &selector, Policy fallback) {
+    return [selector, fallback = std::move(fallback)](
+               Candidate const &candidate) -> long {
+        std::string const name = candidate.properties.deviceName;
+        if (uuidHex(candidate.uuid) != selector &&
+            name.find(selector) == std::string::npos) {
+            return 0;
+        }
+        // A match is picked even if the fallback would reject it
+        return std::max(fallback(candidate), 1L);
+    };
+}
+
+Policy benchmarked(
+    std::function<std::optional<double>(Candidate const &)> measure,
+    Policy fallback) {
+    return [measure = std::move(measure), fallback = std::move(fallback)](
+               Candidate const &candidate) -> long {
+        long const score = fallback(candidate);
+        if (score <= 0) {
+            return score;
+        }
+        std::optional<double> const speed = measure(candidate);
+        if (!speed.has_value()) {
+            return score;
+        }
+        return std::max(static_cast<long>(static_cast<double>(score) * *speed),
+                        1L);
+    };
+}
+} // namespace selection
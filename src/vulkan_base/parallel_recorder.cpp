@@ -0,0 +1,199 @@
+#include "vulkan_base/parallel_recorder.h"
+#include "vulkan_base/create_info.h"
+#include "vulkan_base/trace.h"
+
+#include <algorithm>
+
+namespace recording {
+ParallelRecorder::ParallelRecorder(
+    std::shared_ptr<device::DeviceHandler> deviceHandler,
+    scheduler::Scheduler &scheduler, profiling::Profiler *profiler,
+    size_t threads)
+    : m_deviceHandler(std::move(deviceHandler)), m_scheduler(scheduler),
+      m_profiler(profiler) {
+    if (threads == 0) {
+        threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+
+    m_createPool(m_primaries);
+    for (size_t i = 0; i < threads; i++) {
+        m_pools.push_back(std::make_unique<Pool>());
+        m_createPool(*m_pools.back());
+    }
+    for (size_t i = 0; i < threads; i++) {
+        m_workers.emplace_back(&ParallelRecorder::m_work, this, i);
+    }
+}
+
+ParallelRecorder::~ParallelRecorder() {
+    {
+        std::lock_guard<std::mutex> lock(m_jobsMutex);
+        m_stop = true;
+    }
+    m_jobsReady.notify_all();
+    for (auto &worker : m_workers) {
+        worker.join();
+    }
+
+    m_destroyPool(m_primaries);
+    for (auto &pool : m_pools) {
+        m_destroyPool(*pool);
+    }
+}
+
+void ParallelRecorder::m_createPool(Pool &pool) {
+    VkCommandPoolCreateInfo poolInfo = create_info::commandPoolCreateInfo(
+        m_scheduler.family(scheduler::QueueType::Compute));
+    poolInfo.flags |= VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    VK_CHECK(vkCreateCommandPool(*m_deviceHandler, &poolInfo, nullptr,
+                                 &pool.pool));
+}
+
+void ParallelRecorder::m_destroyPool(Pool &pool) {
+    for (auto const &[point, cmd] : pool.pending) {
+        m_scheduler.wait(point);
+    }
+    vkDestroyCommandPool(*m_deviceHandler, pool.pool, nullptr);
+}
+
+VkCommandBuffer ParallelRecorder::m_acquire(Pool &pool,
+                                            VkCommandBufferLevel level) {
+    while (!pool.pending.empty() &&
+           m_scheduler.poll(pool.pending.front().first)) {
+        VK_CHECK(vkResetCommandBuffer(pool.pending.front().second, 0));
+        pool.free.push_back(pool.pending.front().second);
+        pool.pending.pop_front();
+    }
+
+    if (!pool.free.empty()) {
+        VkCommandBuffer cmd = pool.free.back();
+        pool.free.pop_back();
+        return cmd;
+    }
+
+    VkCommandBufferAllocateInfo allocInfo =
+        create_info::commandBufferAllocInfo(pool.pool, 1);
+    allocInfo.level = level;
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    VK_CHECK(vkAllocateCommandBuffers(*m_deviceHandler, &allocInfo, &cmd));
+    return cmd;
+}
+
+void ParallelRecorder::m_work(size_t index) {
+    Pool &pool = *m_pools[index];
+
+    while (true) {
+        Job job{};
+        {
+            std::unique_lock<std::mutex> lock(m_jobsMutex);
+            m_jobsReady.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+            if (m_jobs.empty()) {
+                return;
+            }
+            job = m_jobs.front();
+            m_jobs.pop_front();
+        }
+
+        std::exception_ptr error;
+        try {
+            std::lock_guard<std::mutex> lock(pool.mutex);
+            VkCommandBuffer cmd =
+                m_acquire(pool, VK_COMMAND_BUFFER_LEVEL_SECONDARY);
+
+            VkCommandBufferInheritanceInfo inheritance =
+                create_info::commandBufferInheritanceInfo();
+            VkCommandBufferBeginInfo beginInfo =
+                create_info::commandBufferBeginInfo();
+            beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+            beginInfo.pInheritanceInfo = &inheritance;
+
+            // Handed out before recording, so that it returns to the pool
+            // even if the segment throws.
+            *job.cmd = cmd;
+            *job.worker = index;
+            tracing::Span span("record segment", "record");
+            VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+            (*job.segment)(cmd);
+            VK_CHECK(vkEndCommandBuffer(cmd));
+        } catch (...) {
+            error = std::current_exception();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(m_jobsMutex);
+            if (error && !m_error) {
+                m_error = error;
+            }
+            m_running--;
+        }
+        m_jobsDone.notify_all();
+    }
+}
+
+scheduler::Point
+ParallelRecorder::submit(std::vector<Segment> const &segments,
+                         std::vector<scheduler::Wait> const &waits) {
+    std::lock_guard<std::mutex> submitLock(m_submitMutex);
+
+    std::vector<VkCommandBuffer> secondaries(segments.size(), VK_NULL_HANDLE);
+    std::vector<size_t> workers(segments.size(), 0);
+
+    std::exception_ptr error;
+    {
+        std::unique_lock<std::mutex> lock(m_jobsMutex);
+        for (size_t i = 0; i < segments.size(); i++) {
+            m_jobs.push_back({&segments[i], &secondaries[i], &workers[i]});
+        }
+        m_running = segments.size();
+        m_jobsReady.notify_all();
+        m_jobsDone.wait(lock, [&] { return m_running == 0; });
+        std::swap(error, m_error);
+    }
+
+    VkCommandBuffer primary = VK_NULL_HANDLE;
+    scheduler::Point point{};
+    if (!error) {
+        std::lock_guard<std::mutex> lock(m_primaries.mutex);
+        primary = m_acquire(m_primaries, VK_COMMAND_BUFFER_LEVEL_PRIMARY);
+
+        VkCommandBufferBeginInfo beginInfo =
+            create_info::commandBufferBeginInfo();
+        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        VK_CHECK(vkBeginCommandBuffer(primary, &beginInfo));
+        uint32_t const scope =
+            m_profiler != nullptr
+                ? m_profiler->begin(primary, "recorded",
+                                    profiling::Level::Batch)
+                : profiling::NO_SCOPE;
+        if (!secondaries.empty()) {
+            vkCmdExecuteCommands(primary,
+                                 static_cast<uint32_t>(secondaries.size()),
+                                 secondaries.data());
+        }
+        if (m_profiler != nullptr) {
+            m_profiler->end(primary, scope);
+        }
+        VK_CHECK(vkEndCommandBuffer(primary));
+
+        point = m_scheduler.submit(scheduler::QueueType::Compute, primary,
+                                   waits);
+        m_primaries.pending.emplace_back(point, primary);
+    }
+
+    // The buffers of a failed submission get a default point, which counts
+    // as reached, so they are reset on their next reuse.
+    for (size_t i = 0; i < secondaries.size(); i++) {
+        if (secondaries[i] == VK_NULL_HANDLE) {
+            continue;
+        }
+        Pool &pool = *m_pools[workers[i]];
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.pending.emplace_back(point, secondaries[i]);
+    }
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+    return point;
+}
+} // namespace recording
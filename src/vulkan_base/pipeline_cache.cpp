@@ -0,0 +1,115 @@
+#include "vulkan_base/pipeline_cache.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace pipeline_cache {
+PipelineCache::PipelineCache(
+    std::shared_ptr<device::DeviceHandler> deviceHandler, std::string path)
+    : m_deviceHandler(std::move(deviceHandler)), m_path(std::move(path)) {
+    std::vector<char> data = m_load();
+
+    VkPipelineCacheCreateInfo cacheInfo{};
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    VK_CHECK(
+        vkCreatePipelineCache(*m_deviceHandler, &cacheInfo, nullptr, &cache));
+}
+
+PipelineCache::~PipelineCache() {
+    save();
+    vkDestroyPipelineCache(*m_deviceHandler, cache, nullptr);
+}
+
+std::vector<char> PipelineCache::m_load() const {
+    std::ifstream input(m_path, std::ios::binary | std::ios::in);
+    if (!input.is_open()) {
+        return {};
+    }
+
+    VkPhysicalDeviceProperties const &props = m_deviceHandler->properties;
+
+    CacheFileHeader header{};
+    input.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!input || header.magic != CACHE_FILE_MAGIC ||
+        header.driverVersion != props.driverVersion ||
+        header.vendorID != props.vendorID ||
+        header.deviceID != props.deviceID ||
+        std::memcmp(header.pipelineCacheUUID, props.pipelineCacheUUID,
+                    VK_UUID_SIZE) != 0 ||
+        header.dataSize < sizeof(VkPipelineCacheHeaderVersionOne)) {
+        return {};
+    }
+
+    std::vector<char> data(header.dataSize);
+    input.read(data.data(), static_cast<std::streamsize>(data.size()));
+    if (!input) {
+        return {};
+    }
+
+    // The driver validates its own header too, but a mismatch there is
+    // reported as a failure on some implementations rather than ignored.
+    VkPipelineCacheHeaderVersionOne driverHeader{};
+    std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+    if (driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+        driverHeader.vendorID != props.vendorID ||
+        driverHeader.deviceID != props.deviceID ||
+        std::memcmp(driverHeader.pipelineCacheUUID, props.pipelineCacheUUID,
+                    VK_UUID_SIZE) != 0) {
+        return {};
+    }
+
+    return data;
+}
+
+void PipelineCache::save() const {
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(*m_deviceHandler, cache, &size, nullptr));
+    if (size == 0) {
+        return;
+    }
+
+    std::vector<char> data(size);
+    VK_CHECK(
+        vkGetPipelineCacheData(*m_deviceHandler, cache, &size, data.data()));
+
+    VkPhysicalDeviceProperties const &props = m_deviceHandler->properties;
+    CacheFileHeader header{};
+    header.magic = CACHE_FILE_MAGIC;
+    header.driverVersion = props.driverVersion;
+    header.vendorID = props.vendorID;
+    header.deviceID = props.deviceID;
+    std::memcpy(header.pipelineCacheUUID, props.pipelineCacheUUID,
+                VK_UUID_SIZE);
+    header.dataSize = size;
+
+    std::string const tmpPath = m_path + ".tmp";
+    {
+        std::ofstream output(tmpPath, std::ios::binary | std::ios::out |
+                                          std::ios::trunc);
+        if (!output.is_open()) {
+            std::cerr << "Could not write the pipeline cache to \"" << tmpPath
+                      << "\"\n";
+            return;
+        }
+        output.write(reinterpret_cast<char const *>(&header), sizeof(header));
+        output.write(data.data(), static_cast<std::streamsize>(size));
+        if (!output.flush()) {
+            std::cerr << "Could not write the pipeline cache to \"" << tmpPath
+                      << "\"\n";
+            return;
+        }
+    }
+
+    std::error_code err;
+    std::filesystem::rename(tmpPath, m_path, err);
+    if (err) {
+        std::cerr << "Could not replace the pipeline cache \"" << m_path
+                  << "\": " << err.message() << "\n";
+        std::filesystem::remove(tmpPath, err);
+    }
+}
+} // namespace pipeline_cache
@@ -0,0 +1,321 @@
+#include "vulkan_base/profiler.h"
+#include "vulkan_base/create_info.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace profiling {
+Profiler::Profiler(std::shared_ptr<device::DeviceHandler> deviceHandler,
+                   scheduler::Scheduler &scheduler, Mode mode,
+                   uint32_t scopes)
+    : m_deviceHandler(std::move(deviceHandler)), m_scheduler(scheduler),
+      m_mode(mode),
+      m_scopes(scopes),
+      m_period(m_deviceHandler->properties.limits.timestampPeriod) {
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_deviceHandler->physicalDevice,
+                                             &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(m_deviceHandler->physicalDevice,
+                                             &familyCount, families.data());
+
+    // A family without valid bits has no timestamps at all. Without host
+    // resets no queue is measured: a scope reset in its command buffer could
+    // be read back before that buffer runs, and find the last results.
+    for (auto queue : {scheduler::QueueType::Compute,
+                       scheduler::QueueType::Transfer}) {
+        uint32_t const bits =
+            m_deviceHandler->hostQueryReset
+                ? families[scheduler.family(queue)].timestampValidBits
+                : 0;
+        m_masks[static_cast<size_t>(queue)] =
+            bits >= 64 ? ~uint64_t{0} : (uint64_t{1} << bits) - 1;
+    }
+
+    VkQueryPoolCreateInfo poolInfo{};
+    poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    // The last query is for the calibration without calibrated timestamps
+    poolInfo.queryCount = 2 * scopes + 1;
+    VK_CHECK(
+        vkCreateQueryPool(*m_deviceHandler, &poolInfo, nullptr, &m_pool));
+    if (m_deviceHandler->hostQueryReset) {
+        vkResetQueryPool(*m_deviceHandler, m_pool, 0, poolInfo.queryCount);
+    }
+
+    if (m_deviceHandler->calibratedTimestamps) {
+        m_getCalibratedTimestamps =
+            reinterpret_cast<PFN_vkGetCalibratedTimestampsEXT>(
+                vkGetDeviceProcAddr(*m_deviceHandler,
+                                    "vkGetCalibratedTimestampsEXT"));
+    }
+}
+
+Profiler::~Profiler() {
+    vkDestroyQueryPool(*m_deviceHandler, m_pool, nullptr);
+}
+
+void Profiler::setMode(Mode mode) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_mode = mode;
+}
+
+Mode Profiler::mode() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_mode;
+}
+
+bool Profiler::enabled(Level level) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return static_cast<int>(m_mode) >= static_cast<int>(level);
+}
+
+uint32_t Profiler::begin(VkCommandBuffer cmd, std::string const &name,
+                         Level level, scheduler::QueueType queue) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (static_cast<int>(m_mode) < static_cast<int>(level) ||
+        m_masks[static_cast<size_t>(queue)] == 0) {
+        return NO_SCOPE;
+    }
+
+    auto const count = static_cast<uint32_t>(m_scopes.size());
+    auto findFree = [&]() -> uint32_t {
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t const scope = (m_next + i) % count;
+            if (!m_scopes[scope].used) {
+                return scope;
+            }
+        }
+        return NO_SCOPE;
+    };
+
+    uint32_t scope = findFree();
+    if (scope == NO_SCOPE) {
+        m_collect();
+        scope = findFree();
+    }
+    if (scope == NO_SCOPE) {
+        m_dropped++;
+        return NO_SCOPE;
+    }
+
+    m_next = (scope + 1) % count;
+    m_scopes[scope].name = name;
+    m_scopes[scope].queue = queue;
+    m_scopes[scope].mask = m_masks[static_cast<size_t>(queue)];
+    m_scopes[scope].used = true;
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_pool,
+                        2 * scope);
+    return scope;
+}
+
+void Profiler::end(VkCommandBuffer cmd, uint32_t scope) {
+    if (scope == NO_SCOPE) {
+        return;
+    }
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_pool,
+                        2 * scope + 1);
+}
+
+void Profiler::discard(uint32_t scope) {
+    if (scope == NO_SCOPE) {
+        return;
+    }
+    // Nothing wrote the queries, so they are still reset
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_scopes[scope].used = false;
+}
+
+void Profiler::collect() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_collect();
+}
+
+void Profiler::m_collect() {
+    tracing::Tracer &tracer = tracing::Tracer::instance();
+    bool const trace = tracer.enabled();
+    // Without host resets there are no scopes, nor a query to calibrate with
+    if (trace && m_deviceHandler->hostQueryReset &&
+        (!m_calibrated || m_getCalibratedTimestamps != nullptr)) {
+        m_calibrate();
+    }
+
+    for (uint32_t scope = 0; scope < m_scopes.size(); scope++) {
+        if (!m_scopes[scope].used) {
+            continue;
+        }
+
+        // Each query is followed by its availability
+        std::array<uint64_t, 4> results{};
+        VkResult const res = vkGetQueryPoolResults(
+            *m_deviceHandler, m_pool, 2 * scope, 2, sizeof(results),
+            results.data(), 2 * sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if ((res != VK_SUCCESS && res != VK_NOT_READY) || results[1] == 0 ||
+            results[3] == 0) {
+            continue;
+        }
+
+        uint64_t const ticks =
+            (results[2] - results[0]) & m_scopes[scope].mask;
+        m_add(m_scopes[scope].name, static_cast<double>(ticks) * m_period);
+        if (trace) {
+            tracer.gpuSpan(m_scopes[scope].name,
+                           m_scopes[scope].queue == scheduler::QueueType::Compute
+                               ? "compute queue"
+                               : "transfer queue",
+                           m_toHost(results[0], m_scopes[scope].mask),
+                           m_toHost(results[2], m_scopes[scope].mask));
+        }
+
+        vkResetQueryPool(*m_deviceHandler, m_pool, 2 * scope, 2);
+        m_scopes[scope].used = false;
+    }
+}
+
+void Profiler::m_calibrate() {
+    if (m_getCalibratedTimestamps != nullptr) {
+        std::array<VkCalibratedTimestampInfoEXT, 2> infos{};
+        infos[0].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[0].timeDomain = VK_TIME_DOMAIN_DEVICE_EXT;
+        infos[1].sType = VK_STRUCTURE_TYPE_CALIBRATED_TIMESTAMP_INFO_EXT;
+        infos[1].timeDomain = VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT;
+        std::array<uint64_t, 2> timestamps{};
+        uint64_t deviation = 0;
+        VK_CHECK(m_getCalibratedTimestamps(
+            *m_deviceHandler, static_cast<uint32_t>(infos.size()),
+            infos.data(), timestamps.data(), &deviation));
+        m_deviceAnchor = timestamps[0];
+        m_hostAnchor = timestamps[1];
+        m_calibrated = true;
+        return;
+    }
+
+    uint32_t const query = 2 * static_cast<uint32_t>(m_scopes.size());
+    VkCommandPoolCreateInfo poolInfo = create_info::commandPoolCreateInfo(
+        m_scheduler.family(scheduler::QueueType::Compute));
+    poolInfo.flags |= VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    VkCommandPool pool{};
+    VK_CHECK(vkCreateCommandPool(*m_deviceHandler, &poolInfo, nullptr, &pool));
+
+    VkCommandBufferAllocateInfo allocInfo =
+        create_info::commandBufferAllocateInfo(
+            pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1);
+    VkCommandBuffer cmd{};
+    VK_CHECK(vkAllocateCommandBuffers(*m_deviceHandler, &allocInfo, &cmd));
+
+    VkCommandBufferBeginInfo beginInfo = create_info::commandBufferBeginInfo();
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_pool, query);
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    // The timestamp is written somewhere between the submission and the end
+    // of the wait, so the middle of the two is the best guess
+    uint64_t const before = tracing::Tracer::now();
+    m_scheduler.wait(m_scheduler.submit(scheduler::QueueType::Compute, cmd));
+    uint64_t const after = tracing::Tracer::now();
+
+    VK_CHECK(vkGetQueryPoolResults(
+        *m_deviceHandler, m_pool, query, 1, sizeof(m_deviceAnchor),
+        &m_deviceAnchor, sizeof(m_deviceAnchor),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+    m_hostAnchor = before + (after - before) / 2;
+    m_calibrated = true;
+
+    vkResetQueryPool(*m_deviceHandler, m_pool, query, 1);
+    vkDestroyCommandPool(*m_deviceHandler, pool, nullptr);
+}
+
+uint64_t Profiler::m_toHost(uint64_t ticks, uint64_t mask) const {
+    // Scopes can start before the anchor, so the difference is signed
+    uint64_t const delta = (ticks - m_deviceAnchor) & mask;
+    double const signedTicks =
+        delta > (mask >> 1) ? -static_cast<double>((mask - delta) + 1)
+                            : static_cast<double>(delta);
+    return static_cast<uint64_t>(static_cast<double>(m_hostAnchor) +
+                                 signedTicks * m_period);
+}
+
+void Profiler::addSample(std::string const &name, double nanoseconds) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_add(name, nanoseconds);
+}
+
+void Profiler::m_add(std::string const &name, double nanoseconds) {
+    Samples &samples = m_samples[name];
+    Stats &stats = samples.stats;
+    stats.min = stats.count == 0 ? nanoseconds : std::min(stats.min, nanoseconds);
+    stats.max = std::max(stats.max, nanoseconds);
+    stats.total += nanoseconds;
+    stats.count++;
+
+    if (samples.latest.size() < PROFILER_SAMPLES) {
+        samples.latest.push_back(nanoseconds);
+    } else {
+        samples.latest[samples.next] = nanoseconds;
+        samples.next = (samples.next + 1) % PROFILER_SAMPLES;
+    }
+}
+
+Stats Profiler::m_stats(Samples const &samples) {
+    Stats stats = samples.stats;
+    if (samples.latest.empty()) {
+        return stats;
+    }
+
+    std::vector<double> sorted = samples.latest;
+    auto percentile = [&](double fraction) {
+        auto const idx = static_cast<size_t>(
+            fraction * static_cast<double>(sorted.size() - 1));
+        std::nth_element(sorted.begin(), sorted.begin() + idx, sorted.end());
+        return sorted[idx];
+    };
+    stats.p50 = percentile(0.5);
+    stats.p99 = percentile(0.99);
+    return stats;
+}
+
+Stats Profiler::stats(std::string const &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_collect();
+    auto samples = m_samples.find(name);
+    return samples == m_samples.end() ? Stats{} : m_stats(samples->second);
+}
+
+std::map<std::string, Stats> Profiler::statistics() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_collect();
+    std::map<std::string, Stats> all;
+    for (auto const &[name, samples] : m_samples) {
+        all[name] = m_stats(samples);
+    }
+    return all;
+}
+
+uint64_t Profiler::dropped() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void Profiler::report(std::ostream &out) {
+    constexpr double NS_PER_US = 1000.0;
+
+    out << std::left << std::setw(32) << "name" << std::right
+        << std::setw(10) << "count" << std::setw(12) << "min us"
+        << std::setw(12) << "p50 us" << std::setw(12) << "p99 us"
+        << std::setw(14) << "total us" << "\n";
+    for (auto const &[name, stats] : statistics()) {
+        out << std::left << std::setw(32) << name << std::right
+            << std::setw(10) << stats.count << std::fixed
+            << std::setprecision(2) << std::setw(12) << stats.min / NS_PER_US
+            << std::setw(12) << stats.p50 / NS_PER_US << std::setw(12)
+            << stats.p99 / NS_PER_US << std::setw(14)
+            << stats.total / NS_PER_US << "\n";
+    }
+    if (dropped() != 0) {
+        out << dropped() << " scopes dropped\n";
+    }
+    out << std::defaultfloat;
+}
+} // namespace profiling
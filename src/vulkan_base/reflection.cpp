@@ -0,0 +1,466 @@
+#include "vulkan_base/reflection.h"
+
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace reflection {
+namespace {
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+constexpr size_t SPIRV_HEADER_WORDS = 5;
+
+// The few opcodes and enumerants of the SPIR-V specification that describe
+// the interface of a compute shader
+enum Op : uint32_t {
+    OpName = 5,
+    OpEntryPoint = 15,
+    OpExecutionMode = 16,
+    OpCapability = 17,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpConstantComposite = 44,
+    OpSpecConstant = 50,
+    OpSpecConstantComposite = 51,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+    OpExecutionModeId = 331,
+};
+
+enum Decoration : uint32_t {
+    DecorationSpecId = 1,
+    DecorationBufferBlock = 3,
+    DecorationArrayStride = 6,
+    DecorationMatrixStride = 7,
+    DecorationBuiltIn = 11,
+    DecorationBinding = 33,
+    DecorationDescriptorSet = 34,
+    DecorationOffset = 35,
+};
+
+constexpr uint32_t EXECUTION_MODEL_GL_COMPUTE = 5;
+constexpr uint32_t EXECUTION_MODE_LOCAL_SIZE = 17;
+constexpr uint32_t EXECUTION_MODE_LOCAL_SIZE_ID = 38;
+constexpr uint32_t BUILT_IN_WORKGROUP_SIZE = 25;
+constexpr uint32_t STORAGE_UNIFORM_CONSTANT = 0;
+constexpr uint32_t STORAGE_UNIFORM = 2;
+constexpr uint32_t STORAGE_PUSH_CONSTANT = 9;
+constexpr uint32_t STORAGE_STORAGE_BUFFER = 12;
+constexpr uint32_t STORAGE_PHYSICAL_STORAGE_BUFFER = 5349;
+constexpr uint32_t CAPABILITY_PHYSICAL_STORAGE_BUFFER_ADDRESSES = 5347;
+constexpr uint32_t DIM_BUFFER = 5;
+constexpr uint32_t IMAGE_STORAGE = 2;
+
+/**
+ * \brief A type or a constant, by the opcode and operands that declared it.
+ */
+struct Declaration {
+    uint32_t opcode = 0;
+    std::vector<uint32_t> operands; /**< Everything after the result id */
+};
+
+/**
+ * \brief What one pass over a module collects.
+ */
+struct Module {
+    std::unordered_map<uint32_t, Declaration> declarations;
+    std::unordered_map<uint32_t, std::string> names;
+    std::unordered_map<uint32_t, uint32_t> sets;
+    std::unordered_map<uint32_t, uint32_t> bindings;
+    std::unordered_map<uint32_t, uint32_t> arrayStrides;
+    std::unordered_map<uint32_t, uint32_t> specIds;
+    std::unordered_map<uint32_t, std::map<uint32_t, uint32_t>> offsets;
+    std::unordered_map<uint32_t, std::map<uint32_t, uint32_t>> matrixStrides;
+    std::unordered_set<uint32_t> bufferBlocks;
+    std::optional<uint32_t> workgroupSize; /**< The WorkgroupSize constant */
+    std::vector<std::pair<uint32_t, uint32_t>> variables; /**< Type, id */
+    std::optional<uint32_t> entryPoint;
+    std::array<uint32_t, 3> localSize = {1, 1, 1};
+    std::array<std::optional<uint32_t>, 3> localSizeSpecIds;
+    bool deviceAddresses = false; /**< Declares the address capability */
+};
+
+/**
+ * \brief Decodes the nul-terminated string starting at words[0].
+ */
+std::string literalString(uint32_t const *words, size_t count) {
+    std::string s;
+    for (size_t i = 0; i < count; i++) {
+        for (size_t byte = 0; byte < 4; byte++) {
+            char const c = static_cast<char>((words[i] >> (8 * byte)) & 0xFF);
+            if (c == '\0') {
+                return s;
+            }
+            s.push_back(c);
+        }
+    }
+    return s;
+}
+
+Declaration const &declaration(Module const &module, uint32_t id) {
+    auto found = module.declarations.find(id);
+    if (found == module.declarations.end()) {
+        throw std::runtime_error("SPIR-V references an undeclared id " +
+                                 std::to_string(id));
+    }
+    return found->second;
+}
+
+uint32_t constantValue(Module const &module, uint32_t id) {
+    Declaration const &constant = declaration(module, id);
+    if ((constant.opcode != OpConstant && constant.opcode != OpSpecConstant) ||
+        constant.operands.size() < 2) {
+        throw std::runtime_error("SPIR-V size is not a scalar constant");
+    }
+    return constant.operands[1];
+}
+
+/**
+ * \brief Bytes of type in the explicit layout of its block.
+ *
+ * A runtime array adds nothing, its stride is reported separately.
+ */
+VkDeviceSize typeSize(Module const &module, uint32_t id,
+                      uint32_t matrixStride = 0) {
+    Declaration const &type = declaration(module, id);
+    std::vector<uint32_t> const &ops = type.operands;
+    switch (type.opcode) {
+    case OpTypeInt:
+    case OpTypeFloat:
+        return ops[0] / 8;
+    case OpTypeVector:
+        return typeSize(module, ops[0]) * ops[1];
+    case OpTypeMatrix:
+        return (matrixStride != 0 ? matrixStride : typeSize(module, ops[0])) *
+               ops[1];
+    case OpTypeArray: {
+        auto stride = module.arrayStrides.find(id);
+        VkDeviceSize const element = stride != module.arrayStrides.end()
+                                         ? stride->second
+                                         : typeSize(module, ops[0]);
+        return element * constantValue(module, ops[1]);
+    }
+    case OpTypeRuntimeArray:
+        return 0;
+    case OpTypePointer:
+        // Only buffer references can be members of a block
+        return ops[0] == STORAGE_PHYSICAL_STORAGE_BUFFER
+                   ? sizeof(VkDeviceAddress)
+                   : 0;
+    case OpTypeStruct: {
+        VkDeviceSize size = 0;
+        auto offsets = module.offsets.find(id);
+        auto strides = module.matrixStrides.find(id);
+        for (uint32_t member = 0; member < ops.size(); member++) {
+            VkDeviceSize offset = 0;
+            if (offsets != module.offsets.end() &&
+                offsets->second.contains(member)) {
+                offset = offsets->second.at(member);
+            }
+            uint32_t stride = 0;
+            if (strides != module.matrixStrides.end() &&
+                strides->second.contains(member)) {
+                stride = strides->second.at(member);
+            }
+            size = std::max(size,
+                            offset + typeSize(module, ops[member], stride));
+        }
+        return size;
+    }
+    default:
+        return 0;
+    }
+}
+
+/**
+ * \brief The element stride of a runtime array ending struct id, or 0.
+ */
+VkDeviceSize runtimeStride(Module const &module, uint32_t id) {
+    Declaration const &type = declaration(module, id);
+    if (type.opcode != OpTypeStruct || type.operands.empty()) {
+        return 0;
+    }
+    uint32_t const last = type.operands.back();
+    if (declaration(module, last).opcode != OpTypeRuntimeArray) {
+        return 0;
+    }
+    auto stride = module.arrayStrides.find(last);
+    return stride != module.arrayStrides.end() ? stride->second : 0;
+}
+
+VkDescriptorType descriptorType(Module const &module, uint32_t storage,
+                                uint32_t typeId) {
+    Declaration const &type = declaration(module, typeId);
+    if (storage == STORAGE_STORAGE_BUFFER) {
+        return VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    }
+    if (storage == STORAGE_UNIFORM) {
+        // Before SPIR-V 1.3 storage buffers are Uniform BufferBlocks
+        return module.bufferBlocks.contains(typeId)
+                   ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+                   : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    }
+    if (storage == STORAGE_UNIFORM_CONSTANT) {
+        switch (type.opcode) {
+        case OpTypeSampler:
+            return VK_DESCRIPTOR_TYPE_SAMPLER;
+        case OpTypeSampledImage:
+            return VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        case OpTypeImage: {
+            bool const storageImage = type.operands[5] == IMAGE_STORAGE;
+            if (type.operands[1] == DIM_BUFFER) {
+                return storageImage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER
+                                    : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            }
+            return storageImage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE
+                                : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+        }
+        default:
+            break;
+        }
+    }
+    throw std::runtime_error("unsupported SPIR-V descriptor type");
+}
+
+Module parse(std::vector<uint32_t> const &code) {
+    if (code.size() < SPIRV_HEADER_WORDS || code[0] != SPIRV_MAGIC) {
+        throw std::runtime_error("not a SPIR-V module");
+    }
+
+    Module module;
+    std::vector<uint32_t> localSizeIds;
+    bool hasLocalSize = false;
+
+    size_t word = SPIRV_HEADER_WORDS;
+    while (word < code.size()) {
+        uint32_t const count = code[word] >> 16;
+        uint32_t const opcode = code[word] & 0xFFFF;
+        if (count == 0 || word + count > code.size()) {
+            throw std::runtime_error("truncated SPIR-V instruction");
+        }
+        uint32_t const *ops = &code[word + 1];
+        size_t const opCount = count - 1;
+
+        switch (opcode) {
+        case OpName:
+            module.names[ops[0]] = literalString(ops + 1, opCount - 1);
+            break;
+        case OpCapability:
+            if (ops[0] == CAPABILITY_PHYSICAL_STORAGE_BUFFER_ADDRESSES) {
+                module.deviceAddresses = true;
+            }
+            break;
+        case OpEntryPoint:
+            if (ops[0] == EXECUTION_MODEL_GL_COMPUTE &&
+                !module.entryPoint.has_value()) {
+                module.entryPoint = ops[1];
+                module.names[ops[1]] = literalString(ops + 2, opCount - 2);
+            }
+            break;
+        case OpExecutionMode:
+            if (ops[1] == EXECUTION_MODE_LOCAL_SIZE && opCount >= 5) {
+                module.localSize = {ops[2], ops[3], ops[4]};
+                hasLocalSize = true;
+            }
+            break;
+        case OpExecutionModeId:
+            if (ops[1] == EXECUTION_MODE_LOCAL_SIZE_ID && opCount >= 5) {
+                localSizeIds = {ops[2], ops[3], ops[4]};
+            }
+            break;
+        case OpDecorate:
+            switch (ops[1]) {
+            case DecorationSpecId:
+                module.specIds[ops[0]] = ops[2];
+                break;
+            case DecorationBufferBlock:
+                module.bufferBlocks.insert(ops[0]);
+                break;
+            case DecorationArrayStride:
+                module.arrayStrides[ops[0]] = ops[2];
+                break;
+            case DecorationBuiltIn:
+                if (ops[2] == BUILT_IN_WORKGROUP_SIZE) {
+                    module.workgroupSize = ops[0];
+                }
+                break;
+            case DecorationBinding:
+                module.bindings[ops[0]] = ops[2];
+                break;
+            case DecorationDescriptorSet:
+                module.sets[ops[0]] = ops[2];
+                break;
+            default:
+                break;
+            }
+            break;
+        case OpMemberDecorate:
+            if (ops[2] == DecorationOffset) {
+                module.offsets[ops[0]][ops[1]] = ops[3];
+            } else if (ops[2] == DecorationMatrixStride) {
+                module.matrixStrides[ops[0]][ops[1]] = ops[3];
+            }
+            break;
+        case OpTypeInt:
+        case OpTypeFloat:
+        case OpTypeVector:
+        case OpTypeMatrix:
+        case OpTypeImage:
+        case OpTypeSampler:
+        case OpTypeSampledImage:
+        case OpTypeArray:
+        case OpTypeRuntimeArray:
+        case OpTypeStruct:
+        case OpTypePointer:
+            module.declarations[ops[0]] = {
+                opcode, std::vector<uint32_t>(ops + 1, ops + opCount)};
+            break;
+        case OpConstant:
+        case OpConstantComposite:
+        case OpSpecConstant:
+        case OpSpecConstantComposite:
+            // Constants have their type first, keep it as the first operand
+            module.declarations[ops[1]] = {opcode, {ops[0]}};
+            module.declarations[ops[1]].operands.insert(
+                module.declarations[ops[1]].operands.end(), ops + 2,
+                ops + opCount);
+            break;
+        case OpVariable:
+            module.variables.emplace_back(ops[0], ops[1]);
+            break;
+        default:
+            break;
+        }
+        word += count;
+    }
+
+    if (!module.entryPoint.has_value()) {
+        throw std::runtime_error("SPIR-V module has no compute entry point");
+    }
+
+    // The WorkgroupSize built-in takes precedence over the execution modes
+    if (module.workgroupSize.has_value()) {
+        Declaration const &size = declaration(module, *module.workgroupSize);
+        localSizeIds.assign(size.operands.begin() + 1, size.operands.end());
+    }
+    if (localSizeIds.size() == 3) {
+        for (size_t axis = 0; axis < 3; axis++) {
+            module.localSize[axis] =
+                constantValue(module, localSizeIds[axis]);
+            auto specId = module.specIds.find(localSizeIds[axis]);
+            if (specId != module.specIds.end()) {
+                module.localSizeSpecIds[axis] = specId->second;
+            }
+        }
+        hasLocalSize = true;
+    }
+    if (!hasLocalSize) {
+        throw std::runtime_error("SPIR-V module has no workgroup size");
+    }
+    return module;
+}
+} // namespace
+
+uint32_t ShaderLayout::setCount() const {
+    uint32_t count = 0;
+    for (Binding const &binding : bindings) {
+        count = std::max(count, binding.set + 1);
+    }
+    return count;
+}
+
+std::vector<Binding> ShaderLayout::set(uint32_t set) const {
+    std::vector<Binding> found;
+    std::copy_if(bindings.begin(), bindings.end(), std::back_inserter(found),
+                 [&](Binding const &binding) { return binding.set == set; });
+    return found;
+}
+
+std::array<uint32_t, 3>
+ShaderLayout::groupCount(std::array<uint32_t, 3> const &invocations) const {
+    std::array<uint32_t, 3> groups{};
+    for (size_t axis = 0; axis < 3; axis++) {
+        groups[axis] = (invocations[axis] + localSize[axis] - 1) /
+                       std::max(localSize[axis], 1U);
+    }
+    return groups;
+}
+
+ShaderLayout reflect(std::vector<uint32_t> const &code) {
+    Module const module = parse(code);
+
+    ShaderLayout layout;
+    layout.localSize = module.localSize;
+    layout.localSizeSpecIds = module.localSizeSpecIds;
+    layout.deviceAddresses = module.deviceAddresses;
+    layout.entryPoint = module.names.at(*module.entryPoint);
+
+    for (auto const &[pointerId, id] : module.variables) {
+        Declaration const &pointer = declaration(module, pointerId);
+        uint32_t const storage = pointer.operands[0];
+        uint32_t typeId = pointer.operands[1];
+
+        if (storage == STORAGE_PUSH_CONSTANT) {
+            layout.pushConstantSize = std::max(
+                layout.pushConstantSize,
+                static_cast<uint32_t>(typeSize(module, typeId)));
+            continue;
+        }
+        if (!module.sets.contains(id) || !module.bindings.contains(id)) {
+            continue;
+        }
+
+        Binding binding;
+        binding.set = module.sets.at(id);
+        binding.binding = module.bindings.at(id);
+
+        // An array of descriptors, not an array inside a block
+        Declaration const *type = &declaration(module, typeId);
+        if (type->opcode == OpTypeRuntimeArray) {
+            throw std::runtime_error(
+                "runtime descriptor arrays are not supported");
+        }
+        if (type->opcode == OpTypeArray) {
+            binding.count = constantValue(module, type->operands[1]);
+            typeId = type->operands[0];
+        }
+
+        binding.type = descriptorType(module, storage, typeId);
+        if (binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER ||
+            binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+            binding.size = typeSize(module, typeId);
+            binding.stride = runtimeStride(module, typeId);
+        }
+
+        auto name = module.names.find(typeId);
+        if (name == module.names.end() || name->second.empty()) {
+            name = module.names.find(id);
+        }
+        if (name != module.names.end()) {
+            binding.name = name->second;
+        }
+        layout.bindings.push_back(binding);
+    }
+
+    std::sort(layout.bindings.begin(), layout.bindings.end(),
+              [](Binding const &a, Binding const &b) {
+                  return a.set != b.set ? a.set < b.set
+                                        : a.binding < b.binding;
+              });
+    return layout;
+}
+} // namespace reflection
@@ -0,0 +1,265 @@
+#include "vulkan_base/scheduler.h"
+#include "vulkan_base/create_info.h"
+#include "vulkan_base/trace.h"
+
+#include <stdexcept>
+#include <string>
+
+namespace scheduler {
+Lane::Lane(Scheduler *scheduler, size_t timeline)
+    : m_scheduler(scheduler), m_timeline(timeline) {}
+
+Lane::Lane(Lane &&other) noexcept
+    : m_scheduler(other.m_scheduler), m_timeline(other.m_timeline) {
+    other.m_scheduler = nullptr;
+}
+
+Lane::~Lane() {
+    if (m_scheduler != nullptr) {
+        m_scheduler->m_release(m_timeline);
+    }
+}
+
+VkQueue Lane::queue() const {
+    return m_scheduler->m_timelines[m_timeline]->queue;
+}
+
+uint32_t Lane::family() const {
+    return m_scheduler->m_timelines[m_timeline]->family;
+}
+
+Scheduler::Scheduler(std::shared_ptr<device::DeviceHandler> deviceHandler)
+    : m_deviceHandler(std::move(deviceHandler)) {
+    QueueFamilyIndices const &families = m_deviceHandler->queueFamilies;
+    m_dedicatedTransfer = m_deviceHandler->transferQueue != VK_NULL_HANDLE &&
+                          families.hasDedicatedTransfer();
+
+    auto addTimeline = [this](VkQueue queue, uint32_t family) {
+        auto timeline = std::make_unique<Timeline>();
+        timeline->queue = queue;
+        timeline->family = family;
+        m_timelines.push_back(std::move(timeline));
+    };
+    for (VkQueue queue : m_deviceHandler->computeQueues) {
+        addTimeline(queue, *families.computeFamily);
+    }
+    for (VkQueue queue : m_deviceHandler->asyncComputeQueues) {
+        addTimeline(queue, *families.asyncComputeFamily);
+    }
+    if (m_dedicatedTransfer) {
+        m_transfer = m_timelines.size();
+        addTimeline(m_deviceHandler->transferQueue, *families.transferFamily);
+    }
+
+    m_sync = std::make_unique<SyncObjects>(m_deviceHandler,
+                                           m_timelines.size(), true);
+    for (size_t i = 0; i < m_timelines.size(); i++) {
+        m_timelines[i]->semaphore = (*m_sync->timed_semaphores)[i];
+    }
+}
+
+Scheduler::~Scheduler() {
+    for (auto const &timeline : m_timelines) {
+        wait(m_last(*timeline));
+    }
+}
+
+Scheduler::Timeline &Scheduler::m_timeline(QueueType queue) {
+    return *m_timelines[queue == QueueType::Transfer ? m_transfer : 0];
+}
+
+Scheduler::Timeline const &Scheduler::m_timeline(QueueType queue) const {
+    return *m_timelines[queue == QueueType::Transfer ? m_transfer : 0];
+}
+
+Lane Scheduler::acquire(std::optional<uint32_t> family) {
+    uint32_t const wanted =
+        family.value_or(*m_deviceHandler->queueFamilies.computeFamily);
+
+    std::lock_guard<std::mutex> lock(m_laneMutex);
+    std::optional<size_t> best;
+    for (size_t i = 0; i < m_timelines.size(); i++) {
+        size_t const index = (m_nextLane + i) % m_timelines.size();
+        Timeline const &timeline = *m_timelines[index];
+        if (timeline.family != wanted ||
+            (m_dedicatedTransfer && index == m_transfer)) {
+            continue;
+        }
+        if (!best.has_value() || timeline.lanes < m_timelines[*best]->lanes) {
+            best = index;
+        }
+    }
+    if (!best.has_value()) {
+        throw std::runtime_error("no compute queue in family " +
+                                 std::to_string(wanted));
+    }
+
+    m_timelines[*best]->lanes++;
+    m_nextLane = (*best + 1) % m_timelines.size();
+    return {this, *best};
+}
+
+void Scheduler::m_release(size_t timeline) {
+    std::lock_guard<std::mutex> lock(m_laneMutex);
+    m_timelines[timeline]->lanes--;
+}
+
+Point Scheduler::submit(QueueType queue,
+                        std::vector<VkCommandBuffer> const &cmds,
+                        std::vector<Wait> const &waits, VkFence fence) {
+    return m_submit(m_timeline(queue), cmds, waits, fence);
+}
+
+Point Scheduler::submit(Lane const &lane,
+                        std::vector<VkCommandBuffer> const &cmds,
+                        std::vector<Wait> const &waits, VkFence fence) {
+    return m_submit(*m_timelines[lane.m_timeline], cmds, waits, fence);
+}
+
+Point Scheduler::submit(Lane const &lane, VkCommandBuffer cmd,
+                        std::vector<Wait> const &waits) {
+    return submit(lane, std::vector<VkCommandBuffer>{cmd}, waits);
+}
+
+Point Scheduler::m_submit(Timeline &timeline,
+                          std::vector<VkCommandBuffer> const &cmds,
+                          std::vector<Wait> const &waits, VkFence fence) {
+    tracing::Span span("submit", "submit");
+
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<uint64_t> waitValues;
+    std::vector<VkPipelineStageFlags> waitStages;
+    for (Wait const &wait : waits) {
+        // Points of timeline itself are kept: batches of one queue only
+        // start in order
+        if (m_passed(wait.point)) {
+            continue;
+        }
+        waitSemaphores.push_back(wait.point.semaphore);
+        waitValues.push_back(wait.point.value);
+        waitStages.push_back(wait.stage);
+    }
+
+    std::lock_guard<std::mutex> lock(timeline.mutex);
+    uint64_t const signalValue = timeline.nextValue++;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timelineInfo.waitSemaphoreValueCount =
+        static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo submitInfo = create_info::submitInfo();
+    submitInfo.commandBufferCount = static_cast<uint32_t>(cmds.size());
+    submitInfo.pCommandBuffers = cmds.data();
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount =
+        static_cast<uint32_t>(waitSemaphores.size());
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &timeline.semaphore;
+
+    VK_CHECK(m_deviceHandler->submit(timeline.queue, 1, &submitInfo, fence));
+    return {timeline.semaphore, signalValue};
+}
+
+Point Scheduler::submit(QueueType queue, VkCommandBuffer cmd,
+                        std::vector<Wait> const &waits) {
+    return submit(queue, std::vector<VkCommandBuffer>{cmd}, waits);
+}
+
+Point Scheduler::last(QueueType queue) { return m_last(m_timeline(queue)); }
+
+Point Scheduler::last(Lane const &lane) {
+    return m_last(*m_timelines[lane.m_timeline]);
+}
+
+Point Scheduler::m_last(Timeline &timeline) {
+    std::lock_guard<std::mutex> lock(timeline.mutex);
+    return {timeline.semaphore, timeline.nextValue - 1};
+}
+
+void Scheduler::m_reached(VkSemaphore semaphore, uint64_t value) const {
+    for (auto const &timeline : m_timelines) {
+        if (timeline->semaphore == semaphore) {
+            uint64_t seen = timeline->reached.load();
+            while (seen < value &&
+                   !timeline->reached.compare_exchange_weak(seen, value)) {
+            }
+            return;
+        }
+    }
+}
+
+bool Scheduler::m_passed(Point const &point) const {
+    if (point.semaphore == VK_NULL_HANDLE || point.value == 0) {
+        return true;
+    }
+    for (auto const &timeline : m_timelines) {
+        if (timeline->semaphore == point.semaphore) {
+            return point.value <= timeline->reached.load();
+        }
+    }
+    return false;
+}
+
+uint64_t Scheduler::completed(QueueType queue) const {
+    Timeline const &timeline = m_timeline(queue);
+    uint64_t value = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(*m_deviceHandler, timeline.semaphore,
+                                        &value));
+    m_reached(timeline.semaphore, value);
+    return value;
+}
+
+void Scheduler::wait(Point const &point) const {
+    if (point.semaphore == VK_NULL_HANDLE || point.value == 0) {
+        return;
+    }
+    tracing::Span span("wait", "wait");
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &point.semaphore;
+    waitInfo.pValues = &point.value;
+    VK_CHECK(vkWaitSemaphores(*m_deviceHandler, &waitInfo,
+                              DEFAULT_FENCE_TIMEOUT));
+    m_reached(point.semaphore, point.value);
+    m_deviceHandler->allocator->invalidateRead(point.semaphore, point.value);
+}
+
+bool Scheduler::poll(Point const &point) const {
+    if (point.semaphore == VK_NULL_HANDLE || point.value == 0) {
+        return true;
+    }
+    uint64_t value = 0;
+    VK_CHECK(
+        vkGetSemaphoreCounterValue(*m_deviceHandler, point.semaphore, &value));
+    if (value < point.value) {
+        return false;
+    }
+    m_reached(point.semaphore, value);
+    m_deviceHandler->allocator->invalidateRead(point.semaphore, value);
+    return true;
+}
+
+void Scheduler::waitIdle(QueueType queue) { wait(last(queue)); }
+
+VkQueue Scheduler::queue(QueueType queue) const {
+    return m_timeline(queue).queue;
+}
+
+uint32_t Scheduler::family(QueueType queue) const {
+    return m_timeline(queue).family;
+}
+
+QueueType Scheduler::typeOf(VkQueue queue) const {
+    if (m_dedicatedTransfer && queue == m_timelines[m_transfer]->queue) {
+        return QueueType::Transfer;
+    }
+    return QueueType::Compute;
+}
+} // namespace scheduler
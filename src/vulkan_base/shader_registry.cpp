@@ -0,0 +1,82 @@
+#include "vulkan_base/shader_registry.h"
+#include "vulkan_base/trace.h"
+#include "vulkan_base/utils.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+namespace shaders {
+Registry::Registry(VkDevice device) : m_device(device) {}
+
+Registry::~Registry() {
+    for (auto &[name, entry] : m_entries) {
+        vkDestroyShaderModule(m_device, entry.module, nullptr);
+    }
+}
+
+void Registry::setOverrideDirectory(std::string directory) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_overrideDirectory = std::move(directory);
+}
+
+bool Registry::contains(std::string const &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_entries.contains(name) || !m_overridePath(name).empty()) {
+        return true;
+    }
+    std::span<Embedded const> const modules = embedded();
+    return std::any_of(
+        modules.begin(), modules.end(),
+        [&](Embedded const &module) { return name == module.name; });
+}
+
+std::vector<uint32_t> const &Registry::code(std::string const &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_load(name).code;
+}
+
+VkShaderModule Registry::module(std::string const &name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry &entry = m_load(name);
+    if (entry.module == VK_NULL_HANDLE) {
+        tracing::Span span("module " + name, "shader");
+        entry.module = utils::createShaderModule(entry.code, m_device);
+    }
+    return entry.module;
+}
+
+Registry::Entry &Registry::m_load(std::string const &name) {
+    auto found = m_entries.find(name);
+    if (found != m_entries.end()) {
+        return found->second;
+    }
+
+    Entry entry;
+    std::string const path = m_overridePath(name);
+    if (!path.empty()) {
+        entry.code = utils::readSpirv(path.c_str());
+    } else {
+        for (Embedded const &module : embedded()) {
+            if (name == module.name) {
+                entry.code.assign(module.code,
+                                  module.code + module.wordCount);
+                break;
+            }
+        }
+    }
+    if (entry.code.empty()) {
+        throw std::runtime_error("No shader named " + name);
+    }
+    return m_entries.emplace(name, std::move(entry)).first->second;
+}
+
+std::string Registry::m_overridePath(std::string const &name) const {
+    if (m_overrideDirectory.empty()) {
+        return {};
+    }
+    std::string path =
+        (std::filesystem::path(m_overrideDirectory) / name).string();
+    return utils::fileExists(path) ? path : std::string{};
+}
+} // namespace shaders
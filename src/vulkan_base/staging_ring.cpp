@@ -0,0 +1,121 @@
+#include "vulkan_base/staging_ring.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace staging {
+StagingRing::StagingRing(std::shared_ptr<device::DeviceHandler> deviceHandler,
+                         transfer::TransferEngine &transferEngine,
+                         VkDeviceSize capacity)
+    : m_deviceHandler(std::move(deviceHandler)),
+      m_transferEngine(transferEngine), m_capacity(capacity),
+      m_alignment(std::max<VkDeviceSize>(
+          m_deviceHandler->properties.limits.optimalBufferCopyOffsetAlignment,
+          1)) {
+    VK_CHECK(m_deviceHandler->createBuffer(
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+            VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+        m_capacity, &m_buffer, &m_allocation, nullptr));
+}
+
+StagingRing::~StagingRing() {
+    while (!m_inFlight.empty()) {
+        m_retireOldest();
+    }
+    m_deviceHandler->destroyBuffer(m_buffer, m_allocation);
+}
+
+bool StagingRing::m_reserve(VkDeviceSize size, VkDeviceSize &offset) const {
+    if (m_inFlight.empty()) {
+        offset = 0;
+        return size <= m_capacity;
+    }
+
+    VkDeviceSize const head =
+        (m_head + m_alignment - 1) / m_alignment * m_alignment;
+    VkDeviceSize const tail = m_inFlight.front().begin;
+
+    // The inequalities against tail are strict so that head == tail always
+    // means an empty ring, never a full one.
+    if (head >= tail) {
+        if (head + size <= m_capacity) {
+            offset = head;
+            return true;
+        }
+        if (size < tail) {
+            offset = 0;
+            return true;
+        }
+        return false;
+    }
+
+    if (head + size < tail) {
+        offset = head;
+        return true;
+    }
+    return false;
+}
+
+void StagingRing::m_retireOldest() {
+    m_transferEngine.waitTransfer(m_inFlight.front().value);
+    m_inFlight.pop_front();
+}
+
+void StagingRing::m_retireCompleted() {
+    uint64_t const completed = m_transferEngine.completedTransfer();
+    while (!m_inFlight.empty() && m_inFlight.front().value <= completed) {
+        m_inFlight.pop_front();
+    }
+}
+
+transfer::Token
+StagingRing::upload(void const *data, VkDeviceSize size, VkBuffer dst,
+                    VkDeviceSize dstOffset, VkSharingMode sharingMode,
+                    std::vector<scheduler::Point> const &after) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    VkDeviceSize const chunkSize =
+        std::max<VkDeviceSize>(m_capacity / STAGING_CHUNK_FRACTION, 1);
+    auto const *src = static_cast<char const *>(data);
+    transfer::Token token{};
+
+    m_retireCompleted();
+
+    for (VkDeviceSize done = 0; done < size;) {
+        VkDeviceSize const chunk = std::min(chunkSize, size - done);
+
+        VkDeviceSize offset = 0;
+        while (!m_reserve(chunk, offset)) {
+            m_retireOldest();
+        }
+
+        std::memcpy(static_cast<char *>(m_allocation.mapped) + offset,
+                    src + done, chunk);
+
+        VkBufferCopy copyRegion{};
+        copyRegion.srcOffset = offset;
+        copyRegion.dstOffset = dstOffset + done;
+        copyRegion.size = chunk;
+
+        // Only the last chunk hands dst over, the earlier ones are ordered
+        // before it on the transfer queue.
+        bool const last = done + chunk == size;
+        uint64_t value = 0;
+        token = m_transferEngine.copy(
+            m_buffer, dst, copyRegion,
+            last ? transfer::Handoff::ToCompute : transfer::Handoff::None,
+            sharingMode, &value, after);
+
+        m_inFlight.push_back({offset, offset + chunk, value});
+        m_head = offset + chunk;
+        done += chunk;
+    }
+
+    return token;
+}
+
+void StagingRing::wait(transfer::Token const &token) const {
+    m_transferEngine.wait(token);
+}
+} // namespace staging
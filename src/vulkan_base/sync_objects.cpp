@@ -1,4 +1,5 @@
 #include "vulkan_base/sync_objects.h"
+#include <stdexcept>
 #include <vulkan/vulkan_core.h>
 
 SyncObjects::SyncObjects(std::shared_ptr<device::DeviceHandler> deviceHandler,
@@ -14,15 +15,15 @@ SyncObjects::SyncObjects(std::shared_ptr<device::DeviceHandler> deviceHandler,
     semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
     semaphoreInfo.flags = 0;
 
-    VkSemaphoreTypeCreateInfo timelineCreateInfo;
+    VkSemaphoreTypeCreateInfo timelineCreateInfo{};
     timelineCreateInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
     timelineCreateInfo.pNext = nullptr;
     timelineCreateInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
     timelineCreateInfo.initialValue = 0;
 
     VkSemaphoreCreateInfo timedSemaphoreInfo = {};
-    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    semaphoreInfo.flags = 0;
+    timedSemaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    timedSemaphoreInfo.flags = 0;
     timedSemaphoreInfo.pNext = &timelineCreateInfo;
 
     VkFenceCreateInfo fenceInfo = {};
@@ -53,4 +54,9 @@ SyncObjects::~SyncObjects() {
         vkDestroySemaphore(*m_deviceHandler, semaphores[i], nullptr);
         vkDestroyFence(*m_deviceHandler, fences[i], nullptr);
     }
+    if (timed_semaphores.has_value()) {
+        for (VkSemaphore semaphore : *timed_semaphores) {
+            vkDestroySemaphore(*m_deviceHandler, semaphore, nullptr);
+        }
+    }
 }
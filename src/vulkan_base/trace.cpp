@@ -0,0 +1,203 @@
+#include "vulkan_base/trace.h"
+#include "common.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+#include <utility>
+
+namespace tracing {
+namespace {
+constexpr int HOST_PID = 1; /**< Process id of the thread tracks */
+constexpr int GPU_PID = 2;  /**< Process id of the queue tracks */
+
+/**
+ * \brief Writes s as a JSON string.
+ */
+void writeString(std::ostream &out, std::string const &s) {
+    out << '"';
+    for (char const c : s) {
+        switch (c) {
+        case '"':
+            out << "\\\"";
+            break;
+        case '\\':
+            out << "\\\\";
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                std::array<char, 8> escaped{};
+                std::snprintf(escaped.data(), escaped.size(), "\\u%04x", c);
+                out << escaped.data();
+            } else {
+                out << c;
+            }
+        }
+    }
+    out << '"';
+}
+
+/**
+ * \brief Writes a metadata event naming a process or a thread.
+ */
+void writeName(std::ostream &out, char const *kind, int pid, uint32_t tid,
+               std::string const &name) {
+    out << "{\"ph\":\"M\",\"name\":\"" << kind << "\",\"pid\":" << pid
+        << ",\"tid\":" << tid << ",\"args\":{\"name\":";
+    writeString(out, name);
+    out << "}}";
+}
+} // namespace
+
+Tracer::Tracer() : m_origin(now()) {}
+
+Tracer &Tracer::instance() {
+    static Tracer tracer;
+    return tracer;
+}
+
+uint64_t Tracer::now() {
+    return static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch())
+            .count());
+}
+
+void Tracer::setEnabled(bool enabled) {
+    m_enabled.store(enabled, std::memory_order_relaxed);
+}
+
+void Tracer::hostSpan(std::string const &name, char const *category,
+                      uint64_t begin, uint64_t end) {
+    if (!enabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_add({name, category, begin, end, 'X', false, m_thread()});
+}
+
+void Tracer::gpuSpan(std::string const &name, char const *queue,
+                     uint64_t begin, uint64_t end) {
+    if (!enabled()) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto track = std::find(m_queues.begin(), m_queues.end(), queue);
+    if (track == m_queues.end()) {
+        track = m_queues.insert(m_queues.end(), queue);
+    }
+    m_add({name, "gpu", begin, end, 'X', true,
+           static_cast<uint32_t>(track - m_queues.begin())});
+}
+
+void Tracer::instant(std::string const &name, char const *category) {
+    if (!enabled()) {
+        return;
+    }
+    uint64_t const time = now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_add({name, category, time, time, 'i', false, m_thread()});
+}
+
+void Tracer::m_add(Event event) {
+    if (m_events.size() >= MAX_TRACE_EVENTS) {
+        m_dropped++;
+        return;
+    }
+    m_events.push_back(std::move(event));
+}
+
+uint32_t Tracer::m_thread() {
+    auto const [thread, added] = m_threads.try_emplace(
+        std::this_thread::get_id(), static_cast<uint32_t>(m_threads.size()));
+    return thread->second;
+}
+
+void Tracer::write(std::ostream &out) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    writeName(out, "process_name", HOST_PID, 0, "host");
+    out << ",\n";
+    writeName(out, "process_name", GPU_PID, 0, "gpu");
+    for (auto const &[id, track] : m_threads) {
+        out << ",\n";
+        writeName(out, "thread_name", HOST_PID, track,
+                  track == 0 ? "main" : "thread " + std::to_string(track));
+    }
+    for (uint32_t track = 0; track < m_queues.size(); track++) {
+        out << ",\n";
+        writeName(out, "thread_name", GPU_PID, track, m_queues[track]);
+    }
+
+    // Chrome traces are in microseconds; relative times keep the precision
+    auto micros = [&](uint64_t time) {
+        return static_cast<double>(static_cast<int64_t>(time - m_origin)) /
+               1000.0;
+    };
+
+    out << std::fixed << std::setprecision(3);
+    for (Event const &event : m_events) {
+        out << ",\n{\"name\":";
+        writeString(out, event.name);
+        out << ",\"cat\":\"" << event.category << "\",\"pid\":"
+            << (event.gpu ? GPU_PID : HOST_PID) << ",\"tid\":" << event.track
+            << ",\"ts\":" << micros(event.begin);
+        if (event.phase == 'i') {
+            out << ",\"ph\":\"i\",\"s\":\"t\"}";
+        } else {
+            out << ",\"ph\":\"X\",\"dur\":"
+                << static_cast<double>(event.end - event.begin) / 1000.0
+                << "}";
+        }
+    }
+    out << "\n]}\n" << std::defaultfloat;
+}
+
+void Tracer::write(std::string const &path) const {
+    std::ofstream out(path);
+    if (!out.is_open()) {
+        throw std::runtime_error("failed to open trace file " + path);
+    }
+    write(out);
+    if (!out.good()) {
+        throw std::runtime_error("failed to write trace file " + path);
+    }
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.clear();
+    m_dropped = 0;
+}
+
+uint64_t Tracer::dropped() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+Span::Span(std::string name, char const *category)
+    : m_name(std::move(name)), m_category(category) {
+    if (Tracer::instance().enabled()) {
+        m_begin = Tracer::now();
+    }
+}
+
+Span::~Span() {
+    if (m_begin != 0) {
+        Tracer::instance().hostSpan(m_name, m_category, m_begin,
+                                    Tracer::now());
+    }
+}
+
+void vkError(VkResult result) {
+    Tracer::instance().instant("VkResult " + std::to_string(result), "error");
+}
+} // namespace tracing
@@ -0,0 +1,216 @@
+#include "vulkan_base/transfer.h"
+#include "vulkan_base/create_info.h"
+
+namespace transfer {
+TransferEngine::TransferEngine(
+    std::shared_ptr<device::DeviceHandler> deviceHandler,
+    scheduler::Scheduler &scheduler, profiling::Profiler *profiler)
+    : m_deviceHandler(std::move(deviceHandler)), m_scheduler(scheduler),
+      m_profiler(profiler) {
+    m_createLane(m_compute, scheduler::QueueType::Compute);
+    m_createLane(m_transfer, scheduler::QueueType::Transfer);
+    m_dedicated = m_transfer.family != m_compute.family;
+}
+
+TransferEngine::~TransferEngine() {
+    m_destroyLane(m_transfer);
+    m_destroyLane(m_compute);
+}
+
+void TransferEngine::m_createLane(Lane &lane, scheduler::QueueType queue) {
+    lane.queue = queue;
+    lane.family = m_scheduler.family(queue);
+
+    VkCommandPoolCreateInfo poolInfo =
+        create_info::commandPoolCreateInfo(lane.family);
+    poolInfo.flags |= VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    VK_CHECK(vkCreateCommandPool(*m_deviceHandler, &poolInfo, nullptr,
+                                 &lane.pool));
+}
+
+void TransferEngine::m_destroyLane(Lane &lane) {
+    if (!lane.pending.empty()) {
+        wait({m_scheduler.last(lane.queue).semaphore,
+              lane.pending.back().first});
+    }
+    vkDestroyCommandPool(*m_deviceHandler, lane.pool, nullptr);
+}
+
+VkCommandBuffer TransferEngine::m_begin(Lane &lane) {
+    uint64_t const completed = m_scheduler.completed(lane.queue);
+    while (!lane.pending.empty() && lane.pending.front().first <= completed) {
+        VK_CHECK(vkResetCommandBuffer(lane.pending.front().second, 0));
+        lane.free.push_back(lane.pending.front().second);
+        lane.pending.pop_front();
+    }
+
+    VkCommandBuffer cmd = VK_NULL_HANDLE;
+    if (lane.free.empty()) {
+        VkCommandBufferAllocateInfo allocInfo =
+            create_info::commandBufferAllocInfo(lane.pool, 1);
+        VK_CHECK(vkAllocateCommandBuffers(*m_deviceHandler, &allocInfo, &cmd));
+    } else {
+        cmd = lane.free.back();
+        lane.free.pop_back();
+    }
+
+    VkCommandBufferBeginInfo beginInfo = create_info::commandBufferBeginInfo();
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+    return cmd;
+}
+
+Token TransferEngine::m_submit(Lane &lane, VkCommandBuffer cmd,
+                               std::vector<scheduler::Wait> const &waits) {
+    VK_CHECK(vkEndCommandBuffer(cmd));
+    Token const point = m_scheduler.submit(lane.queue, cmd, waits);
+    lane.pending.emplace_back(point.value, cmd);
+    return point;
+}
+
+VkBufferMemoryBarrier
+TransferEngine::m_ownershipBarrier(VkBuffer buffer, VkSharingMode sharingMode,
+                                   uint32_t srcFamily,
+                                   uint32_t dstFamily) const {
+    VkBufferMemoryBarrier barrier = create_info::bufferMemoryBarrier();
+    barrier.buffer = buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    if (m_dedicated && sharingMode == VK_SHARING_MODE_EXCLUSIVE) {
+        barrier.srcQueueFamilyIndex = srcFamily;
+        barrier.dstQueueFamilyIndex = dstFamily;
+    }
+    return barrier;
+}
+
+Token TransferEngine::copy(VkBuffer src, VkBuffer dst,
+                           VkBufferCopy const &region, Handoff handoff,
+                           VkSharingMode sharingMode, uint64_t *transferValue,
+                           std::vector<scheduler::Point> const &after) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // The first submission of the copy waits for the work of other lanes
+    bool const released = handoff == Handoff::FromCompute && m_dedicated;
+    std::vector<scheduler::Wait> producers;
+    for (scheduler::Point const &point : after) {
+        producers.push_back({point, released
+                                        ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT
+                                        : VK_PIPELINE_STAGE_TRANSFER_BIT});
+    }
+
+    std::vector<scheduler::Wait> waits;
+    if (!released) {
+        // Nothing else keeps the copy from overwriting dst, or src, while
+        // earlier dispatches on the compute queue still use it
+        waits = producers;
+        waits.push_back({m_scheduler.last(scheduler::QueueType::Compute),
+                         VK_PIPELINE_STAGE_TRANSFER_BIT});
+    } else {
+        // Release src on the compute queue, after the work that wrote it
+        VkCommandBuffer release = m_begin(m_compute);
+        VkBufferMemoryBarrier barrier = m_ownershipBarrier(
+            src, sharingMode, m_compute.family, m_transfer.family);
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(release, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0,
+                             nullptr, 1, &barrier, 0, nullptr);
+        waits.push_back({m_submit(m_compute, release, producers),
+                         VK_PIPELINE_STAGE_TRANSFER_BIT});
+    }
+
+    VkCommandBuffer cmd = m_begin(m_transfer);
+
+    if (handoff == Handoff::FromCompute) {
+        VkBufferMemoryBarrier barrier = m_ownershipBarrier(
+            src, sharingMode, m_compute.family, m_transfer.family);
+        barrier.srcAccessMask = m_dedicated ? 0 : VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(cmd,
+                             m_dedicated ? VK_PIPELINE_STAGE_TRANSFER_BIT
+                                         : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 1,
+                             &barrier, 0, nullptr);
+    }
+
+    uint32_t const scope =
+        m_profiler != nullptr
+            ? m_profiler->begin(cmd, "transfer", profiling::Level::Batch,
+                                m_transfer.queue)
+            : profiling::NO_SCOPE;
+    vkCmdCopyBuffer(cmd, src, dst, 1, &region);
+    if (m_profiler != nullptr) {
+        m_profiler->end(cmd, scope);
+    }
+
+    if (handoff == Handoff::ToCompute) {
+        // Releases dst when dedicated, otherwise makes the copy visible to
+        // the shaders that follow on the same queue.
+        VkBufferMemoryBarrier barrier = m_ownershipBarrier(
+            dst, sharingMode, m_transfer.family, m_compute.family);
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask =
+            m_dedicated ? 0
+                        : VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             m_dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+                                         : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    if (handoff == Handoff::FromCompute) {
+        // Hands src back when dedicated, otherwise keeps the shaders that
+        // follow on the same queue from writing it before it is read.
+        VkBufferMemoryBarrier barrier = m_ownershipBarrier(
+            src, sharingMode, m_transfer.family, m_compute.family);
+        barrier.srcAccessMask = 0;
+        barrier.dstAccessMask = 0;
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             m_dedicated ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+                                         : VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                             0, 0, nullptr, 1, &barrier, 0, nullptr);
+    }
+
+    Token const copied = m_submit(m_transfer, cmd, waits);
+    if (transferValue != nullptr) {
+        *transferValue = copied.value;
+    }
+
+    if (handoff == Handoff::None || !m_dedicated) {
+        return copied;
+    }
+
+    // Acquire the buffer on the compute queue. Everything submitted to the
+    // compute queue later is ordered after this barrier, so it needs no
+    // extra wait.
+    VkCommandBuffer acquire = m_begin(m_compute);
+    VkBufferMemoryBarrier barrier = m_ownershipBarrier(
+        handoff == Handoff::ToCompute ? dst : src, sharingMode,
+        m_transfer.family, m_compute.family);
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask =
+        VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(acquire, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                         VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1,
+                         &barrier, 0, nullptr);
+    return m_submit(m_compute, acquire,
+                    {{copied, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT}});
+}
+
+void TransferEngine::wait(Token const &token) const {
+    m_scheduler.wait(token);
+}
+
+bool TransferEngine::poll(Token const &token) const {
+    return m_scheduler.poll(token);
+}
+
+void TransferEngine::waitTransfer(uint64_t value) const {
+    m_scheduler.wait(
+        {m_scheduler.last(scheduler::QueueType::Transfer).semaphore, value});
+}
+
+uint64_t TransferEngine::completedTransfer() const {
+    return m_scheduler.completed(scheduler::QueueType::Transfer);
+}
+} // namespace transfer
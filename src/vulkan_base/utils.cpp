@@ -1,4 +1,5 @@
 #include "vulkan_base/common.h"
+#include "vulkan_base/trace.h"
 
 #include <fstream>
 
@@ -27,35 +28,46 @@ uint32_t alignedSize(uint32_t value, uint32_t alignment) {
     return (value + alignment - 1) & ~(alignment - 1);
 }
 
-VkShaderModule loadShader(const char *fileName, VkDevice device) {
+std::vector<uint32_t> readSpirv(const char *fileName) {
+    tracing::Span span(std::string("load ") + fileName, "shader");
     std::ifstream input(fileName,
                         std::ios::binary | std::ios::in | std::ios::ate);
 
     if (!input.is_open()) {
         std::cerr << "Error: Could not open shader file \"" << fileName << "\""
                   << "\n";
-        return VK_NULL_HANDLE;
+        return {};
     }
 
-    ssize_t size = input.tellg();
+    std::streamsize const size = input.tellg();
     input.seekg(0, std::ios::beg);
-    char *shaderCode = new char[size];
-    input.read(shaderCode, size);
-    input.close();
 
-    assert(size > 0);
+    assert(size > 0 && size % sizeof(uint32_t) == 0);
 
+    std::vector<uint32_t> code(static_cast<size_t>(size) / sizeof(uint32_t));
+    input.read(reinterpret_cast<char *>(code.data()), size);
+    return code;
+}
+
+VkShaderModule createShaderModule(std::vector<uint32_t> const &code,
+                                  VkDevice device) {
     VkShaderModule shaderModule{};
     VkShaderModuleCreateInfo moduleCreateInfo{};
     moduleCreateInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    moduleCreateInfo.codeSize = size;
-    moduleCreateInfo.pCode = reinterpret_cast<uint32_t *>(shaderCode);
+    moduleCreateInfo.codeSize = code.size() * sizeof(uint32_t);
+    moduleCreateInfo.pCode = code.data();
 
     VK_CHECK(vkCreateShaderModule(device, &moduleCreateInfo, nullptr,
                                   &shaderModule));
 
-    delete[] shaderCode;
-
     return shaderModule;
 }
+
+VkShaderModule loadShader(const char *fileName, VkDevice device) {
+    std::vector<uint32_t> const code = readSpirv(fileName);
+    if (code.empty()) {
+        return VK_NULL_HANDLE;
+    }
+    return createShaderModule(code, device);
+}
 } // namespace utils
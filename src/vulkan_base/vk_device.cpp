@@ -1,15 +1,43 @@
 #include "vulkan_base/vk_device.h"
 #include "vulkan_base/common.h"
 #include "vulkan_base/create_info.h"
+#include "vulkan_base/trace.h"
 
+#include <algorithm>
 #include <cstring>
 #include <map>
+#include <optional>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <vulkan/vulkan_core.h>
 
 namespace device {
+namespace {
+/**
+ * \brief The structure of type sType in the pNext chain, or null.
+ */
+VkBaseOutStructure *findInChain(void *pNext, VkStructureType sType) {
+    auto *chained = static_cast<VkBaseOutStructure *>(pNext);
+    while (chained != nullptr && chained->sType != sType) {
+        chained = chained->pNext;
+    }
+    return chained;
+}
+
+/**
+ * \brief The number of queues in family.
+ */
+uint32_t familyQueueCount(VkPhysicalDevice device, uint32_t family) {
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> families(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount,
+                                             families.data());
+    return families.at(family).queueCount;
+}
+} // namespace
+
 bool DeviceHandler::m_checkDeviceExtensions(VkPhysicalDevice device) {
     uint32_t extensionCount{};
     vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
@@ -29,35 +57,57 @@ bool DeviceHandler::m_checkDeviceExtensions(VkPhysicalDevice device) {
     return requiredExtensions.empty();
 }
 
-bool DeviceHandler::m_deviceIsSuitable(VkPhysicalDevice device) {
-    QueueFamilyIndices indices = getQueueFamilyIndices(device);
-
-    bool extensionsSupported = m_checkDeviceExtensions(device);
-
-    return indices.isComplete() && extensionsSupported;
+bool DeviceHandler::m_supportsExtension(VkPhysicalDevice device,
+                                       char const *name) {
+    uint32_t extensionCount{};
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount,
+                                         extensions.data());
+    return std::any_of(extensions.begin(), extensions.end(),
+                       [&](auto const &extension) {
+                           return std::strcmp(extension.extensionName, name) ==
+                                  0;
+                       });
 }
 
-long int DeviceHandler::m_rateDevice(VkPhysicalDevice device) {
-    if (!m_deviceIsSuitable(device)) {
-        return -1;
+bool DeviceHandler::m_supportsCalibration(VkPhysicalDevice device) {
+    bool const hasExtension = m_supportsExtension(
+        device, VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+
+    auto getDomains =
+        reinterpret_cast<PFN_vkGetPhysicalDeviceCalibrateableTimeDomainsEXT>(
+            vkGetInstanceProcAddr(
+                m_vkInstance,
+                "vkGetPhysicalDeviceCalibrateableTimeDomainsEXT"));
+    if (!hasExtension || getDomains == nullptr) {
+        return false;
     }
 
-    long int score = 0;
+    uint32_t domainCount{};
+    getDomains(device, &domainCount, nullptr);
+    std::vector<VkTimeDomainEXT> domains(domainCount);
+    getDomains(device, &domainCount, domains.data());
+
+    // Host spans are timed with steady_clock, which is CLOCK_MONOTONIC
+    auto has = [&](VkTimeDomainEXT domain) {
+        return std::find(domains.begin(), domains.end(), domain) !=
+               domains.end();
+    };
+    return has(VK_TIME_DOMAIN_DEVICE_EXT) &&
+           has(VK_TIME_DOMAIN_CLOCK_MONOTONIC_EXT);
+}
 
-    vkGetPhysicalDeviceProperties(device, &properties);
-    vkGetPhysicalDeviceFeatures(device, &enabledFeatures);
+bool DeviceHandler::m_deviceIsSuitable(VkPhysicalDevice device) {
+    QueueFamilyIndices indices = getQueueFamilyIndices(device);
 
-    score += properties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU
-                 ? DISCRETE_GPU_BONUS
-                 : INTEGRATED_GPU_BONUS;
-    score += properties.limits.maxImageDimension2D;
-    score *= enabledFeatures.geometryShader;
+    bool extensionsSupported = m_checkDeviceExtensions(device);
 
-    return score;
+    return indices.isComplete() && extensionsSupported;
 }
 
-void DeviceHandler::m_pickDevice() {
-    std::multimap<int, VkPhysicalDevice> candidates;
+void DeviceHandler::m_pickDevice(selection::Policy const &policy) {
     uint32_t deviceCount = 0;
     vkEnumeratePhysicalDevices(m_vkInstance, &deviceCount, nullptr);
 
@@ -68,64 +118,263 @@ void DeviceHandler::m_pickDevice() {
     std::vector<VkPhysicalDevice> devices(deviceCount);
     vkEnumeratePhysicalDevices(m_vkInstance, &deviceCount, devices.data());
 
-    for (const auto &device : devices) {
-        int score = m_rateDevice(device);
-        candidates.emplace(std::make_pair(score, device));
+    std::optional<selection::Candidate> best;
+    long bestScore = 0;
+    for (auto &device : devices) {
+        if (!m_deviceIsSuitable(device)) {
+            continue;
+        }
+        selection::Candidate candidate = selection::describe(device);
+        long const score = policy(candidate);
+        if (score > bestScore) {
+            bestScore = score;
+            best = candidate;
+        }
     }
 
-    if (candidates.rbegin()->first > 0) {
-        physicalDevice = candidates.rbegin()->second;
-        vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-
-    } else {
+    if (!best.has_value()) {
         throw std::runtime_error("failed to find a suitable GPU!");
     }
+
+    physicalDevice = best->physicalDevice;
+    properties = best->properties;
+    enabledFeatures = best->features;
+    deviceUUID = best->uuid;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
 }
 
 void DeviceHandler::m_createLogicalDevice(VkPhysicalDeviceFeatures2 *pNext,
                                           VkAllocationCallbacks *pAllocator) {
-    QueueFamilyIndices indices = getQueueFamilyIndices(physicalDevice);
-
-    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
-    std::set<uint32_t> uniqueQueueFamilies = {indices.computeFamily.value()};
+    // Also checked by selection::computeScore, but a pinned device skips it
+    if (properties.apiVersion < VK_API_VERSION_1_2) {
+        throw std::runtime_error("The device does not support Vulkan 1.2");
+    }
 
+    QueueFamilyIndices indices = getQueueFamilyIndices(physicalDevice);
+    queueFamilies = indices;
+
+    // Every queue of the compute families goes to the scheduler's pool, the
+    // transfer family only needs one
+    std::map<uint32_t, uint32_t> queueCounts = {
+        {indices.computeFamily.value(),
+         familyQueueCount(physicalDevice, indices.computeFamily.value())},
+    };
+    if (indices.hasAsyncCompute()) {
+        queueCounts[indices.asyncComputeFamily.value()] = familyQueueCount(
+            physicalDevice, indices.asyncComputeFamily.value());
+    }
     if (indices.hasDedicatedTransfer()) {
-        uniqueQueueFamilies = {
-            indices.computeFamily.value(),
-            indices.transferFamily.value(),
-        };
+        queueCounts[indices.transferFamily.value()] = 1;
+    }
+
+    uint32_t maxQueueCount = 0;
+    for (auto const &[family, count] : queueCounts) {
+        maxQueueCount = std::max(maxQueueCount, count);
     }
+    std::vector<float> const queuePriorities(maxQueueCount, 1.0F);
 
-    float queuePriority = 1.0F;
-    for (uint32_t queueFamily : uniqueQueueFamilies) {
+    std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
+    for (auto const &[family, count] : queueCounts) {
         VkDeviceQueueCreateInfo queueCreateInfo =
-            create_info::queueCreateInfo(queueFamily, &queuePriority);
+            create_info::queueCreateInfo(family, queuePriorities.data());
+        queueCreateInfo.queueCount = count;
         queueCreateInfos.push_back(queueCreateInfo);
     }
 
     VkPhysicalDeviceFeatures deviceFeatures = {};
-    // deviceFeatures.bufferDeviceAddress = VK_TRUE;
+    // The integrand shaders compute in doubles
+    deviceFeatures.shaderFloat64 = enabledFeatures.shaderFloat64;
+
+    // Calibrated timestamps are optional, the profiler falls back to
+    // estimating the offset of the GPU clock without them
+    std::vector<const char *> extensions = m_deviceExtensions;
+    calibratedTimestamps = m_supportsCalibration(physicalDevice);
+    if (calibratedTimestamps) {
+        extensions.push_back(VK_EXT_CALIBRATED_TIMESTAMPS_EXTENSION_NAME);
+    }
+
+    // Without push descriptors, pipelines bind pooled sets instead
+    pushDescriptors = m_supportsExtension(
+        physicalDevice, VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    if (pushDescriptors) {
+        extensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
+        VkPhysicalDevicePushDescriptorPropertiesKHR pushProperties{};
+        pushProperties.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PUSH_DESCRIPTOR_PROPERTIES_KHR;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &pushProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+        maxPushDescriptors = pushProperties.maxPushDescriptors;
+    }
+
+    // Without subgroup size control the driver picks the subgroup size of
+    // every pipeline, and tuning only sweeps workgroup sizes
+    VkPhysicalDeviceSubgroupSizeControlFeaturesEXT sizeControl{};
+    sizeControl.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_FEATURES_EXT;
+    if (m_supportsExtension(physicalDevice,
+                            VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME)) {
+        VkPhysicalDeviceFeatures2 query{};
+        query.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        query.pNext = &sizeControl;
+        vkGetPhysicalDeviceFeatures2(physicalDevice, &query);
+
+        VkPhysicalDeviceSubgroupSizeControlPropertiesEXT sizeProperties{};
+        sizeProperties.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 properties2{};
+        properties2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        properties2.pNext = &sizeProperties;
+        vkGetPhysicalDeviceProperties2(physicalDevice, &properties2);
+
+        subgroupSizeControl =
+            sizeControl.subgroupSizeControl == VK_TRUE &&
+            static_cast<bool>(sizeProperties.requiredSubgroupSizeStages &
+                              VK_SHADER_STAGE_COMPUTE_BIT);
+        if (subgroupSizeControl) {
+            extensions.push_back(VK_EXT_SUBGROUP_SIZE_CONTROL_EXTENSION_NAME);
+            minSubgroupSize = sizeProperties.minSubgroupSize;
+            maxSubgroupSize = sizeProperties.maxSubgroupSize;
+        }
+    }
+    sizeControl.pNext = nullptr;
+
+    // Reductions fall back to shared memory without subgroup arithmetic
+    VkPhysicalDeviceSubgroupProperties subgroupProperties{};
+    subgroupProperties.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_PROPERTIES;
+    VkPhysicalDeviceProperties2 subgroupQuery{};
+    subgroupQuery.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    subgroupQuery.pNext = &subgroupProperties;
+    vkGetPhysicalDeviceProperties2(physicalDevice, &subgroupQuery);
+    subgroupArithmetic =
+        static_cast<bool>(subgroupProperties.supportedStages &
+                          VK_SHADER_STAGE_COMPUTE_BIT) &&
+        static_cast<bool>(subgroupProperties.supportedOperations &
+                          VK_SUBGROUP_FEATURE_ARITHMETIC_BIT);
 
     VkDeviceCreateInfo createInfo =
-        create_info::deviceCreateInfo(queueCreateInfos, m_deviceExtensions,
+        create_info::deviceCreateInfo(queueCreateInfos, extensions,
                                       m_validationLayers, &deviceFeatures);
 
-    if (pNext != VK_NULL_HANDLE) {
+    // Buffer device addresses are optional, shaders that use them are
+    // rejected when the pipeline is created
+    VkPhysicalDeviceVulkan12Features supported12{};
+    supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported12;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &supported);
+    bufferDeviceAddress = supported12.bufferDeviceAddress == VK_TRUE;
+    if (supported12.timelineSemaphore != VK_TRUE) {
+        throw std::runtime_error(
+            "The device does not support timeline semaphores");
+    }
+    hostQueryReset = supported12.hostQueryReset == VK_TRUE;
+
+    // Every submission signals a timeline semaphore, so that feature is
+    // turned on in the caller's chain, or in one of our own if there is
+    // none. The profiler resets its queries from the host if it can, and
+    // with commands otherwise.
+    VkPhysicalDeviceVulkan12Features vulkan12Features{};
+    vulkan12Features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12Features.timelineSemaphore = VK_TRUE;
+    vulkan12Features.hostQueryReset = supported12.hostQueryReset;
+    vulkan12Features.bufferDeviceAddress = supported12.bufferDeviceAddress;
+
+    VkPhysicalDeviceFeatures2 features2{};
+    if (pNext == VK_NULL_HANDLE) {
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.features = deviceFeatures;
+        pNext = &features2;
+    } else {
         pNext->features = enabledFeatures;
-        createInfo.pEnabledFeatures = nullptr;
-        createInfo.pNext = pNext;
     }
 
+    VkBaseOutStructure *chained = findInChain(
+        pNext->pNext, VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES);
+    if (chained != nullptr) {
+        auto *features =
+            reinterpret_cast<VkPhysicalDeviceVulkan12Features *>(chained);
+        features->timelineSemaphore = VK_TRUE;
+        features->hostQueryReset |= supported12.hostQueryReset;
+        features->bufferDeviceAddress |= supported12.bufferDeviceAddress;
+    } else {
+        vulkan12Features.pNext = pNext->pNext;
+        pNext->pNext = &vulkan12Features;
+    }
+
+    // The feature is in the caller's 1.3 features, or in our own structure
+    if (subgroupSizeControl) {
+        if (VkBaseOutStructure *chained13 = findInChain(
+                pNext->pNext,
+                VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES)) {
+            reinterpret_cast<VkPhysicalDeviceVulkan13Features *>(chained13)
+                ->subgroupSizeControl = VK_TRUE;
+        } else if (VkBaseOutStructure *chainedControl = findInChain(
+                       pNext->pNext,
+                       VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SUBGROUP_SIZE_CONTROL_FEATURES_EXT)) {
+            reinterpret_cast<VkPhysicalDeviceSubgroupSizeControlFeaturesEXT *>(
+                chainedControl)
+                ->subgroupSizeControl = VK_TRUE;
+        } else {
+            sizeControl.pNext = pNext->pNext;
+            pNext->pNext = &sizeControl;
+        }
+    }
+
+    createInfo.pEnabledFeatures = nullptr;
+    createInfo.pNext = pNext;
+
     VK_CHECK(vkCreateDevice(physicalDevice, &createInfo, pAllocator,
                             &logicalDevice));
 
-    vkGetDeviceQueue(logicalDevice, indices.computeFamily.value(), 0,
-                     &computeQueue);
+    computeQueues.resize(queueCounts[indices.computeFamily.value()]);
+    for (uint32_t i = 0; i < computeQueues.size(); i++) {
+        vkGetDeviceQueue(logicalDevice, indices.computeFamily.value(), i,
+                         &computeQueues[i]);
+    }
+    computeQueue = computeQueues.front();
+
+    if (indices.hasAsyncCompute()) {
+        asyncComputeQueues.resize(
+            queueCounts[indices.asyncComputeFamily.value()]);
+        for (uint32_t i = 0; i < asyncComputeQueues.size(); i++) {
+            vkGetDeviceQueue(logicalDevice, indices.asyncComputeFamily.value(),
+                             i, &asyncComputeQueues[i]);
+        }
+    }
 
     if (indices.hasDedicatedTransfer()) {
         vkGetDeviceQueue(logicalDevice, indices.transferFamily.value(), 0,
                          &transferQueue);
     }
+
+    // Only read from now on, so looking a lock up needs no lock itself
+    for (VkQueue queue : computeQueues) {
+        m_queueLocks.emplace(queue, std::make_unique<std::mutex>());
+    }
+    for (VkQueue queue : asyncComputeQueues) {
+        m_queueLocks.emplace(queue, std::make_unique<std::mutex>());
+    }
+    if (transferQueue != VK_NULL_HANDLE) {
+        m_queueLocks.emplace(transferQueue, std::make_unique<std::mutex>());
+    }
+}
+
+VkResult DeviceHandler::submit(VkQueue queue, uint32_t submitCount,
+                               VkSubmitInfo const *submits,
+                               VkFence fence) const {
+    auto lock = m_queueLocks.find(queue);
+    if (lock == m_queueLocks.end()) {
+        throw std::runtime_error("submitting to a queue of another device");
+    }
+    allocator->flushWritten();
+    std::lock_guard<std::mutex> guard(*lock->second);
+    return vkQueueSubmit(queue, submitCount, submits, fence);
 }
 
 QueueFamilyIndices
@@ -140,24 +389,41 @@ DeviceHandler::getQueueFamilyIndices(VkPhysicalDevice &device) {
     vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount,
                                              queueFamilies.data());
 
-    int idx = 0;
+    uint32_t idx = 0;
     for (const auto &queueFamily : queueFamilies) {
         const VkQueueFlags maskedFlags =
             (~VK_QUEUE_SPARSE_BINDING_BIT & queueFamily.queueFlags);
-        if (static_cast<bool>(maskedFlags & VK_QUEUE_COMPUTE_BIT)) {
+        if (static_cast<bool>(maskedFlags & VK_QUEUE_COMPUTE_BIT) &&
+            !indices.computeFamily.has_value()) {
             indices.computeFamily = idx;
         }
 
+        // Prefer a pure copy engine over a second compute family
         if (static_cast<bool>(maskedFlags & VK_QUEUE_TRANSFER_BIT) &&
-            !static_cast<bool>(maskedFlags & VK_QUEUE_GRAPHICS_BIT)) {
+            !static_cast<bool>(maskedFlags & VK_QUEUE_GRAPHICS_BIT) &&
+            (!indices.transferFamily.has_value() ||
+             !static_cast<bool>(maskedFlags & VK_QUEUE_COMPUTE_BIT))) {
             indices.transferFamily = idx;
         }
 
-        if (indices.isComplete()) {
+        idx++;
+    }
+
+    // A transfer family that is also the compute family is not dedicated
+    if (indices.transferFamily == indices.computeFamily) {
+        indices.transferFamily.reset();
+    }
+
+    // A compute family without graphics, that neither of the above took,
+    // runs work next to the main compute family
+    for (idx = 0; idx < queueFamilyCount; idx++) {
+        VkQueueFlags const flags = queueFamilies[idx].queueFlags;
+        if (static_cast<bool>(flags & VK_QUEUE_COMPUTE_BIT) &&
+            !static_cast<bool>(flags & VK_QUEUE_GRAPHICS_BIT) &&
+            idx != indices.computeFamily && idx != indices.transferFamily) {
+            indices.asyncComputeFamily = idx;
             break;
         }
-
-        idx++;
     }
 
     return indices;
@@ -166,11 +432,21 @@ DeviceHandler::getQueueFamilyIndices(VkPhysicalDevice &device) {
 DeviceHandler::DeviceHandler(std::vector<const char *> &devExt,
                              std::vector<const char *> &validations,
                              VkInstance m_vkInstance,
-                             VkPhysicalDeviceFeatures2 *pNext)
+                             VkPhysicalDeviceFeatures2 *pNext,
+                             selection::Policy const &policy)
     : m_deviceExtensions(devExt), m_validationLayers(validations),
       m_vkInstance(m_vkInstance) {
-    m_pickDevice();
+    tracing::Span span("device creation", "init");
+    m_pickDevice(policy);
     m_createLogicalDevice(pNext);
+    allocator = std::make_unique<memory::Allocator>(*this);
+    shaderRegistry = std::make_unique<shaders::Registry>(logicalDevice);
+}
+
+void DeviceHandler::cleanupDevice(VkAllocationCallbacks *pAllocator) {
+    shaderRegistry.reset();
+    allocator.reset();
+    vkDestroyDevice(logicalDevice, pAllocator);
 }
 
 uint32_t DeviceHandler::getMemoryType(uint32_t typeBits,
@@ -196,55 +472,119 @@ uint32_t DeviceHandler::getMemoryType(uint32_t typeBits,
     throw std::runtime_error("Could not find a matching memory type");
 }
 
+uint32_t DeviceHandler::getMemoryType(uint32_t typeBits,
+                                      memory::Usage intent) const {
+    VkMemoryPropertyFlags const deviceLocal =
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+    VkMemoryPropertyFlags const hostVisible =
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+    VkMemoryPropertyFlags const cached = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+    // Weights of the flags a type has, the highest total wins. Coherence
+    // only breaks ties, non-coherent ranges are flushed by the allocator.
+    int deviceLocalWeight = 0;
+    int hostVisibleWeight = 0;
+    int cachedWeight = 0;
+    int const coherentWeight = intent == memory::Usage::GpuOnly ? 0 : 1;
+    switch (intent) {
+    case memory::Usage::GpuOnly:
+        // Leaves the BAR and host memory to the buffers the host touches
+        deviceLocalWeight = 4;
+        hostVisibleWeight = -2;
+        break;
+    case memory::Usage::Upload:
+        // Sequential writes are fastest write-combined, straight into VRAM
+        deviceLocalWeight = 4;
+        cachedWeight = -1;
+        break;
+    case memory::Usage::Readback:
+        // Reads from uncached memory go over the bus one by one
+        cachedWeight = 4;
+        deviceLocalWeight = -1;
+        break;
+    case memory::Usage::HostRandomAccess:
+        cachedWeight = 4;
+        deviceLocalWeight = 1;
+        break;
+    }
+    VkMemoryPropertyFlags const required =
+        intent == memory::Usage::GpuOnly ? 0 : hostVisible;
+    VkMemoryPropertyFlags const unusable =
+        VK_MEMORY_PROPERTY_PROTECTED_BIT |
+        VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+
+    std::optional<uint32_t> best;
+    int bestScore = 0;
+    for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+        VkMemoryType const &type = memoryProperties.memoryTypes[i];
+        VkMemoryPropertyFlags const flags = type.propertyFlags;
+        if (((typeBits >> i) & 1) == 0 || (flags & required) != required ||
+            static_cast<bool>(flags & unusable)) {
+            continue;
+        }
+
+        // Without resizable BAR the host-visible VRAM is a small window,
+        // too small to hold the uploads, and ranks below system memory
+        bool const smallBar =
+            static_cast<bool>(flags & deviceLocal) &&
+            static_cast<bool>(flags & hostVisible) &&
+            memoryProperties.memoryHeaps[type.heapIndex].size <=
+                memory::SMALL_BAR_HEAP_SIZE;
+
+        int score = smallBar ? -1 : 0;
+        if (static_cast<bool>(flags & deviceLocal) && !smallBar) {
+            score += deviceLocalWeight;
+        }
+        if (static_cast<bool>(flags & hostVisible)) {
+            score += hostVisibleWeight;
+        }
+        if (static_cast<bool>(flags & cached)) {
+            score += cachedWeight;
+        }
+        if (static_cast<bool>(flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+            score += coherentWeight;
+        }
+        if (!best.has_value() || score > bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+
+    if (!best.has_value()) {
+        throw std::runtime_error("Could not find a matching memory type");
+    }
+    return *best;
+}
+
 VkResult DeviceHandler::createBuffer(VkBufferUsageFlags usageFlags,
                                      VkMemoryPropertyFlags memoryPropertyFlags,
                                      VkDeviceSize size, VkBuffer *buffer,
-                                     VkDeviceMemory *memory, void *data) const {
+                                     memory::Allocation *allocation,
+                                     void *data) const {
     // Create the buffer handle
     VkBufferCreateInfo bufferCreateInfo =
         create_info::bufferCreateInfo(usageFlags, size);
     VK_CHECK(vkCreateBuffer(logicalDevice, &bufferCreateInfo, nullptr, buffer));
 
-    // Create the memory backing up the buffer handle
-    VkMemoryRequirements memReqs;
-    vkGetBufferMemoryRequirements(logicalDevice, *buffer, &memReqs);
-
-    VkMemoryAllocateInfo memAlloc = create_info::memoryAllocInfo(
-        memReqs.size,
-        getMemoryType(memReqs.memoryTypeBits, memoryPropertyFlags));
-    // If the buffer has VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT set we also
-    // need to enable the appropriate flag during allocation
-    VkMemoryAllocateFlagsInfoKHR allocFlagsInfo{};
-    if (static_cast<bool>(usageFlags &
-                          VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT)) {
-        allocFlagsInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_FLAGS_INFO_KHR;
-        allocFlagsInfo.flags = VK_MEMORY_ALLOCATE_DEVICE_ADDRESS_BIT_KHR;
-        memAlloc.pNext = &allocFlagsInfo;
-    }
-    VK_CHECK(vkAllocateMemory(logicalDevice, &memAlloc, nullptr, memory));
-
-    // If a pointer to the buffer data has been passed, map the buffer and copy
-    // over the data
+    // Sub-allocate the memory backing up the buffer handle and bind it. The
+    // allocator takes care of the device address flag.
+    *allocation =
+        allocator->allocateBuffer(*buffer, usageFlags, memoryPropertyFlags);
+
+    // If a pointer to the buffer data has been passed, copy over the data
+    // through the persistent mapping
     if (data != nullptr) {
-        void *mapped{};
-        VK_CHECK(vkMapMemory(logicalDevice, *memory, 0, size, 0, &mapped));
-        std::memcpy(mapped, data, size);
-        // If host coherency hasn't been requested, do a manual flush to make
-        // writes visible
-        if ((memoryPropertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT) == 0) {
-            VkMappedMemoryRange mappedRange{};
-            mappedRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-            mappedRange.memory = *memory;
-            mappedRange.offset = 0;
-            mappedRange.size = size;
-            vkFlushMappedMemoryRanges(logicalDevice, 1, &mappedRange);
-        }
-        vkUnmapMemory(logicalDevice, *memory);
+        std::memcpy(allocation->mapped, data, size);
+        // A no-op unless the memory type turned out not to be coherent
+        allocator->flush(*allocation, 0, size);
     }
 
-    // Attach the memory to the buffer object
-    VK_CHECK(vkBindBufferMemory(logicalDevice, *buffer, *memory, 0));
-
     return VK_SUCCESS;
 }
+
+void DeviceHandler::destroyBuffer(VkBuffer buffer,
+                                  memory::Allocation &allocation) const {
+    vkDestroyBuffer(logicalDevice, buffer, nullptr);
+    allocator->free(allocation);
+}
 } // namespace device
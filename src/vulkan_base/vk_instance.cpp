@@ -1,6 +1,7 @@
 #include "vulkan_base/vk_instance.h"
 #include "vulkan_base/common.h"
 #include "vulkan_base/debug.h"
+#include "vulkan_base/trace.h"
 
 #include <stdexcept>
 
@@ -41,6 +42,7 @@ VkInstance createDefaultVkInstance(VkAllocationCallbacks *alloc) {
         createInfo.pNext = nullptr;
     }
 
+    tracing::Span span("instance creation", "init");
     VK_CHECK(vkCreateInstance(&createInfo, alloc, &instance));
 
     return instance;
@@ -83,6 +85,7 @@ VkInstance createNamedVkInstance(const char *name,
         createInfo.pNext = nullptr;
     }
 
+    tracing::Span span("instance creation", "init");
     VK_CHECK(vkCreateInstance(&createInfo, alloc, &instance));
 
     return instance;
@@ -0,0 +1,71 @@
+#include "integrator.h"
+#include "vulkan_base/command_buffer.h"
+#include "vulkan_base/vk_device.h"
+#include "vulkan_base/vk_instance.h"
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+constexpr double TOLERANCE = 1e-9; /**< Rounding of the sums only */
+
+/**
+ * \brief Integrates x + y over [0, 1] x [0, 2], which is 3, with splits
+ * that are not a multiple of the grid.
+ *
+ * Every cell must sample exactly its share of the steps; one that samples
+ * past its end scales the estimate up by the ratio of the points taken.
+ */
+bool linearIntegral(
+    std::shared_ptr<device::DeviceHandler> const &device,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &cmd_buf) {
+    Integrator integrator("integrand0.midpoint.fp64.spv",
+                          QuadratureRule::Midpoint, "reduce.comp.spv", device,
+                          cmd_buf);
+
+    IntegralPushContant bounds{};
+    bounds.start_x = 0.0;
+    bounds.end_x = 1.0;
+    bounds.start_y = 0.0;
+    bounds.end_y = 2.0;
+
+    bool passed = true;
+    for (double const splits : {37.0, 100.0, 1000.0}) {
+        std::unordered_map<std::string, double> const config = {
+            {"init_steps_x", splits}, {"init_steps_y", splits + 3},
+            {"abs_err", 1.0},         {"rel_err", 1.0},
+            {"max_iter", 1.0},
+        };
+        IntegrationResult const result = integrator.integrate(bounds, config);
+        if (std::abs(result.value - 3.0) > TOLERANCE) {
+            std::cerr << std::setprecision(15) << "linear integral with "
+                      << splits << " splits is " << result.value
+                      << ", expected 3\n";
+            passed = false;
+        }
+    }
+    return passed;
+}
+} // namespace
+
+int main() {
+    std::vector<const char *> validation_layers = {
+        "VK_LAYER_KHRONOS_validation",
+    };
+    std::vector<const char *> devExt = {};
+
+    auto instance = std::make_unique<vk_instance::Instance>();
+    auto device = std::make_shared<device::DeviceHandler>(
+        devExt, validation_layers, *instance);
+    auto cmd_buf =
+        std::make_shared<command_buffer::CommandBufferHandler>(device);
+
+    bool const passed = linearIntegral(device, cmd_buf);
+    std::cout << (passed ? "passed" : "failed") << "\n";
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+#include "chunked_stream.h"
+#include "compute_stream.h"
+#include "simple_compute_pipeline.h"
+#include "vulkan_base/buffer.h"
+#include "vulkan_base/command_buffer.h"
+#include "vulkan_base/create_info.h"
+#include "vulkan_base/vk_device.h"
+#include "vulkan_base/vk_instance.h"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace {
+constexpr uint32_t ELEMENTS = 1 << 20; /**< Enough for the copy to race */
+
+/**
+ * \brief Uploads a buffer, dispatches a kernel that reads it and uploads it
+ * again at once.
+ *
+ * The second upload must wait for the dispatch; one that overtakes it
+ * corrupts the input, and the kernel reports the elements it saw changed.
+ */
+bool reuploadAfterDispatch(
+    std::shared_ptr<device::DeviceHandler> const &device,
+    std::shared_ptr<command_buffer::CommandBufferHandler> const &cmd_buf) {
+    SimpleComputePipeline pipeline("compute.comp.chunked.spv", device,
+                                   VK_NULL_HANDLE, DescriptorMode::Push);
+    ComputeStream stream(device, cmd_buf);
+
+    VkDeviceSize const bytes = ELEMENTS * sizeof(int32_t);
+    buffer::Buffer input(device, cmd_buf,
+                         VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                             VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                         memory::Usage::GpuOnly, VK_SHARING_MODE_EXCLUSIVE,
+                         bytes);
+    buffer::Buffer output(device, cmd_buf, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                          memory::Usage::Readback, VK_SHARING_MODE_EXCLUSIVE,
+                          bytes);
+    output.map();
+
+    std::vector<int32_t> values(ELEMENTS);
+    for (uint32_t i = 0; i < ELEMENTS; i++) {
+        values[i] = static_cast<int32_t>(i);
+    }
+    transfer::Token const uploaded = input.copyAsync(values.data(), bytes);
+
+    ChunkPushConstants const header{0, 0, ELEMENTS, 0};
+    scheduler::Point const computed = stream.submit(
+        [&](VkCommandBuffer cmd) {
+            pipeline.record(cmd, {{input.buffer, 0, bytes},
+                                  {output.buffer, 0, bytes}},
+                            &header, sizeof(header),
+                            pipeline.groupCount({ELEMENTS, 1, 1}));
+
+            VkBufferMemoryBarrier barrier = create_info::bufferMemoryBarrier();
+            barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+            barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+            barrier.buffer = output.buffer;
+            barrier.offset = 0;
+            barrier.size = bytes;
+            vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                                 VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                                 &barrier, 0, nullptr);
+        },
+        {{uploaded, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT}});
+    output.markRead(computed, 0, bytes);
+
+    std::vector<int32_t> const overwrite(ELEMENTS, -1);
+    transfer::Token const reuploaded =
+        input.copyAsync(overwrite.data(), bytes, {computed});
+
+    stream.wait(computed);
+    std::vector<int32_t> mismatches(ELEMENTS);
+    std::memcpy(mismatches.data(), output.mapped, bytes);
+    input.wait(reuploaded);
+
+    uint32_t changed = 0;
+    for (int32_t const mismatch : mismatches) {
+        changed += mismatch != 0 ? 1 : 0;
+    }
+    if (changed != 0) {
+        std::cerr << "the dispatch saw " << changed
+                  << " elements of the second upload\n";
+        return false;
+    }
+    return true;
+}
+} // namespace
+
+int main() {
+    std::vector<const char *> validation_layers = {
+        "VK_LAYER_KHRONOS_validation",
+    };
+    std::vector<const char *> devExt = {};
+
+    auto instance = std::make_unique<vk_instance::Instance>();
+    auto device = std::make_shared<device::DeviceHandler>(
+        devExt, validation_layers, *instance);
+    auto cmd_buf =
+        std::make_shared<command_buffer::CommandBufferHandler>(device);
+
+    bool const passed = reuploadAfterDispatch(device, cmd_buf);
+    std::cout << (passed ? "passed" : "failed") << "\n";
+    return passed ? 0 : 1;
+}